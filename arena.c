@@ -0,0 +1,99 @@
+/*
+  mairix - message index builder and finder for maildir folders.
+
+ **********************************************************************
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ **********************************************************************
+ */
+
+/* Scratch memory for the short-lived objects made while parsing a message
+ * (parsed Content-* headers, unfolded header text and so on).  Allocation
+ * just bumps a pointer through a chain of blocks, and nothing is freed
+ * individually: arena_reset() makes all of it available again once the
+ * message is finished with.  The blocks themselves are kept, so after the
+ * first few messages parsing doesn't go near malloc for these at all.
+ *
+ * There is only one arena, so this must only be used from one thread. */
+
+#include "mairix.h"
+#include "memmac.h"
+
+#define ARENA_BLOCK_SIZE 16384
+#define ARENA_ALIGN 8
+
+struct arena_block {/*{{{*/
+  struct arena_block *next;
+  size_t size;
+  size_t used;
+  /* Padding so that the data after the header is aligned */
+  double align;
+};
+/*}}}*/
+
+static struct arena_block *first_block = NULL;
+static struct arena_block *current_block = NULL;
+
+void *arena_alloc(size_t size)/*{{{*/
+{
+  struct arena_block *b;
+  size_t block_size;
+  char *result;
+
+  size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+  b = current_block;
+  while (b && (b->used + size > b->size)) {
+    /* Move on to a block left over from an earlier message, if it's big
+     * enough; a big block made for one large object stays in the chain for
+     * reuse too. */
+    b = b->next;
+    if (b) b->used = 0;
+  }
+
+  if (!b) {
+    block_size = (size > ARENA_BLOCK_SIZE) ? size : ARENA_BLOCK_SIZE;
+    b = (struct arena_block *) Malloc(sizeof(struct arena_block) + block_size);
+    b->size = block_size;
+    b->used = 0;
+    if (current_block) {
+      b->next = current_block->next;
+      current_block->next = b;
+    } else {
+      b->next = NULL;
+      first_block = b;
+    }
+  }
+  current_block = b;
+
+  result = (char *) (b + 1) + b->used;
+  b->used += size;
+  return (void *) result;
+}
+/*}}}*/
+char *arena_string(const char *s, int len)/*{{{*/
+{
+  /* Return a null-terminated copy of the len characters at s. */
+  char *result = arena_alloc(len + 1);
+  memcpy(result, s, len);
+  result[len] = '\0';
+  return result;
+}
+/*}}}*/
+void arena_reset(void)/*{{{*/
+{
+  if (first_block) first_block->used = 0;
+  current_block = first_block;
+}
+/*}}}*/
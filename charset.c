@@ -0,0 +1,477 @@
+/*
+  mairix - message index builder and finder for maildir folders.
+
+ **********************************************************************
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ **********************************************************************
+ */
+
+/* Character set handling.  All text is converted to UTF-8 before it is
+ * tokenised, and tokens are case folded, so that a word ends up as the same
+ * token whichever character set the message was written in and however it
+ * was capitalised.
+ *
+ * UTF-8, ISO-8859-1 and windows-1252 are converted here directly, since they
+ * cover most mail; anything else goes through iconv(3) if it's available.
+ * Text with no declared character set is taken as UTF-8 if it is valid
+ * UTF-8, else as windows-1252 (a superset of ISO-8859-1 in practice).  Pure
+ * ASCII text in any ASCII-compatible character set is left exactly where it
+ * is. */
+
+#include "mairix.h"
+#include <ctype.h>
+
+#ifdef USE_ICONV
+#include <iconv.h>
+#include <errno.h>
+#endif
+
+enum charset_kind {
+  CS_UNDECLARED, /* or us-ascii : valid UTF-8 if possible, else windows-1252 */
+  CS_UTF8,
+  CS_WINDOWS_1252,
+  CS_OTHER,
+  CS_UNKNOWN /* can't be converted, leave it alone */
+};
+
+/* Unicode values for windows-1252 bytes 0x80-0x9f.  The 5 bytes that have no
+ * assignment are mapped to the C1 controls, as for ISO-8859-1. */
+static const unsigned short cp1252_high[32] = {/*{{{*/
+  0x20ac, 0x0081, 0x201a, 0x0192, 0x201e, 0x2026, 0x2020, 0x2021,
+  0x02c6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008d, 0x017d, 0x008f,
+  0x0090, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014,
+  0x02dc, 0x2122, 0x0161, 0x203a, 0x0153, 0x009d, 0x017e, 0x0178
+};
+/*}}}*/
+
+static int ascii_length(const char *text, int len)/*{{{*/
+{
+  /* Return the length of the run of ASCII characters at the start of text,
+   * looking at a word at a time while that's possible. */
+  const unsigned long high_bits = ((unsigned long) -1 / 0xff) * 0x80;
+  int i = 0;
+  while (i + (int) sizeof(unsigned long) <= len) {
+    unsigned long w;
+    memcpy(&w, text + i, sizeof(unsigned long));
+    if (w & high_bits) break;
+    i += sizeof(unsigned long);
+  }
+  while ((i < len) && !(text[i] & 0x80)) i++;
+  return i;
+}
+/*}}}*/
+static int utf8_sequence_length(const unsigned char *p, int len)/*{{{*/
+{
+  /* If p starts a valid, shortest-form UTF-8 sequence of at most len bytes,
+   * return its length, else 0. */
+  unsigned char c = p[0];
+  if (c < 0x80) return 1;
+  if (c < 0xc2) return 0;
+  if (c < 0xe0) {
+    if ((len < 2) || ((p[1] & 0xc0) != 0x80)) return 0;
+    return 2;
+  }
+  if (c < 0xf0) {
+    if ((len < 3) || ((p[1] & 0xc0) != 0x80) || ((p[2] & 0xc0) != 0x80)) return 0;
+    if ((c == 0xe0) && (p[1] < 0xa0)) return 0; /* overlong */
+    if ((c == 0xed) && (p[1] >= 0xa0)) return 0; /* surrogate */
+    return 3;
+  }
+  if (c < 0xf5) {
+    if ((len < 4) || ((p[1] & 0xc0) != 0x80) ||
+        ((p[2] & 0xc0) != 0x80) || ((p[3] & 0xc0) != 0x80)) return 0;
+    if ((c == 0xf0) && (p[1] < 0x90)) return 0; /* overlong */
+    if ((c == 0xf4) && (p[1] >= 0x90)) return 0; /* beyond U+10FFFF */
+    return 4;
+  }
+  return 0;
+}
+/*}}}*/
+char *put_utf8(char *q, unsigned int c)/*{{{*/
+{
+  /* Write character c at q in UTF-8, returning the end of it. */
+  if (c < 0x80) {
+    *q++ = c;
+  } else if (c < 0x800) {
+    *q++ = 0xc0 | (c >> 6);
+    *q++ = 0x80 | (c & 0x3f);
+  } else if (c < 0x10000) {
+    *q++ = 0xe0 | (c >> 12);
+    *q++ = 0x80 | ((c >> 6) & 0x3f);
+    *q++ = 0x80 | (c & 0x3f);
+  } else {
+    *q++ = 0xf0 | (c >> 18);
+    *q++ = 0x80 | ((c >> 12) & 0x3f);
+    *q++ = 0x80 | ((c >> 6) & 0x3f);
+    *q++ = 0x80 | (c & 0x3f);
+  }
+  return q;
+}
+/*}}}*/
+static char *put_cp1252(char *q, unsigned char c)/*{{{*/
+{
+  if ((c >= 0x80) && (c < 0xa0)) return put_utf8(q, cp1252_high[c - 0x80]);
+  return put_utf8(q, c);
+}
+/*}}}*/
+static int charset_is(const char *charset, const char *const *names)/*{{{*/
+{
+  for (; *names; names++) {
+    if (!strcasecmp(charset, *names)) return 1;
+  }
+  return 0;
+}
+/*}}}*/
+static enum charset_kind classify_charset(const char *charset)/*{{{*/
+{
+  static const char *const utf8_names[] = {
+    "utf-8", "utf8", NULL
+  };
+  static const char *const ascii_names[] = {
+    "us-ascii", "ascii", "ansi_x3.4-1968", "iso646-us", NULL
+  };
+  static const char *const cp1252_names[] = {
+    "iso-8859-1", "iso8859-1", "iso_8859-1", "latin1", "l1",
+    "windows-1252", "cp1252", "x-cp1252", NULL
+  };
+
+  if (!charset || !*charset) return CS_UNDECLARED;
+  if (charset_is(charset, utf8_names)) return CS_UTF8;
+  if (charset_is(charset, ascii_names)) return CS_UNDECLARED;
+  if (charset_is(charset, cp1252_names)) return CS_WINDOWS_1252;
+#ifdef USE_ICONV
+  return CS_OTHER;
+#else
+  return CS_UNKNOWN;
+#endif
+}
+/*}}}*/
+static int ascii_compatible(const char *charset)/*{{{*/
+{
+  /* Whether pure ASCII text in this character set means the same as in
+   * ASCII.  These are the ones where it doesn't. */
+  static const char *const prefixes[] = {
+    "utf-7", "utf7", "utf-16", "utf16", "utf-32", "utf32", "ucs",
+    "iso-2022", "hz", NULL
+  };
+  const char *const *p;
+  for (p = prefixes; *p; p++) {
+    if (!strncasecmp(charset, *p, strlen(*p))) return 0;
+  }
+  return 1;
+}
+/*}}}*/
+static void make_room(char **buf, int *buf_size, int used, int needed)/*{{{*/
+{
+  if (used + needed > *buf_size) {
+    *buf_size = used + needed + (*buf_size >> 1);
+    *buf = grow_array(char, *buf_size, *buf);
+  }
+}
+/*}}}*/
+static int convert_8bit(const char *text, int len, int start, int as_utf8, char **buf, int *buf_size)/*{{{*/
+{
+  /* Convert text, of which the first start bytes are known to be ASCII, to
+   * UTF-8 in *buf.  Valid UTF-8 sequences are kept if as_utf8 is set, every
+   * other byte is taken as windows-1252.  Returns the output length. */
+  const unsigned char *p = (const unsigned char *) text;
+  char *q;
+  int i, n;
+
+  /* No character takes more than 3 bytes of output per byte of input */
+  make_room(buf, buf_size, 0, start + 3 * (len - start) + 1);
+  memcpy(*buf, text, start);
+  q = *buf + start;
+  for (i = start; i < len; ) {
+    if (p[i] < 0x80) {
+      *q++ = p[i++];
+    } else if (as_utf8 && ((n = utf8_sequence_length(p + i, len - i)) > 0)) {
+      memcpy(q, p + i, n);
+      q += n;
+      i += n;
+    } else {
+      q = put_cp1252(q, p[i++]);
+    }
+  }
+  *q = '\0';
+  return q - *buf;
+}
+/*}}}*/
+static int is_valid_utf8(const char *text, int len, int start)/*{{{*/
+{
+  const unsigned char *p = (const unsigned char *) text;
+  int i, n;
+  for (i = start; i < len; i += n) {
+    if (p[i] < 0x80) {
+      i += ascii_length(text + i, len - i);
+      n = 0;
+      continue;
+    }
+    n = utf8_sequence_length(p + i, len - i);
+    if (!n) return 0;
+  }
+  return 1;
+}
+/*}}}*/
+#ifdef USE_ICONV
+#define N_CONVERTERS 8
+static struct converter {/*{{{*/
+  char *charset;
+  iconv_t cd; /* (iconv_t) -1 if iconv doesn't know the character set */
+} converters[N_CONVERTERS];
+/*}}}*/
+static int next_converter = 0;
+
+static iconv_t get_converter(const char *charset)/*{{{*/
+{
+  /* iconv_open() is much too slow to call for every part, so keep the last
+   * few conversions that were needed. */
+  struct converter *c;
+  int i;
+  for (i = 0; i < N_CONVERTERS; i++) {
+    c = &converters[i];
+    if (c->charset && !strcasecmp(c->charset, charset)) {
+      return c->cd;
+    }
+  }
+  c = &converters[next_converter];
+  next_converter = (next_converter + 1) % N_CONVERTERS;
+  if (c->charset) {
+    free(c->charset);
+    if (c->cd != (iconv_t) -1) iconv_close(c->cd);
+  }
+  c->charset = new_string(charset);
+  c->cd = iconv_open("UTF-8", charset);
+  return c->cd;
+}
+/*}}}*/
+static int convert_with_iconv(iconv_t cd, const char *text, int len, char **buf, int *buf_size)/*{{{*/
+{
+  /* Returns the output length in *buf.  Bytes that aren't valid in the
+   * character set are skipped. */
+  char *in = (char *) text;
+  size_t in_left = len;
+  char *out;
+  size_t out_left;
+  int used = 0;
+
+  iconv(cd, NULL, NULL, NULL, NULL);
+  make_room(buf, buf_size, 0, 2 * len + 1);
+  for (;;) {
+    out = *buf + used;
+    out_left = *buf_size - used - 1;
+    if (iconv(cd, &in, &in_left, &out, &out_left) != (size_t) -1) {
+      used = out - *buf;
+      /* Flush out any shift state */
+      out_left = *buf_size - used - 1;
+      if (iconv(cd, NULL, NULL, &out, &out_left) != (size_t) -1) {
+        used = out - *buf;
+        break;
+      }
+    }
+    used = out - *buf;
+    if (errno == E2BIG) {
+      make_room(buf, buf_size, used, 2 * in_left + 16);
+    } else if ((errno == EILSEQ) && (in_left > 0)) {
+      in++;
+      in_left--;
+    } else {
+      /* Incomplete sequence at the end */
+      break;
+    }
+  }
+  (*buf)[used] = '\0';
+  return used;
+}
+/*}}}*/
+#endif
+char *text_to_utf8(const char *charset, char *text, int len, int *out_len, char **buf, int *buf_size)/*{{{*/
+{
+  /* Return the len bytes of text, in the given character set (NULL if none
+   * was declared), as null-terminated UTF-8.  If the text is already
+   * acceptable, text itself is returned; otherwise the result is built in
+   * *buf, which is grown as necessary (*buf_size is its size) and is reused
+   * by the caller from one call to the next. */
+  enum charset_kind kind = classify_charset(charset);
+  int start;
+
+  if (out_len) *out_len = len;
+  if (kind == CS_UNKNOWN) return text;
+  if ((kind != CS_OTHER) || ascii_compatible(charset)) {
+    start = ascii_length(text, len);
+    if (start == len) return text;
+  } else {
+    start = 0;
+  }
+
+  switch (kind) {
+    case CS_UNDECLARED:
+    case CS_UTF8:
+      if (is_valid_utf8(text, len, start)) return text;
+      len = convert_8bit(text, len, start, 1, buf, buf_size);
+      break;
+    case CS_WINDOWS_1252:
+      len = convert_8bit(text, len, start, 0, buf, buf_size);
+      break;
+    case CS_OTHER:
+#ifdef USE_ICONV
+      {
+        iconv_t cd = get_converter(charset);
+        if (cd == (iconv_t) -1) {
+          /* Not a character set that iconv knows : do the best we can */
+          if (is_valid_utf8(text, len, start)) return text;
+          len = convert_8bit(text, len, start, 1, buf, buf_size);
+        } else {
+          len = convert_with_iconv(cd, text, len, buf, buf_size);
+        }
+      }
+      break;
+#endif
+    case CS_UNKNOWN:
+      return text;
+  }
+  if (out_len) *out_len = len;
+  return *buf;
+}
+/*}}}*/
+static unsigned int fold_character(unsigned int c)/*{{{*/
+{
+  /* Simple case folding for the alphabets of Europe and around.  Only
+   * mappings that don't change the length of the UTF-8 encoding are done, so
+   * that folding can happen in place. */
+  if (c < 0x100) {
+    if ((c >= 0xc0) && (c <= 0xde) && (c != 0xd7)) return c + 0x20;
+  } else if (c < 0x180) {
+    /* Latin Extended-A : upper and lower case alternate */
+    if (c == 0x178) return 0xff;
+    if ((c >= 0x139) && (c <= 0x148)) return (c & 1) ? c + 1 : c;
+    if ((c >= 0x179) && (c <= 0x17e)) return (c & 1) ? c + 1 : c;
+    if ((c == 0x130) || (c == 0x138) || (c == 0x149) || (c == 0x17f)) return c;
+    return (c & 1) ? c : c + 1;
+  } else if ((c >= 0x386) && (c <= 0x3ab)) {
+    /* Greek */
+    if (c == 0x386) return 0x3ac;
+    if ((c >= 0x388) && (c <= 0x38a)) return c + 0x25;
+    if (c == 0x38c) return 0x3cc;
+    if ((c == 0x38e) || (c == 0x38f)) return c + 0x3f;
+    if ((c >= 0x391) && (c != 0x3a2)) return c + 0x20;
+  } else if (c == 0x3c2) {
+    return 0x3c3; /* final sigma */
+  } else if ((c >= 0x400) && (c < 0x530)) {
+    /* Cyrillic */
+    if (c < 0x410) return c + 0x50;
+    if (c < 0x430) return c + 0x20;
+    if (((c >= 0x460) && (c <= 0x481)) || ((c >= 0x48a) && (c <= 0x4bf)) || (c >= 0x4d0)) {
+      return (c & 1) ? c : c + 1;
+    }
+    if (c == 0x4c0) return 0x4cf;
+    if ((c >= 0x4c1) && (c <= 0x4ce)) return (c & 1) ? c + 1 : c;
+  } else if ((c >= 0x531) && (c <= 0x556)) {
+    /* Armenian */
+    return c + 0x30;
+  } else if ((c >= 0x1e00) && (c <= 0x1eff)) {
+    /* Latin Extended Additional */
+    if ((c <= 0x1e95) || (c >= 0x1ea0)) return (c & 1) ? c : c + 1;
+  } else if ((c >= 0xff21) && (c <= 0xff3a)) {
+    /* Fullwidth Latin */
+    return c + 0x20;
+  }
+  return c;
+}
+/*}}}*/
+int fold_case_character(char *dst, const char *src, int len)/*{{{*/
+{
+  /* Case fold the character at the start of the len bytes at src into dst
+   * (which may be the same as src), returning its length in bytes, which
+   * folding never changes.  Anything that isn't valid UTF-8 is copied a byte
+   * at a time as it is. */
+  const unsigned char *p = (const unsigned char *) src;
+  unsigned char *q = (unsigned char *) dst;
+  unsigned int c;
+  int n;
+
+  if (*p < 0x80) {
+    *q = ((*p >= 'A') && (*p <= 'Z')) ? *p + ('a' - 'A') : *p;
+    return 1;
+  }
+  n = utf8_sequence_length(p, len);
+  if (n == 2) {
+    c = ((p[0] & 0x1f) << 6) | (p[1] & 0x3f);
+    c = fold_character(c);
+    q[0] = 0xc0 | (c >> 6);
+    q[1] = 0x80 | (c & 0x3f);
+  } else if (n == 3) {
+    c = ((p[0] & 0x0f) << 12) | ((p[1] & 0x3f) << 6) | (p[2] & 0x3f);
+    c = fold_character(c);
+    q[0] = 0xe0 | (c >> 12);
+    q[1] = 0x80 | ((c >> 6) & 0x3f);
+    q[2] = 0x80 | (c & 0x3f);
+  } else {
+    if (n == 0) n = 1;
+    memmove(q, p, n);
+  }
+  return n;
+}
+/*}}}*/
+void fold_case(char *text)/*{{{*/
+{
+  /* Case fold the null-terminated UTF-8 text in place.  ASCII goes through
+   * at the cost of one comparison per character; anything that isn't valid
+   * UTF-8 is left alone. */
+  unsigned char *p = (unsigned char *) text;
+
+  while (*p) {
+    if (*p < 0x80) {
+      if ((*p >= 'A') && (*p <= 'Z')) *p += 'a' - 'A';
+      p++;
+      continue;
+    }
+    /* The null terminator ends any sequence, so no real length is needed */
+    p += fold_case_character((char *) p, (char *) p, 4);
+  }
+}
+/*}}}*/
+int utf8_separator_length(const char *text)/*{{{*/
+{
+  /* If text starts with a non-ASCII character that separates words (a
+   * non-breaking space, typographic quotes and dashes and so on), return its
+   * length in bytes, else 0.  text must be null-terminated. */
+  const unsigned char *p = (const unsigned char *) text;
+  unsigned int c;
+  int n = utf8_sequence_length(p, 4);
+  if (n == 2) {
+    c = ((p[0] & 0x1f) << 6) | (p[1] & 0x3f);
+    switch (c) {
+      case 0xa0: /* no-break space */
+      case 0xa1: /* inverted ! */
+      case 0xa7: /* section sign */
+      case 0xab: /* left guillemet */
+      case 0xb6: /* pilcrow */
+      case 0xb7: /* middle dot */
+      case 0xbb: /* right guillemet */
+      case 0xbf: /* inverted ? */
+        return 2;
+      default:
+        return 0;
+    }
+  } else if (n == 3) {
+    c = ((p[0] & 0x0f) << 12) | ((p[1] & 0x3f) << 6) | (p[2] & 0x3f);
+    if ((c >= 0x2000) && (c <= 0x206f)) return 3; /* General Punctuation */
+    if ((c >= 0x3000) && (c <= 0x3003)) return 3; /* CJK space, comma, full stop */
+    if (c == 0xfeff) return 3; /* zero-width no-break space */
+  }
+  return 0;
+}
+/*}}}*/
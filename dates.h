@@ -38,8 +38,5 @@ enum DATESCAN_TYPE {
   DS_DMY,
 };
 
-extern int datescan_next_state(int current_state, int next_token);
-extern enum DATESCAN_TYPE datescan_exitval[];
-
 
 #endif /* DATES_H */
@@ -0,0 +1,66 @@
+#include "dates.h"
+short datescan_char2tok[256] = {
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, 
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, 
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, 
+    0,   1,   2,   3,   4,   4,   4,   4,   4,   4,  -1,  -1,  -1,  -1,  -1,  -1, 
+   -1,   5,   5,   5,   5,   5,   5,   5,   5,   5,   5,   5,   5,   5,   5,   5, 
+    5,   5,   5,   5,   5,   5,   5,   5,   5,   5,   5,  -1,  -1,  -1,  -1,  -1, 
+   -1,   5,   5,   5,   5,   5,   5,   5,   5,   5,   5,   5,   5,   5,   5,   5, 
+    5,   5,   5,   5,   5,   5,   5,   5,   5,   5,   5,  -1,  -1,  -1,  -1,  -1, 
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, 
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, 
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, 
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, 
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, 
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, 
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, 
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1
+};
+enum DATESCAN_TYPE datescan_attr[] = {
+  DS_FAILURE, /* State 0 */
+  DS_FAILURE, /* State 1 */
+  DS_D, /* State 2 */
+  DS_D, /* State 3 */
+  DS_D, /* State 4 */
+  DS_FAILURE, /* State 5 */
+  DS_Y, /* State 6 */
+  DS_SCALED, /* State 7 */
+  DS_D, /* State 8 */
+  DS_SCALED, /* State 9 */
+  DS_Y, /* State 10 */
+  DS_FAILURE, /* State 11 */
+  DS_FAILURE, /* State 12 */
+  DS_SCALED, /* State 13 */
+  DS_FAILURE, /* State 14 */
+  DS_FAILURE, /* State 15 */
+  DS_M, /* State 16 */
+  DS_FAILURE, /* State 17 */
+  DS_FAILURE, /* State 18 */
+  DS_Y, /* State 19 */
+  DS_DM, /* State 20 */
+  DS_FAILURE, /* State 21 */
+  DS_MD, /* State 22 */
+  DS_MD, /* State 23 */
+  DS_MD, /* State 24 */
+  DS_FAILURE, /* State 25 */
+  DS_YM, /* State 26 */
+  DS_FAILURE, /* State 27 */
+  DS_FAILURE, /* State 28 */
+  DS_FAILURE, /* State 29 */
+  DS_FAILURE, /* State 30 */
+  DS_MY, /* State 31 */
+  DS_MD, /* State 32 */
+  DS_MY, /* State 33 */
+  DS_YYMMDD, /* State 34 */
+  DS_YMD, /* State 35 */
+  DS_YMD, /* State 36 */
+  DS_YMD, /* State 37 */
+  DS_DMY, /* State 38 */
+  DS_FAILURE, /* State 39 */
+  DS_DMY, /* State 40 */
+  DS_FAILURE, /* State 41 */
+  DS_YYMMDD, /* State 42 */
+  DS_FAILURE  /* State 43 */
+};
+
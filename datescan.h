@@ -0,0 +1,328 @@
+#ifndef datescan_HEADER_H
+#define datescan_HEADER_H
+extern short datescan_char2tok[256];
+extern enum DATESCAN_TYPE datescan_attr[];
+static inline int datescan_next_state(int current_state, int next_token) {
+  switch (current_state) {
+    case 0:
+      switch (next_token) {
+        case 0:
+          return 1;
+        case 1: case 2:
+          return 2;
+        case 3:
+          return 3;
+        case 4:
+          return 4;
+        case 5:
+          return 5;
+      }
+      return -1;
+    case 1:
+      switch (next_token) {
+        case 0: case 1: case 2: case 3: case 4:
+          return 6;
+        case 5:
+          return 7;
+      }
+      return -1;
+    case 2:
+      switch (next_token) {
+        case 0: case 1: case 2: case 3: case 4:
+          return 8;
+        case 5:
+          return 9;
+      }
+      return -1;
+    case 3:
+      switch (next_token) {
+        case 0: case 1:
+          return 8;
+        case 2: case 3: case 4:
+          return 10;
+        case 5:
+          return 9;
+      }
+      return -1;
+    case 4:
+      switch (next_token) {
+        case 0: case 1: case 2: case 3: case 4:
+          return 10;
+        case 5:
+          return 9;
+      }
+      return -1;
+    case 5:
+      switch (next_token) {
+        case 5:
+          return 11;
+      }
+      return -1;
+    case 6:
+      switch (next_token) {
+        case 0: case 1: case 2: case 3: case 4:
+          return 12;
+        case 5:
+          return 13;
+      }
+      return -1;
+    case 7:
+      switch (next_token) {
+      }
+      return -1;
+    case 8:
+      switch (next_token) {
+        case 0: case 1: case 2: case 3: case 4:
+          return 14;
+        case 5:
+          return 9;
+      }
+      return -1;
+    case 9:
+      switch (next_token) {
+        case 5:
+          return 15;
+      }
+      return -1;
+    case 10:
+      switch (next_token) {
+        case 0: case 1: case 2: case 3: case 4:
+          return 14;
+        case 5:
+          return 13;
+      }
+      return -1;
+    case 11:
+      switch (next_token) {
+        case 5:
+          return 16;
+      }
+      return -1;
+    case 12:
+      switch (next_token) {
+        case 0: case 1: case 2: case 3: case 4:
+          return 17;
+        case 5:
+          return 7;
+      }
+      return -1;
+    case 13:
+      switch (next_token) {
+        case 5:
+          return 18;
+      }
+      return -1;
+    case 14:
+      switch (next_token) {
+        case 0: case 1: case 2: case 3: case 4:
+          return 19;
+        case 5:
+          return 7;
+      }
+      return -1;
+    case 15:
+      switch (next_token) {
+        case 5:
+          return 20;
+      }
+      return -1;
+    case 16:
+      switch (next_token) {
+        case 0:
+          return 21;
+        case 1: case 2:
+          return 22;
+        case 3:
+          return 23;
+        case 4:
+          return 24;
+      }
+      return -1;
+    case 17:
+      switch (next_token) {
+        case 0: case 1: case 2: case 3: case 4:
+          return 25;
+        case 5:
+          return 7;
+      }
+      return -1;
+    case 18:
+      switch (next_token) {
+        case 5:
+          return 26;
+      }
+      return -1;
+    case 19:
+      switch (next_token) {
+        case 0: case 1: case 2: case 3: case 4:
+          return 25;
+        case 5:
+          return 13;
+      }
+      return -1;
+    case 20:
+      switch (next_token) {
+        case 0:
+          return 27;
+        case 1: case 2:
+          return 28;
+        case 3:
+          return 29;
+        case 4:
+          return 30;
+      }
+      return -1;
+    case 21:
+      switch (next_token) {
+        case 0: case 1: case 2: case 3: case 4:
+          return 31;
+      }
+      return -1;
+    case 22:
+      switch (next_token) {
+        case 0: case 1: case 2: case 3: case 4:
+          return 32;
+      }
+      return -1;
+    case 23:
+      switch (next_token) {
+        case 0: case 1:
+          return 32;
+        case 2: case 3: case 4:
+          return 33;
+      }
+      return -1;
+    case 24:
+      switch (next_token) {
+        case 0: case 1: case 2: case 3: case 4:
+          return 33;
+      }
+      return -1;
+    case 25:
+      switch (next_token) {
+        case 0: case 1: case 2: case 3: case 4:
+          return 34;
+        case 5:
+          return 7;
+      }
+      return -1;
+    case 26:
+      switch (next_token) {
+        case 1: case 2:
+          return 35;
+        case 3:
+          return 36;
+        case 4:
+          return 37;
+      }
+      return -1;
+    case 27:
+      switch (next_token) {
+        case 0: case 1: case 2: case 3: case 4:
+          return 38;
+      }
+      return -1;
+    case 28:
+      switch (next_token) {
+        case 0: case 1: case 2: case 3: case 4:
+          return 39;
+      }
+      return -1;
+    case 29:
+      switch (next_token) {
+        case 0: case 1:
+          return 39;
+        case 2: case 3: case 4:
+          return 40;
+      }
+      return -1;
+    case 30:
+      switch (next_token) {
+        case 0: case 1: case 2: case 3: case 4:
+          return 40;
+      }
+      return -1;
+    case 31:
+      switch (next_token) {
+      }
+      return -1;
+    case 32:
+      switch (next_token) {
+        case 0: case 1: case 2: case 3: case 4:
+          return 21;
+      }
+      return -1;
+    case 33:
+      switch (next_token) {
+        case 0: case 1: case 2: case 3: case 4:
+          return 21;
+      }
+      return -1;
+    case 34:
+      switch (next_token) {
+        case 0: case 1: case 2: case 3: case 4:
+          return 41;
+        case 5:
+          return 7;
+      }
+      return -1;
+    case 35:
+      switch (next_token) {
+        case 0: case 1: case 2: case 3: case 4:
+          return 37;
+      }
+      return -1;
+    case 36:
+      switch (next_token) {
+        case 0: case 1:
+          return 37;
+      }
+      return -1;
+    case 37:
+      switch (next_token) {
+      }
+      return -1;
+    case 38:
+      switch (next_token) {
+      }
+      return -1;
+    case 39:
+      switch (next_token) {
+        case 0: case 1: case 2: case 3: case 4:
+          return 27;
+      }
+      return -1;
+    case 40:
+      switch (next_token) {
+        case 0: case 1: case 2: case 3: case 4:
+          return 27;
+      }
+      return -1;
+    case 41:
+      switch (next_token) {
+        case 0: case 1: case 2: case 3: case 4:
+          return 42;
+        case 5:
+          return 7;
+      }
+      return -1;
+    case 42:
+      switch (next_token) {
+        case 0: case 1: case 2: case 3: case 4:
+          return 43;
+        case 5:
+          return 7;
+      }
+      return -1;
+    case 43:
+      switch (next_token) {
+        case 0: case 1: case 2: case 3: case 4:
+          return 43;
+        case 5:
+          return 7;
+      }
+      return -1;
+  }
+  return -1;
+}
+#endif
@@ -27,6 +27,7 @@
 #include <ctype.h>
 #include <assert.h>
 #include <sys/time.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include "imapinterface.h"
 
@@ -208,6 +209,7 @@ struct database *new_database(unsigned int hash_key)/*{{{*/
   result->attachment_name = new_toktable();
 
   result->msg_ids = new_toktable2();
+  result->spill = NULL;
 
   if ( hash_key == CREATE_RANDOM_DATABASE_HASH )
     {
@@ -226,6 +228,9 @@ struct database *new_database(unsigned int hash_key)/*{{{*/
   result->n_mboxen = 0;
   result->max_mboxen = 0;
 
+  result->dirs = NULL;
+  result->n_dirs = 0;
+
   return result;
 }
 /*}}}*/
@@ -240,6 +245,7 @@ void free_database(struct database *db)/*{{{*/
   free_toktable(db->body);
   free_toktable(db->attachment_name);
   free_toktable2(db->msg_ids);
+  if (db->spill) free_spill(db->spill);
 
   if (db->msgs) {
     for (i=0; i<db->n_msgs; i++) {
@@ -260,6 +266,7 @@ void free_database(struct database *db)/*{{{*/
   }
 
   free_mboxen(db);
+  free_dirstamps(db->dirs, db->n_dirs);
   free(db);
 }
 /*}}}*/
@@ -276,14 +283,17 @@ static void import_toktable(const struct read_db *indb, int n_msgs, struct tokta
 
   out->size = size;
   out->mask = size - 1;
-  out->n = n;
+  out->n = 0;
   out->tokens = new_array(struct token *, size);
+  out->slots = new_array(struct token_slot, size);
   memset(out->tokens, 0, size * sizeof(struct token *));
+  memset(out->slots, 0, size * sizeof(struct token_slot));
   out->hwm = (n + size) >> 1;
 
   for (i=0; i<n; i++) {
     unsigned int hash, index;
     const char *text;
+    int len;
     struct token *nt;
     struct int_list_reader ilr;
 
@@ -303,14 +313,20 @@ corrupt:
        * scratch by deleting it then rerunning. */
       unlock_and_exit(1);
     }
-    hash = hashfn((unsigned char *) text, strlen(text), indb->hash_key);
+    len = strlen(text);
+    if (len == 0) {
+      /* Older versions could store an empty token, which can't be searched
+       * for and has no place in the table now. */
+      free_token(nt);
+      continue;
+    }
+    hash = hashfn((unsigned char *) text, len, indb->hash_key);
 
-    nt->hashval = hash;
-    nt->text = new_string(text);
+    nt->text = store_token_text(&out->text, text, len);
     assert(nt->match0.highest < n_msgs);
 
     index = hash & out->mask;
-    while (out->tokens[index]) {
+    while (out->slots[index].len) {
       /* Audit to look for corrupt database with multiple entries for the same
        * string. */
       if (!strcmp(nt->text, out->tokens[index]->text)) {
@@ -323,6 +339,9 @@ corrupt:
     }
 
     out->tokens[index] = nt;
+    out->slots[index].hashval = hash;
+    out->slots[index].len = len;
+    ++out->n;
   }
 }
 /*}}}*/
@@ -337,14 +356,17 @@ static void import_toktable2(struct read_db *indb, int n_msgs, struct toktable2_
 
   out->size = size;
   out->mask = size - 1;
-  out->n = n;
+  out->n = 0;
   out->tokens = new_array(struct token2 *, size);
+  out->slots = new_array(struct token_slot, size);
   memset(out->tokens, 0, size * sizeof(struct token2 *));
+  memset(out->slots, 0, size * sizeof(struct token_slot));
   out->hwm = (n + size) >> 1;
 
   for (i=0; i<n; i++) {
     unsigned int hash, index;
     const char *text;
+    int len;
     struct token2 *nt;
     struct int_list_reader ilr;
 
@@ -361,20 +383,27 @@ static void import_toktable2(struct read_db *indb, int n_msgs, struct toktable2_
       fprintf(stderr, "  Delete the database file and rebuild from scratch as a workaround\n");
       unlock_and_exit(1);
     }
-    hash = hashfn((unsigned char *) text, strlen(text), indb->hash_key);
+    len = strlen(text);
+    if (len == 0) {
+      free_token2(nt);
+      continue;
+    }
+    hash = hashfn((unsigned char *) text, len, indb->hash_key);
 
-    nt->hashval = hash;
-    nt->text = new_string(text);
+    nt->text = store_token_text(&out->text, text, len);
     assert(nt->match0.highest < n_msgs);
     assert(nt->match1.highest < n_msgs);
 
     index = hash & out->mask;
-    while (out->tokens[index]) {
+    while (out->slots[index].len) {
       ++index;
       index &= out->mask;
     }
 
     out->tokens[index] = nt;
+    out->slots[index].hashval = hash;
+    out->slots[index].len = len;
+    ++out->n;
   }
 }
 /*}}}*/
@@ -452,17 +481,17 @@ struct database *new_database_from_file(char *db_filename, int do_integrity_chec
       case DB_MSG_MBOX:
         {
           unsigned int mbi, msgi;
-          int n;
           struct mbox *mb;
           result->type[i] = MTY_MBOX;
           decode_mbox_indices(input->data + input->path_offsets[i], &mbi, &msgi);
           result->msgs[i].src.mbox.file_index = mbi;
           mb = &result->mboxen[mbi];
-          assert(mb->n_so_far == msgi);
-          n = mb->n_so_far;
-          result->msgs[i].src.mbox.msg_index = n;
-          mb->start[n] = input->mtime_table[i];
-          mb->len[n] = input->size_table[i];
+          /* The messages of an mbox come in file order, unless index_order
+           * has put them in some other order */
+          assert(msgi < mb->n_msgs);
+          result->msgs[i].src.mbox.msg_index = msgi;
+          mb->start[msgi] = input->mtime_table[i];
+          mb->len[msgi] = input->size_table[i];
           ++mb->n_so_far;
         }
 
@@ -475,6 +504,14 @@ struct database *new_database_from_file(char *db_filename, int do_integrity_chec
     result->msgs[i].tid   = input->tid_table[i];
   }
 
+  N = result->n_dirs = input->n_dirs;
+  result->dirs = N ? (new_array(struct dirstamp, N)) : NULL;
+  for (i=0; i<N; i++) {
+    result->dirs[i].path = new_string(input->data + input->dir_paths_table[i]);
+    result->dirs[i].mtime = input->dir_mtime_table[i];
+    result->dirs[i].n_entries = input->dir_entries_table[i];
+  }
+
   import_toktable(input, result->n_msgs, &input->to, result->to);
   import_toktable(input, result->n_msgs, &input->cc, result->cc);
   import_toktable(input, result->n_msgs, &input->from, result->from);
@@ -502,9 +539,7 @@ static void add_angled_terms(int file_index, unsigned int hash_key, struct tokta
     while (left) {
       right = strchr(left, '>');
       if (right) {
-        *right = '\0';
-        add_token2_in_file(file_index, hash_key, left+1, table, add_to_chain1);
-        *right = '>'; /* restore */
+        add_token2_in_file(file_index, hash_key, left+1, right-(left+1), table, add_to_chain1);
       } else {
         break;
       }
@@ -559,113 +594,559 @@ static inline int char_valid_p(char x, unsigned int mask)/*{{{*/
   else return 0;
 }
 /*}}}*/
-static void tokenise_string(int file_index, unsigned int hash_key, struct toktable *table, char *data, int match_mask)/*{{{*/
+static inline int separator_length(const char *p, unsigned int mask)/*{{{*/
 {
-  char *ss, *es, old_es;
-  ss = data;
-  for (;;) {
-    while (*ss && !char_valid_p(*ss,match_mask)) ss++;
-    if (!*ss) break;
-    es = ss + 1;
-    while (*es && char_valid_p(*es,match_mask)) es++;
+  /* Return the number of bytes in the word separator at p, or 0 if p is in a
+   * word.  The text is UTF-8, so as well as the ASCII punctuation there are
+   * non-breaking spaces, typographic quotes and the like to look out for. */
+  unsigned char c = *(const unsigned char *) p;
+  if (c < 0x80) return char_valid_p(c, mask) ? 0 : 1;
+  else return utf8_separator_length(p);
+}
+/*}}}*/
+/* Words shorter than this are never judged on their mix of characters */
+#define JUNK_MIN_LENGTH 16
+
+struct junk_rules junk_rules = {/*{{{*/
+  64,   /* max_token_length */
+  50,   /* max_digit_percent */
+  40,   /* max_shift_percent */
+  1,    /* skip_armor */
+  0     /* max_part_bytes */
+};
+/*}}}*/
 
-    /* deal with token [ss,es) */
-    old_es = *es;
-    *es = '\0';
-    /* FIXME: Ought to do this by passing start and length - clean up later */
-    add_token_in_file(file_index, hash_key, ss, table);
-    *es = old_es;
+enum message_order message_order = MO_FOUND;
+
+/* While new messages are being indexed, the database is written out every
+ * checkpoint_interval seconds (never if 0) to checkpoint_path, so that a run
+ * that gets stopped part way through doesn't have to start again from
+ * scratch. */
+int checkpoint_interval = 300;
+char *checkpoint_path = NULL;
+volatile sig_atomic_t index_interrupted = 0;
+static time_t last_checkpoint = 0;
+
+/* Counts of what the junk rules have left out, for the verbose report */
+static int n_junk_long = 0;
+static int n_junk_digits = 0;
+static int n_junk_shifts = 0;
+static long n_armor_bytes = 0;
+static int n_parts_cut = 0;
+
+static int junk_word(const char *p, int len)/*{{{*/
+{
+  /* Decide whether a word from a message body is noise that nobody will
+   * search for : a base64 fragment, a hex hash and so on.  Only ASCII words
+   * are judged, since a long run of other characters is more likely to be a
+   * sentence from a language written without spaces. */
+  int i, digits, letters, shifts;
+  int class, last_class;
+  int max_len = junk_rules.max_token_length;
+
+  if ((len < JUNK_MIN_LENGTH) && (!max_len || (len <= max_len))) return 0;
+
+  digits = letters = shifts = 0;
+  last_class = -1;
+  for (i=0; i<len; i++) {
+    unsigned char c = p[i];
+    if (c >= 0x80) return 0;
+    else if (isdigit(c)) class = 0, digits++;
+    else if (isupper(c)) class = 1, letters++;
+    else if (islower(c)) class = 2, letters++;
+    else continue; /* underscores don't count either way */
+    if ((last_class >= 0) && (class != last_class)) shifts++;
+    last_class = class;
+  }
 
-    if (!*es) break;
-    ss = es;
+  if (max_len && (len > max_len)) {
+    n_junk_long++;
+    return 1;
+  }
+  if (len < JUNK_MIN_LENGTH) {
+    return 0;
+  }
+  if (junk_rules.max_digit_percent && letters &&
+      (100 * digits > junk_rules.max_digit_percent * len)) {
+    n_junk_digits++;
+    return 1;
+  }
+  if (junk_rules.max_shift_percent &&
+      (100 * shifts > junk_rules.max_shift_percent * (len - 1))) {
+    n_junk_shifts++;
+    return 1;
   }
+  return 0;
 }
 /*}}}*/
-static void tokenise_html_string(int file_index, unsigned int hash_key, struct toktable *table, char *data)/*{{{*/
+static char *next_line(char *p)/*{{{*/
+{
+  p = strchr(p, '\n');
+  return p ? p + 1 : NULL;
+}
+/*}}}*/
+static int uuencode_begin_line(const char *p)/*{{{*/
 {
-  char *ss, *es, old_es;
+  /* "begin", then the file mode, then the file name */
+  int n;
+  if (strncmp(p, "begin ", 6)) return 0;
+  for (p += 6, n = 0; (*p >= '0') && (*p <= '7'); p++) n++;
+  return (n >= 3) && (n <= 4) && (*p == ' ');
+}
+/*}}}*/
+static int uuencode_end_line(const char *p)/*{{{*/
+{
+  return !strncmp(p, "end", 3) && ((p[3] == '\n') || (p[3] == '\r') || (p[3] == '\0'));
+}
+/*}}}*/
+static void blank_armored_blocks(char *text)/*{{{*/
+{
+  /* Overwrite the insides of PGP (and other) armored blocks and of uuencoded
+   * files with spaces, leaving the BEGIN and END lines themselves to be
+   * indexed.  The text of a clearsigned message isn't armored, only the
+   * signature after it.  A block with no end line is left alone. */
+  char *p, *q, *body;
+  int armor;
+
+  for (p=text; p; p=next_line(p)) {
+    if (!strncmp(p, "-----BEGIN ", 11)) {
+      if (!strncmp(p + 11, "PGP SIGNED MESSAGE-----", 23)) continue;
+      armor = 1;
+    } else if (uuencode_begin_line(p)) {
+      armor = 0;
+    } else {
+      continue;
+    }
+
+    body = next_line(p);
+    for (q=body; q; q=next_line(q)) {
+      if (armor ? !strncmp(q, "-----END ", 9) : uuencode_end_line(q)) break;
+    }
+    if (!q) break;
+
+    memset(body, ' ', q - body);
+    n_armor_bytes += q - body;
+    p = q;
+  }
+}
+/*}}}*/
+static void cut_part(char *text)/*{{{*/
+{
+  /* Only index the first max_part_bytes of a text part, stopping at the last
+   * whitespace before the limit so that no word is cut in half. */
+  char *cut;
 
-  /* FIXME : Probably want to rewrite this as an explicit FSM */
+  if (!junk_rules.max_part_bytes) return;
+  if (memchr(text, '\0', junk_rules.max_part_bytes)) return;
 
+  cut = text + junk_rules.max_part_bytes;
+  while ((cut > text) && !isspace(((unsigned char *) cut)[-1])) cut--;
+  *cut = '\0';
+  n_parts_cut++;
+}
+/*}}}*/
+static void report_junk(void)/*{{{*/
+{
+  if (n_junk_long || n_junk_digits || n_junk_shifts || n_armor_bytes || n_parts_cut) {
+    fprintf(stderr, "Left out of body table: %d long words, %d words mostly digits, %d words of mixed-up characters, %ld bytes of armor; %d parts cut short\n",
+        n_junk_long, n_junk_digits, n_junk_shifts, n_armor_bytes, n_parts_cut);
+  }
+}
+/*}}}*/
+static void tokenise_string(int file_index, unsigned int hash_key, struct toktable *table, const char *data, int match_mask, int drop_junk)/*{{{*/
+{
+  const char *ss, *es;
+  int n;
   ss = data;
   for (;;) {
-    /* Assume < and > are never valid token characters ! */
-    while (*ss && !char_valid_p(*ss, 1)) {
-      if (*ss++ == '<') {
-        /* Skip over HTML tag */
-        while (*ss && (*ss != '>')) ss++;
-      }
-    }
+    while (*ss && (n = separator_length(ss, match_mask))) ss += n;
     if (!*ss) break;
-
     es = ss + 1;
-    while (*es && char_valid_p(*es, 1)) es++;
+    while (*es && !separator_length(es, match_mask)) es++;
 
     /* deal with token [ss,es) */
-    old_es = *es;
-    *es = '\0';
-    /* FIXME: Ought to do this by passing start and length - clean up later */
-    add_token_in_file(file_index, hash_key, ss, table);
-    *es = old_es;
+    if (!drop_junk || !junk_word(ss, es - ss)) {
+      add_token_in_file(file_index, hash_key, ss, es - ss, table);
+    }
 
     if (!*es) break;
     ss = es;
   }
 }
 /*}}}*/
-void tokenise_message(int file_index, struct database *db, struct rfc822 *msg)/*{{{*/
+static void tokenise_address_string(int file_index, unsigned int hash_key, struct toktable *table, const char *data)/*{{{*/
 {
-  struct attachment *a;
+  /* Add both the words (as tokenise_string() with mask 1 would) and the
+   * whole addresses (mask 2) in data, in one pass.  An address is a run of
+   * words joined by the characters only mask 2 allows (@ . + -), so each word
+   * is found on the way through the address it belongs to. */
+  const char *p, *addr, *word;
+  int n, joined;
+
+  p = data;
+  while (*p) {
+    if ((n = separator_length(p, 2))) {
+      p += n;
+      continue;
+    }
 
-  /* Match on whole addresses in these headers as well as the individual words */
-  if (msg->hdrs.to) {
-    tokenise_string(file_index, db->hash_key, db->to, msg->hdrs.to, 1);
-    tokenise_string(file_index, db->hash_key, db->to, msg->hdrs.to, 2);
-  }
-  if (msg->hdrs.cc) {
-    tokenise_string(file_index, db->hash_key, db->cc, msg->hdrs.cc, 1);
-    tokenise_string(file_index, db->hash_key, db->cc, msg->hdrs.cc, 2);
+    addr = p;
+    word = NULL;
+    joined = 0;
+    while (*p && !separator_length(p, 2)) {
+      if (separator_length(p, 1)) {
+        /* A character joining words into an address */
+        if (word) {
+          add_token_in_file(file_index, hash_key, word, p - word, table);
+          word = NULL;
+        }
+        joined = 1;
+      } else if (!word) {
+        word = p;
+      }
+      p++;
+    }
+    if (word) {
+      add_token_in_file(file_index, hash_key, word, p - word, table);
+    }
+    /* If nothing was joined, the address is the word just added */
+    if (joined) {
+      add_token_in_file(file_index, hash_key, addr, p - addr, table);
+    }
   }
-  if (msg->hdrs.from) {
-    tokenise_string(file_index, db->hash_key, db->from, msg->hdrs.from, 1);
-    tokenise_string(file_index, db->hash_key, db->from, msg->hdrs.from, 2);
+}
+/*}}}*/
+/* Names of the HTML character entities for U+00A0 to U+00FF, in order */
+static const char *latin1_entities[96] = {/*{{{*/
+  "nbsp", "iexcl", "cent", "pound", "curren", "yen", "brvbar", "sect",
+  "uml", "copy", "ordf", "laquo", "not", "shy", "reg", "macr",
+  "deg", "plusmn", "sup2", "sup3", "acute", "micro", "para", "middot",
+  "cedil", "sup1", "ordm", "raquo", "frac14", "frac12", "frac34", "iquest",
+  "Agrave", "Aacute", "Acirc", "Atilde", "Auml", "Aring", "AElig", "Ccedil",
+  "Egrave", "Eacute", "Ecirc", "Euml", "Igrave", "Iacute", "Icirc", "Iuml",
+  "ETH", "Ntilde", "Ograve", "Oacute", "Ocirc", "Otilde", "Ouml", "times",
+  "Oslash", "Ugrave", "Uacute", "Ucirc", "Uuml", "Yacute", "THORN", "szlig",
+  "agrave", "aacute", "acirc", "atilde", "auml", "aring", "aelig", "ccedil",
+  "egrave", "eacute", "ecirc", "euml", "igrave", "iacute", "icirc", "iuml",
+  "eth", "ntilde", "ograve", "oacute", "ocirc", "otilde", "ouml", "divide",
+  "oslash", "ugrave", "uacute", "ucirc", "uuml", "yacute", "thorn", "yuml"
+};
+/*}}}*/
+/* The other entities that turn up in mail often enough to matter */
+static const struct {/*{{{*/
+  const char *name;
+  unsigned int c;
+} other_entities[] = {
+  {"amp", '&'}, {"lt", '<'}, {"gt", '>'}, {"quot", '"'}, {"apos", '\''},
+  {"OElig", 0x152}, {"oelig", 0x153}, {"Scaron", 0x160}, {"scaron", 0x161},
+  {"Yuml", 0x178}, {"ensp", 0x2002}, {"emsp", 0x2003}, {"thinsp", 0x2009},
+  {"zwnj", 0x200c}, {"zwj", 0x200d}, {"ndash", 0x2013}, {"mdash", 0x2014},
+  {"lsquo", 0x2018}, {"rsquo", 0x2019}, {"sbquo", 0x201a}, {"ldquo", 0x201c},
+  {"rdquo", 0x201d}, {"bdquo", 0x201e}, {"bull", 0x2022}, {"hellip", 0x2026},
+  {"euro", 0x20ac}, {"trade", 0x2122},
+  {NULL, 0}
+};
+/*}}}*/
+static unsigned int html_character_reference(char **rp)/*{{{*/
+{
+  /* *rp points at an '&'.  If a character reference follows, move *rp past it
+   * and return the character it stands for; otherwise return 0.  The UTF-8
+   * for the character is never longer than the reference itself. */
+  char *p = *rp + 1;
+  char *start;
+  unsigned int c = 0;
+  int i, len;
+
+  if (*p == '#') {
+    p++;
+    if ((*p == 'x') || (*p == 'X')) {
+      for (start = ++p; isxdigit(*(unsigned char *) p); p++) {
+        if (c < 0x110000) c = (c << 4) + (isdigit(*(unsigned char *) p) ? (*p - '0') : ((*p | 0x20) - 'a' + 10));
+      }
+    } else {
+      for (start = p; isdigit(*(unsigned char *) p); p++) {
+        if (c < 0x110000) c = (c * 10) + (*p - '0');
+      }
+    }
+    if (p == start) return 0;
+    /* Anything that isn't a usable character just separates words */
+    if ((c == 0) || (c >= 0x110000) || ((c >= 0xd800) && (c < 0xe000))) c = ' ';
+  } else {
+    for (start = p; isalnum(*(unsigned char *) p); p++) ;
+    len = p - start;
+    for (i = 0; i < 96; i++) {
+      if (!strncmp(latin1_entities[i], start, len) && !latin1_entities[i][len]) {
+        c = 0xa0 + i;
+        break;
+      }
+    }
+    for (i = 0; !c && other_entities[i].name; i++) {
+      if (!strncmp(other_entities[i].name, start, len) && !other_entities[i].name[len]) {
+        c = other_entities[i].c;
+      }
+    }
+    if (!c) return 0;
   }
-  if (msg->hdrs.subject) tokenise_string(file_index, db->hash_key, db->subject, msg->hdrs.subject, 1);
+  if (*p == ';') p++;
+  *rp = p;
+  return c;
+}
+/*}}}*/
+static int match_end_tag(const char *p, const char *name)/*{{{*/
+{
+  /* Return non-zero if p is at the end tag for the element name. */
+  int len;
+  if ((p[0] != '<') || (p[1] != '/')) return 0;
+  len = strlen(name);
+  if (strncasecmp(p + 2, name, len)) return 0;
+  return !isalnum(((const unsigned char *) p)[2 + len]);
+}
+/*}}}*/
+enum html_state {/*{{{*/
+  HS_TEXT,        /* Ordinary text, to be indexed */
+  HS_TAG_OPEN,    /* Just after a '<' */
+  HS_TAG_NAME,
+  HS_IN_TAG,      /* Attributes and so on */
+  HS_QUOTED,      /* A quoted attribute value */
+  HS_COMMENT,     /* <!-- ... --> */
+  HS_DECLARATION, /* <!DOCTYPE ...>, <?xml ...?> etc */
+  HS_RAW_TEXT     /* The contents of script and style elements */
+};
+/*}}}*/
+static void tokenise_html_string(int file_index, unsigned int hash_key, struct toktable *table, char *data)/*{{{*/
+{
+  /* Index the text of an HTML part, skipping over tags, comments and the
+   * contents of script and style elements, which never hold anything worth
+   * searching for.  Character references are decoded as the text is read;
+   * each word is written back over data as it goes (the decoded text is never
+   * longer), so data is overwritten. */
+  enum html_state state;
+  char *r, *w, *word;   /* read position, write position, start of word */
+  char *name = NULL;
+  const char *raw_element = NULL;
+  char quote = '\0';
+  char utf8[4];
+  unsigned int c;
+  int n, end_tag = 0;
+  int value_next = 0;   /* in a tag, only blanks since the last '=' */
+
+  state = HS_TEXT;
+  r = w = word = data;
+  while (*r) {
+    switch (state) {
+      case HS_TEXT:
+        n = 0;
+        if ((*r == '<') && (isalpha(((unsigned char *) r)[1]) ||
+              (r[1] == '/') || (r[1] == '!') || (r[1] == '?'))) {
+          state = HS_TAG_OPEN;
+          n = 1;
+          r++;
+        } else if ((*r == '&') && (c = html_character_reference(&r))) {
+          char *e = put_utf8(utf8, c);
+          if (c == 0xad) {
+            /* A soft hyphen is invisible, so leave the word whole */
+          } else if ((c < 0x80) ? char_valid_p(c, 1) : !utf8_separator_length(utf8)) {
+            memcpy(w, utf8, e - utf8);
+            w += e - utf8;
+          } else {
+            n = 1;
+          }
+        } else if ((n = separator_length(r, 1))) {
+          r += n;
+        } else {
+          *w++ = *r++;
+        }
+        if (n && (w > word) && !junk_word(word, w - word)) {
+          /* deal with token [word,w) */
+          add_token_in_file(file_index, hash_key, word, w - word, table);
+        }
+        if (n) word = w;
+        break;
 
-  for (a=msg->atts.next; a!=&msg->atts; a=a->next) {
-    switch (a->ct) {
-      case CT_TEXT_PLAIN:
-        tokenise_string(file_index, db->hash_key, db->body, a->data.normal.bytes, 1);
+      case HS_TAG_OPEN:
+        end_tag = 0;
+        if (*r == '!') {
+          if ((r[1] == '-') && (r[2] == '-')) {
+            state = HS_COMMENT;
+            r += 3;
+          } else {
+            state = HS_DECLARATION;
+            r++;
+          }
+        } else if (*r == '?') {
+          state = HS_DECLARATION;
+          r++;
+        } else {
+          if (*r == '/') {
+            end_tag = 1;
+            r++;
+          }
+          state = HS_TAG_NAME;
+          name = r;
+        }
         break;
-      case CT_TEXT_HTML:
-        tokenise_html_string(file_index, db->hash_key, db->body, a->data.normal.bytes);
+
+      case HS_TAG_NAME:
+        if (isalnum(*(unsigned char *) r)) {
+          r++;
+        } else {
+          n = r - name;
+          raw_element = NULL;
+          if (!end_tag && (n == 6) && !strncasecmp(name, "script", 6)) raw_element = "script";
+          if (!end_tag && (n == 5) && !strncasecmp(name, "style", 5)) raw_element = "style";
+          state = HS_IN_TAG;
+          value_next = 0;
+        }
         break;
-      case CT_MESSAGE_RFC822:
-        /* Just recurse for now - maybe we should have separate token tables
-         * for tokens occurring in embedded messages? */
 
-        if (a->data.rfc822) {
-          tokenise_message(file_index, db, a->data.rfc822);
+      case HS_IN_TAG:
+        if (*r == '>') {
+          state = raw_element ? HS_RAW_TEXT : HS_TEXT;
+        } else if (value_next && ((*r == '"') || (*r == '\''))) {
+          /* A quote only starts a quoted value straight after the '='; in
+           * <img alt=it's> it is just part of an unquoted value */
+          quote = *r;
+          state = HS_QUOTED;
+        } else if ((*r == '/') && (r[1] == '>')) {
+          /* Self-closing, so there is no content to skip */
+          raw_element = NULL;
         }
+        if (*r == '=') value_next = 1;
+        else if (!isspace(*(unsigned char *) r)) value_next = 0;
+        r++;
         break;
-      default:
-        /* Don't do anything - unknown text format or some nasty binary stuff.
-         * In future, we could have all kinds of 'plug-ins' here, e.g.
-         * something that can parse PDF to get the basic text strings out of
-         * the pages? */
+
+      case HS_QUOTED:
+        if (*r == quote) state = HS_IN_TAG;
+        r++;
         break;
-    }
 
-    if (a->filename) {
-      add_token_in_file(file_index, db->hash_key, a->filename, db->attachment_name);
+      case HS_COMMENT:
+        if ((r[0] == '-') && (r[1] == '-') && (r[2] == '>')) {
+          state = HS_TEXT;
+          r += 3;
+        } else {
+          r++;
+        }
+        break;
+
+      case HS_DECLARATION:
+        if (*r == '>') state = HS_TEXT;
+        r++;
+        break;
+
+      case HS_RAW_TEXT:
+        if (match_end_tag(r, raw_element)) {
+          raw_element = NULL;
+          state = HS_IN_TAG;
+          value_next = 0;
+          r += 2;
+        } else {
+          r++;
+        }
+        break;
     }
+  }
+
+  if ((state == HS_TEXT) && (w > word) && !junk_word(word, w - word)) {
+    add_token_in_file(file_index, hash_key, word, w - word, table);
+  }
+}
+/*}}}*/
+static void tokenise_headers(int file_index, struct database *db, struct headers *hdrs)/*{{{*/
+{
+  /* Match on whole addresses in these headers as well as the individual words */
+  if (hdrs->to) tokenise_address_string(file_index, db->hash_key, db->to, hdrs->to);
+  if (hdrs->cc) tokenise_address_string(file_index, db->hash_key, db->cc, hdrs->cc);
+  if (hdrs->from) tokenise_address_string(file_index, db->hash_key, db->from, hdrs->from);
+  if (hdrs->subject) tokenise_string(file_index, db->hash_key, db->subject, hdrs->subject, 1, 0);
+}
+/*}}}*/
+static void tokenise_part(int file_index, struct database *db, enum content_type ct, char *text, const char *filename)/*{{{*/
+{
+  switch (ct) {
+    case CT_TEXT_PLAIN:
+      /* The text is only needed for indexing by now, so it can be cut short
+       * and blanked out in place */
+      cut_part(text);
+      if (junk_rules.skip_armor) blank_armored_blocks(text);
+      tokenise_string(file_index, db->hash_key, db->body, text, 1, 1);
+      break;
+    case CT_TEXT_HTML:
+      cut_part(text);
+      tokenise_html_string(file_index, db->hash_key, db->body, text);
+      break;
+    default:
+      /* Don't do anything - unknown text format or some nasty binary stuff.
+       * In future, we could have all kinds of 'plug-ins' here, e.g.
+       * something that can parse PDF to get the basic text strings out of
+       * the pages?  (The contents of message/rfc822 parts have already been
+       * dealt with.) */
+      break;
+  }
+
+  if (filename) {
+    add_token_in_file(file_index, db->hash_key, filename, strlen(filename), db->attachment_name);
+  }
+}
+/*}}}*/
+static void tokenise_threading(int file_index, struct database *db, struct headers *hdrs)/*{{{*/
+{
+  add_angled_terms(file_index, db->hash_key, db->msg_ids, 1, hdrs->message_id);
+  add_angled_terms(file_index, db->hash_key, db->msg_ids, 0, hdrs->in_reply_to);
+  add_angled_terms(file_index, db->hash_key, db->msg_ids, 0, hdrs->references);
+}
+/*}}}*/
+void tokenise_message(int file_index, struct database *db, struct rfc822 *msg)/*{{{*/
+{
+  struct attachment *a;
+
+  /* For an embedded message this only costs a few extra probes */
+  reset_token_filter();
+  tokenise_headers(file_index, db, &msg->hdrs);
 
+  for (a=msg->atts.next; a!=&msg->atts; a=a->next) {
+    if (a->ct == CT_MESSAGE_RFC822) {
+      /* Just recurse for now - maybe we should have separate token tables
+       * for tokens occurring in embedded messages? */
+      if (a->data.rfc822) {
+        tokenise_message(file_index, db, a->data.rfc822);
+      }
+      tokenise_part(file_index, db, a->ct, NULL, a->filename);
+    } else {
+      tokenise_part(file_index, db, a->ct, a->data.normal.bytes, a->filename);
+    }
   }
 
   /* Deal with threading information */
-  add_angled_terms(file_index, db->hash_key, db->msg_ids, 1, msg->hdrs.message_id);
-  add_angled_terms(file_index, db->hash_key, db->msg_ids, 0, msg->hdrs.in_reply_to);
-  add_angled_terms(file_index, db->hash_key, db->msg_ids, 0, msg->hdrs.references);
+  tokenise_threading(file_index, db, &msg->hdrs);
+}
+/*}}}*/
+struct tokenise_visit {/*{{{*/
+  int file_index;
+  struct database *db;
+};
+/*}}}*/
+static void tokenise_visit_start(void *arg, struct headers *hdrs, int depth)/*{{{*/
+{
+  struct tokenise_visit *tv = (struct tokenise_visit *) arg;
+  if (depth == 0) {
+    tv->db->msgs[tv->file_index].date = hdrs->date;
+    reset_token_filter();
+  }
+  tokenise_headers(tv->file_index, tv->db, hdrs);
+}
+/*}}}*/
+static void tokenise_visit_part(void *arg, enum content_type ct, char *text, const char *filename)/*{{{*/
+{
+  struct tokenise_visit *tv = (struct tokenise_visit *) arg;
+  tokenise_part(tv->file_index, tv->db, ct, text, filename);
+}
+/*}}}*/
+static void tokenise_visit_end(void *arg, struct headers *hdrs, int depth)/*{{{*/
+{
+  struct tokenise_visit *tv = (struct tokenise_visit *) arg;
+  tokenise_threading(tv->file_index, tv->db, hdrs);
 }
 /*}}}*/
 
@@ -697,8 +1178,38 @@ static void scan_maildir_flags(struct msgpath *m)/*{{{*/
 static void scan_new_messages(struct database *db, int start_at, struct imap_ll *imapc)/*{{{*/
 {
   int i;
+  struct tokenise_visit tv;
+  struct rfc822_visitor visitor;
+  struct prefetch *pf;
+  char **paths;
+
+  /* Have the files read ahead of the parser, so that on a cold cache (or slow
+   * storage) the reads overlap with the parsing rather than each file being
+   * fetched when its turn comes. */
+  paths = new_array(char *, db->n_msgs - start_at + 1);
+  for (i=start_at; i<db->n_msgs; i++) {
+    char *path = db->msgs[i].src.mpf.path;
+    int len = strlen(path);
+    if ((db->type[i] == MTY_FILE) &&
+        !(len > 10 && !strcmp(path + len - 11, "/.gitignore"))) {
+      paths[i - start_at] = path;
+    } else {
+      paths[i - start_at] = NULL;
+    }
+  }
+  pf = start_prefetch(paths, db->n_msgs - start_at);
+
+  /* Messages in files are tokenised as they're parsed, a part at a time,
+   * without building a struct rfc822 for them. */
+  tv.db = db;
+  visitor.start_message = tokenise_visit_start;
+  visitor.part = tokenise_visit_part;
+  visitor.end_message = tokenise_visit_end;
+  visitor.arg = &tv;
+
   for (i=start_at; i<db->n_msgs; i++) {
     struct rfc822 *msg = NULL;
+    int parsed = 0;
     int len = strlen(db->msgs[i].src.mpf.path);
 
     if (len > 10 && !strcmp(db->msgs[i].src.mpf.path + len - 11, "/.gitignore"))
@@ -713,23 +1224,29 @@ static void scan_new_messages(struct database *db, int start_at, struct imap_ll
         break;
       case MTY_FILE:
         if (verbose) fprintf(stderr, "Scanning <%s>\n", db->msgs[i].src.mpf.path);
-        msg = make_rfc822(db->msgs[i].src.mpf.path);
+        tv.file_index = i;
+        parsed = (visit_prefetched_file(pf, i - start_at, &visitor) == 0);
         break;
       case MTY_IMAP:
         if (verbose) fprintf(stderr, "Scanning IMAP <%s>\n", db->msgs[i].src.mpf.path);
         msg = make_rfc822_from_imap(db->msgs[i].src.mpf.path, imapc);
+        if (msg) {
+          db->msgs[i].date = msg->hdrs.date;
+          tokenise_message(i, db, msg);
+          free_rfc822(msg);
+          parsed = 1;
+        }
         break;
     }
-    if(msg)
-    {
-      db->msgs[i].date = msg->hdrs.date;
+    if (parsed)
       scan_maildir_flags(&db->msgs[i]);
-      tokenise_message(i, db, msg);
-      free_rfc822(msg);
-    }
     else
       fprintf(stderr, "Skipping %s (could not parse message)\n", db->msgs[i].src.mpf.path);
+    check_token_memory(db);
+    maybe_checkpoint(db, i + 1);
   }
+  end_prefetch(pf);
+  free(paths);
 }
 /*}}}*/
 
@@ -827,6 +1344,68 @@ static void find_threading(struct database *db)/*{{{*/
   return;
 }
 /*}}}*/
+static void write_checkpoint(struct database *db, int n_done)/*{{{*/
+{
+  /* Write the database out as though only the first n_done messages had been
+   * found.  The directory stamps are still the ones from the last complete
+   * run, so the next run lists any changed directories again and finds the
+   * rest of the messages in them.  Each mbox that still has messages to scan
+   * is written with no mtime or size, so the next run checks the messages
+   * that have been indexed against the file and carries on after them. */
+  int n_msgs = db->n_msgs;
+  time_t *mtimes;
+  size_t *sizes;
+  int i;
+
+  mtimes = new_array(time_t, db->n_mboxen + 1);
+  sizes = new_array(size_t, db->n_mboxen + 1);
+  for (i=0; i<db->n_mboxen; i++) {
+    struct mbox *mb = &db->mboxen[i];
+    mtimes[i] = mb->current_mtime;
+    sizes[i] = mb->current_size;
+    if (mb->new_msgs) {
+      mb->current_mtime = 0;
+      mb->current_size = 0;
+    }
+  }
+
+  db->n_msgs = n_done;
+  find_threading(db);
+  write_database(db, checkpoint_path, 0);
+  db->n_msgs = n_msgs;
+
+  for (i=0; i<db->n_mboxen; i++) {
+    db->mboxen[i].current_mtime = mtimes[i];
+    db->mboxen[i].current_size = sizes[i];
+  }
+  free(mtimes);
+  free(sizes);
+
+  if (verbose) {
+    printf("Checkpoint written after %d messages\n", n_done);
+  }
+}
+/*}}}*/
+void maybe_checkpoint(struct database *db, int n_done)/*{{{*/
+{
+  /* Called after each new message has been indexed.  n_done is how many
+   * entries at the start of db->msgs are complete. */
+  time_t now;
+
+  if (!checkpoint_path) return;
+  now = time(NULL);
+  if (!last_checkpoint) last_checkpoint = now;
+
+  if (index_interrupted) {
+    write_checkpoint(db, n_done);
+    fprintf(stderr, "Interrupted; the messages indexed so far have been saved\n");
+    unlock_and_exit(7);
+  } else if (now - last_checkpoint >= checkpoint_interval) {
+    write_checkpoint(db, n_done);
+    last_checkpoint = time(NULL);
+  }
+}
+/*}}}*/
 static int lookup_msgpath(struct msgpath *sorted_paths, int n_msgs, char *key, enum message_type type)/*{{{*/
 {
   /* Implement bisection search */
@@ -883,6 +1462,51 @@ enum stat_result {/*{{{*/
 };
 /*}}}*/
 
+/* The directory of the last message stat'd.  Messages come mostly in
+ * directory order, so looking each one up relative to an open descriptor for
+ * its directory saves walking every component of its path again. */
+static char *stat_dir_path = NULL;
+static int stat_dir_len = -1;
+static int stat_dir_fd = -1;
+
+static int stat_in_dir(const char *path, struct stat *sb)/*{{{*/
+{
+#if defined(AT_FDCWD) && defined(O_DIRECTORY)
+  const char *slash;
+  int len;
+
+  slash = strrchr(path, '/');
+  if (!slash || (slash == path)) {
+    return stat(path, sb);
+  }
+  len = slash - path;
+  if ((len != stat_dir_len) || strncmp(path, stat_dir_path, len)) {
+    if (stat_dir_fd >= 0) close(stat_dir_fd);
+    if (stat_dir_path) free(stat_dir_path);
+    stat_dir_path = new_array(char, len + 1);
+    memcpy(stat_dir_path, path, len);
+    stat_dir_path[len] = '\0';
+    stat_dir_len = len;
+    stat_dir_fd = open(stat_dir_path, O_RDONLY | O_DIRECTORY);
+  }
+  if (stat_dir_fd < 0) {
+    return stat(path, sb);
+  }
+  return fstatat(stat_dir_fd, slash + 1, sb, 0);
+#else
+  return stat(path, sb);
+#endif
+}
+/*}}}*/
+static void release_stat_dir(void)/*{{{*/
+{
+  if (stat_dir_fd >= 0) close(stat_dir_fd);
+  if (stat_dir_path) free(stat_dir_path);
+  stat_dir_path = NULL;
+  stat_dir_len = -1;
+  stat_dir_fd = -1;
+}
+/*}}}*/
 static int do_stat(struct msgpath *mp)/*{{{*/
 {
   struct stat sb;
@@ -892,7 +1516,7 @@ static int do_stat(struct msgpath *mp)/*{{{*/
     mp->src.mpf.size = 0;
     return STAT_RESULT_FILE;
   }
-  status = stat(mp->src.mpf.path, &sb);
+  status = stat_in_dir(mp->src.mpf.path, &sb);
   if (status < 0) {
     return STAT_RESULT_BAD;
   }
@@ -935,9 +1559,11 @@ int update_database(struct database *db, struct msgpath *sorted_paths, int n_msg
       case MTY_FILE:
         matched_index = lookup_msgpath(sorted_paths, n_msgs, db->msgs[i].src.mpf.path, MTY_FILE);
         if (matched_index >= 0) {
-          if (do_fast_index) {
+          if (do_fast_index || sorted_paths[matched_index].dir_unchanged) {
             /* Assume the presence of a matching path is good enough without
-             * even bothering to stat the file that's there now. */
+             * even bothering to stat the file that's there now.  (Always the
+             * case for a maildir directory that hasn't changed since the last
+             * run.) */
             file_in_db[matched_index] = 1;
             file_in_new_list[i] = 1;
           } else {
@@ -1040,6 +1666,7 @@ int update_database(struct database *db, struct msgpath *sorted_paths, int n_msg
       }
     }
   }
+  release_stat_dir();
 
   if (any_new) {
     scan_new_messages(db, new_entries_start_at, imapc);
@@ -1050,6 +1677,7 @@ int update_database(struct database *db, struct msgpath *sorted_paths, int n_msg
 
   if (any_new) {
     find_threading(db);
+    if (verbose) report_junk();
   } else {
     if (verbose) fprintf(stderr, "No new messages found\n");
   }
@@ -1060,31 +1688,60 @@ int update_database(struct database *db, struct msgpath *sorted_paths, int n_msg
   return any_new || (n_newly_pruned > 0);
 }
 /*}}}*/
-static void recode_encoding(struct matches *m, int *new_idx)/*{{{*/
+int compare_ints(const void *a, const void *b)/*{{{*/
+{
+  int aa = *(const int *) a;
+  int bb = *(const int *) b;
+  return (aa < bb) ? -1 : (aa > bb) ? 1 : 0;
+}
+/*}}}*/
+static void recode_encoding(struct matches *m, int *new_idx, int in_order)/*{{{*/
 {
-  unsigned char *new_enc, *old_enc;
-  int idx, n_idx;
+  /* If the messages have been put in a new order, rather than just having
+   * the gaps closed up, a list has to be sorted again before encoding it. */
+  static int *sorted = NULL;
+  static int max_sorted = 0;
+  struct matches old;
+  int idx, n_idx, n, i;
   struct int_list_reader ilr;
 
-  old_enc = m->msginfo;
-  matches_int_list_reader_init(&ilr, m);
+  old = *m;
+  matches_int_list_reader_init(&ilr, &old);
 
-  new_enc = new_array(unsigned char, m->max); /* Probably not bigger than this. */
+  m->msginfo = NULL;
   m->n = 0;
+  m->max = 0;
   m->highest = 0;
-  m->msginfo = new_enc;
+  enlarge_encoding(m, old.n); /* Probably not bigger than this. */
 
-  while (int_list_reader_read(&ilr, &idx)) {
-    n_idx = new_idx[idx];
-    if (n_idx >= 0) {
-      check_and_enlarge_encoding(m);
-      insert_index_on_encoding(m, n_idx);
+  if (in_order) {
+    while (int_list_reader_read(&ilr, &idx)) {
+      n_idx = new_idx[idx];
+      if (n_idx >= 0) {
+        insert_index_on_encoding(m, n_idx);
+      }
+    }
+  } else {
+    n = 0;
+    while (int_list_reader_read(&ilr, &idx)) {
+      n_idx = new_idx[idx];
+      if (n_idx >= 0) {
+        if (n == max_sorted) {
+          max_sorted = max_sorted ? (max_sorted << 1) : 256;
+          sorted = grow_array(int, max_sorted, sorted);
+        }
+        sorted[n++] = n_idx;
+      }
+    }
+    qsort(sorted, n, sizeof(int), compare_ints);
+    for (i=0; i<n; i++) {
+      insert_index_on_encoding(m, sorted[i]);
     }
   }
-  free(old_enc);
+  free_encoding(&old);
 }
 /*}}}*/
-static void recode_toktable(struct toktable *tbl, int *new_idx)/*{{{*/
+static void recode_toktable(struct toktable *tbl, int *new_idx, int in_order)/*{{{*/
 {
   /* Re-encode the vectors according to the new path indices */
   int i;
@@ -1094,7 +1751,7 @@ static void recode_toktable(struct toktable *tbl, int *new_idx)/*{{{*/
   for (i=0; i<tbl->size; i++) {
     struct token *tok = tbl->tokens[i];
     if (tok) {
-      recode_encoding(&tok->match0, new_idx);
+      recode_encoding(&tok->match0, new_idx, in_order);
       if (tok->match0.n == 0) {
         /* Delete this token.  Gotcha - there may be tokens further on in the
          * array that didn't get their natural hash bucket due to collisions.
@@ -1107,6 +1764,7 @@ static void recode_toktable(struct toktable *tbl, int *new_idx)/*{{{*/
 #endif
         free_token(tok);
         tbl->tokens[i] = NULL;
+        tbl->slots[i].len = 0;
         --tbl->n; /* Maintain number in use counter */
         any_dead = 1;
       }
@@ -1133,7 +1791,7 @@ static void recode_toktable(struct toktable *tbl, int *new_idx)/*{{{*/
       for (i=0; i<tbl->size; i++) {
         if (tbl->tokens[i]) {
           int nat_bucket_i;
-          nat_bucket_i = tbl->tokens[i]->hashval & tbl->mask;
+          nat_bucket_i = tbl->slots[i].hashval & tbl->mask;
           if (nat_bucket_i != i) {
             /* Find earliest bucket that we could move i to */
             int j = nat_bucket_i;
@@ -1144,7 +1802,9 @@ static void recode_toktable(struct toktable *tbl, int *new_idx)/*{{{*/
                 fprintf(stderr, "Moved <%s> from bucket %d to %d (natural bucket %d)\n", tbl->tokens[i]->text, i, j, nat_bucket_i);
 #endif
                 tbl->tokens[j] = tbl->tokens[i];
+                tbl->slots[j] = tbl->slots[i];
                 tbl->tokens[i] = NULL;
+                tbl->slots[i].len = 0;
                 any_moved = 1;
                 break;
               } else {
@@ -1167,7 +1827,7 @@ static void recode_toktable(struct toktable *tbl, int *new_idx)/*{{{*/
   }
 }
 /*}}}*/
-static void recode_toktable2(struct toktable2 *tbl, int *new_idx)/*{{{*/
+static void recode_toktable2(struct toktable2 *tbl, int *new_idx, int in_order)/*{{{*/
 {
   /* Re-encode the vectors according to the new path indices */
   int i;
@@ -1177,8 +1837,8 @@ static void recode_toktable2(struct toktable2 *tbl, int *new_idx)/*{{{*/
   for (i=0; i<tbl->size; i++) {
     struct token2 *tok = tbl->tokens[i];
     if (tok) {
-      recode_encoding(&tok->match0, new_idx);
-      recode_encoding(&tok->match1, new_idx);
+      recode_encoding(&tok->match0, new_idx, in_order);
+      recode_encoding(&tok->match1, new_idx, in_order);
       if ((tok->match0.n == 0) && (tok->match1.n == 0)) {
         /* Delete this token.  Gotcha - there may be tokens further on in the
          * array that didn't get their natural hash bucket due to collisions.
@@ -1191,6 +1851,7 @@ static void recode_toktable2(struct toktable2 *tbl, int *new_idx)/*{{{*/
 #endif
         free_token2(tok);
         tbl->tokens[i] = NULL;
+        tbl->slots[i].len = 0;
         --tbl->n; /* Maintain number in use counter */
         any_dead = 1;
       }
@@ -1215,7 +1876,7 @@ static void recode_toktable2(struct toktable2 *tbl, int *new_idx)/*{{{*/
       for (i=0; i<tbl->size; i++) {
         if (tbl->tokens[i]) {
           int nat_bucket_i;
-          nat_bucket_i = tbl->tokens[i]->hashval & tbl->mask;
+          nat_bucket_i = tbl->slots[i].hashval & tbl->mask;
           if (nat_bucket_i != i) {
             /* Find earliest bucket that we could move i to */
             int j = nat_bucket_i;
@@ -1226,7 +1887,9 @@ static void recode_toktable2(struct toktable2 *tbl, int *new_idx)/*{{{*/
                 fprintf(stderr, "Moved <%s> from bucket %d to %d (natural bucket %d)\n", tbl->tokens[i]->text, i, j, nat_bucket_i);
 #endif
                 tbl->tokens[j] = tbl->tokens[i];
+                tbl->slots[j] = tbl->slots[i];
                 tbl->tokens[i] = NULL;
+                tbl->slots[i].len = 0;
                 any_moved = 1;
                 break;
               } else {
@@ -1249,12 +1912,96 @@ static void recode_toktable2(struct toktable2 *tbl, int *new_idx)/*{{{*/
   }
 }
 /*}}}*/
-int cull_dead_messages(struct database *db, int do_integrity_checks)/*{{{*/
+struct order_key {/*{{{*/
+  time_t group_date; /* of the earliest message in the thread */
+  int group;
+  time_t date;
+  int index;
+};
+/*}}}*/
+static int compare_order_keys(const void *a, const void *b)/*{{{*/
+{
+  const struct order_key *aa = (const struct order_key *) a;
+  const struct order_key *bb = (const struct order_key *) b;
+  if (aa->group_date != bb->group_date) return (aa->group_date < bb->group_date) ? -1 : 1;
+  if (aa->group != bb->group) return (aa->group < bb->group) ? -1 : 1;
+  if (aa->date != bb->date) return (aa->date < bb->date) ? -1 : 1;
+  return aa->index - bb->index;
+}
+/*}}}*/
+static int order_messages(struct database *db, int *new_idx)/*{{{*/
 {
-  /* Return true if any culled */
+  /* Renumber the live messages by date, or by thread and then date, for
+   * message_order.  Messages that are close in time then have close numbers,
+   * which makes the lists of matching messages encode smaller, and searches
+   * whose results are sorted by date find them in order already.  Return
+   * true if the order of any messages changed. */
+  struct order_key *keys;
+  time_t *thread_date = NULL;
+  char *thread_seen;
+  int i, n, max_tid, any_moved;
+
+  keys = new_array(struct order_key, db->n_msgs + 1);
+
+  if (message_order == MO_THREAD) {
+    max_tid = 0;
+    for (i=0; i<db->n_msgs; i++) {
+      if (db->msgs[i].tid > max_tid) max_tid = db->msgs[i].tid;
+    }
+    thread_date = new_array(time_t, max_tid + 1);
+    thread_seen = new_array(char, max_tid + 1);
+    memset(thread_seen, 0, max_tid + 1);
+    for (i=0; i<db->n_msgs; i++) {
+      if (new_idx[i] >= 0) {
+        int tid = db->msgs[i].tid;
+        if (!thread_seen[tid] || (db->msgs[i].date < thread_date[tid])) {
+          thread_date[tid] = db->msgs[i].date;
+          thread_seen[tid] = 1;
+        }
+      }
+    }
+    free(thread_seen);
+  }
+
+  for (i=0, n=0; i<db->n_msgs; i++) {
+    if (new_idx[i] >= 0) {
+      if (thread_date) {
+        keys[n].group_date = thread_date[db->msgs[i].tid];
+        keys[n].group = db->msgs[i].tid;
+      } else {
+        keys[n].group_date = 0;
+        keys[n].group = 0;
+      }
+      keys[n].date = db->msgs[i].date;
+      keys[n].index = i;
+      n++;
+    }
+  }
+  qsort(keys, n, sizeof(struct order_key), compare_order_keys);
+
+  any_moved = 0;
+  for (i=0; i<n; i++) {
+    if (new_idx[keys[i].index] != i) any_moved = 1;
+    new_idx[keys[i].index] = i;
+  }
+
+  if (thread_date) free(thread_date);
+  free(keys);
+  return any_moved;
+}
+/*}}}*/
+int cull_dead_messages(struct database *db, int do_integrity_checks, int allow_reorder)/*{{{*/
+{
+  /* Return true if any culled, or if the messages were put in a new order.
+   * The messages are only put in order for message_order if allow_reorder is
+   * set, since that can rewrite every list of matches; the watcher only does
+   * it on a full pass. */
 
   int *new_idx, i, j, n_old;
   int any_culled = 0;
+  int any_moved = 0;
+  struct msgpath *old_msgs;
+  enum message_type *old_type;
 
   /* Check db is OK before we start on this. (Check afterwards is done in the
    * writer.c code.) */
@@ -1283,29 +2030,56 @@ int cull_dead_messages(struct database *db, int do_integrity_checks)/*{{{*/
     }
   }
 
-  recode_toktable(db->to, new_idx);
-  recode_toktable(db->cc, new_idx);
-  recode_toktable(db->from, new_idx);
-  recode_toktable(db->subject, new_idx);
-  recode_toktable(db->body, new_idx);
-  recode_toktable(db->attachment_name, new_idx);
-  recode_toktable2(db->msg_ids, new_idx);
+  if (allow_reorder && (message_order != MO_FOUND)) {
+    any_moved = order_messages(db, new_idx);
+  }
 
-  /* And crunch down the filename table */
-  for (i=0, j=0; i<n_old; i++) {
-    switch (db->type[i]) {
-      case MTY_DEAD:
-        break;
-      case MTY_FILE:
-      case MTY_MBOX:
-      case MTY_IMAP:
-        if (i > j) {
-          db->msgs[j] = db->msgs[i];
-          db->type[j]  = db->type[i];
-        }
+  if (db->spill) {
+    /* Put the rest of the words out with the runs, so that the messages in all
+     * of them are still numbered the old way when the runs are merged. */
+    spill_toktables(db);
+    recode_spilled_tables(db->spill, new_idx, n_old);
+  }
+  recode_toktable(db->to, new_idx, !any_moved);
+  recode_toktable(db->cc, new_idx, !any_moved);
+  recode_toktable(db->from, new_idx, !any_moved);
+  recode_toktable(db->subject, new_idx, !any_moved);
+  recode_toktable(db->body, new_idx, !any_moved);
+  recode_toktable(db->attachment_name, new_idx, !any_moved);
+  recode_toktable2(db->msg_ids, new_idx, !any_moved);
+
+  if (!any_moved) {
+    /* And crunch down the filename table */
+    for (i=0, j=0; i<n_old; i++) {
+      switch (db->type[i]) {
+        case MTY_DEAD:
+          break;
+        case MTY_FILE:
+        case MTY_MBOX:
+        case MTY_IMAP:
+          if (i > j) {
+            db->msgs[j] = db->msgs[i];
+            db->type[j]  = db->type[i];
+          }
+          j++;
+          break;
+      }
+    }
+  } else {
+    /* Move each message to its new place */
+    old_msgs = db->msgs;
+    old_type = db->type;
+    db->msgs = new_array(struct msgpath, db->max_msgs);
+    db->type = new_array(enum message_type, db->max_msgs);
+    for (i=0, j=0; i<n_old; i++) {
+      if (new_idx[i] >= 0) {
+        db->msgs[new_idx[i]] = old_msgs[i];
+        db->type[new_idx[i]] = old_type[i];
         j++;
-        break;
+      }
     }
+    free(old_msgs);
+    free(old_type);
   }
   db->n_msgs = j;
 
@@ -1314,6 +2088,6 @@ int cull_dead_messages(struct database *db, int do_integrity_checks)/*{{{*/
   /* .. and cull dead mboxen */
   cull_dead_mboxen(db);
 
-  return any_culled;
+  return any_culled || any_moved;
 }
 /*}}}*/
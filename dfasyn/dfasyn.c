@@ -302,6 +302,59 @@ static void print_compressed_tables(struct DFA *dfa, int do_inline, const char *
   write_next_state_function_compressed(do_inline, prefix_under);
 }
 /*}}}*/
+static void print_direct_coded_function(struct DFA *dfa, int do_inline, const char *prefix_under)/*{{{*/
+/* Write the next_state function as code instead of tables : a switch on the
+   current state, and within each state a switch on the token, with all the
+   tokens that lead to the same next state sharing one case.  The compiler can
+   then turn each state into whatever mix of range tests and jump tables
+   suits it best, and there are no transition tables to load from. */
+{
+  FILE *dest;
+  int Nt = ntokens + n_charclasses;
+  int *done = new_array(int, Nt);
+  int i, j, k, n;
+
+  dest = do_inline ? header_output : output;
+
+  fprintf(dest, "%sint %snext_state(int current_state, int next_token) {\n",
+      do_inline ? "static inline " : "",
+      prefix_under);
+  fprintf(dest, "  switch (current_state) {\n");
+  for (i=0; i<dfa->n; i++) {
+    int *map = dfa->s[i]->map;
+    for (j=0; j<Nt; j++) done[j] = 0;
+    fprintf(dest, "    case %d:\n", i);
+    fprintf(dest, "      switch (next_token) {\n");
+    for (j=0; j<Nt; j++) {
+      if (done[j] || (map[j] < 0)) continue;
+      n = 0;
+      for (k=j; k<Nt; k++) {
+        if (!done[k] && (map[k] == map[j])) {
+          if (n%8 == 0) {
+            fprintf(dest, "%s        ", n ? "\n" : "");
+          } else {
+            fputc(' ', dest);
+          }
+          fprintf(dest, "case %d:", k);
+          done[k] = 1;
+          n++;
+        }
+      }
+      fprintf(dest, "\n          return %d;\n", map[j]);
+    }
+    fprintf(dest, "      }\n");
+    fprintf(dest, "      return -1;\n");
+  }
+  fprintf(dest, "  }\n");
+  fprintf(dest, "  return -1;\n");
+  fprintf(dest, "}\n");
+  if (!do_inline && header_output) {
+    fprintf(header_output, "extern int %snext_state(int current_state, int next_token);\n",
+        prefix_under);
+  }
+  free(done);
+}
+/*}}}*/
 static void print_entries_table(const char *prefix_under)/*{{{*/
 {
   int i;
@@ -456,6 +509,7 @@ static void usage(void)/*{{{*/
     "  -p,  --prefix PREFIX        Specify a prefix for the variables and functions in the generated file(s)\n"
     "  -u,  --uncompressed-tables  Don't compress the generated transition tables\n"
     "  -ud, --uncompressed-dfa     Don't common-up identical states in the DFA\n"
+    "  -d,  --direct-coded         Generate the next_state function as code instead of tables\n"
     "  -I,  --inline-function      Make the next_state function inline (requires -ho)\n"
     "\n"
     "General:\n"
@@ -477,6 +531,7 @@ int main (int argc, char **argv)/*{{{*/
   char *report_name = NULL;
   int uncompressed_tables = 0;
   int uncompressed_dfa = 0; /* Useful for debug */
+  int direct_coded = 0;
   int do_inline = 0;
   extern char *prefix;
   char *prefix_under;
@@ -506,6 +561,8 @@ int main (int argc, char **argv)/*{{{*/
       uncompressed_tables = 1;
     } else if (!strcmp(*argv, "-ud") || !strcmp(*argv, "--uncompressed-dfa")) {
       uncompressed_dfa = 1;
+    } else if (!strcmp(*argv, "-d") || !strcmp(*argv, "--direct-coded")) {
+      direct_coded = 1;
     } else if (!strcmp(*argv, "-I") || !strcmp(*argv, "--inline-function")) {
       do_inline = 1;
     } else if (!strcmp(*argv, "-p") || !strcmp(*argv, "--prefix")) {
@@ -661,7 +718,9 @@ int main (int argc, char **argv)/*{{{*/
   print_charclass_mapping(output, header_output, prefix_under);
   print_attr_tables(dfa, prefix_under);
 
-  if (uncompressed_tables) {
+  if (direct_coded) {
+    print_direct_coded_function(dfa, do_inline, prefix_under);
+  } else if (uncompressed_tables) {
     print_uncompressed_tables(dfa, do_inline, prefix_under);
   } else {
     print_compressed_tables(dfa, do_inline, prefix_under);
@@ -27,8 +27,12 @@
 #include <ctype.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <assert.h>
 #include "mairix.h"
+#ifdef USE_PTHREADS
+#  include <pthread.h>
+#endif
 
 struct msgpath_array *new_msgpath_array(void)/*{{{*/
 {
@@ -37,6 +41,9 @@ struct msgpath_array *new_msgpath_array(void)/*{{{*/
   result->paths = NULL;
   result->n = 0;
   result->max = 0;
+  result->dirs = NULL;
+  result->n_dirs = 0;
+  result->max_dirs = 0;
   return result;
 }
 /*}}}*/
@@ -58,9 +65,21 @@ void free_msgpath_array(struct msgpath_array *x)/*{{{*/
     }
     free(x->paths);
   }
+  free_dirstamps(x->dirs, x->n_dirs);
   free(x);
 }
 /*}}}*/
+void free_dirstamps(struct dirstamp *dirs, int n)/*{{{*/
+{
+  int i;
+  if (dirs) {
+    for (i=0; i<n; i++) {
+      free(dirs[i].path);
+    }
+    free(dirs);
+  }
+}
+/*}}}*/
 static void add_file_to_list(char *x, struct msgpath_array *arr, enum folder_type ft) {/*{{{*/
   char *y = new_string(x);
   if (arr->n == arr->max) {
@@ -70,46 +89,213 @@ static void add_file_to_list(char *x, struct msgpath_array *arr, enum folder_typ
   arr->paths[arr->n].type = MTY_FILE;
   arr->paths[arr->n].src.mpf.path = y;
   arr->paths[arr->n].source_ft = ft;
+  arr->paths[arr->n].dir_unchanged = 0;
   ++arr->n;
   return;
 }
 /*}}}*/
-static void get_maildir_message_paths(char *folder, struct msgpath_array *arr)/*{{{*/
+static void add_dirstamp(struct msgpath_array *arr, const char *path, time_t mtime, int n_entries)/*{{{*/
+{
+  if (arr->n_dirs == arr->max_dirs) {
+    arr->max_dirs += 256;
+    arr->dirs = grow_array(struct dirstamp, arr->max_dirs, arr->dirs);
+  }
+  arr->dirs[arr->n_dirs].path = new_string(path);
+  arr->dirs[arr->n_dirs].mtime = mtime;
+  arr->dirs[arr->n_dirs].n_entries = n_entries;
+  ++arr->n_dirs;
+}
+/*}}}*/
+
+/* The database's message-per-file entries, sorted by path, so that the
+ * entries lying in a given directory can be found by bisection. */
+struct known_paths {/*{{{*/
+  struct database *db;
+  int *idx;
+  int n;
+};
+/*}}}*/
+static struct database *sort_db; /* for compare_db_paths */
+static int compare_db_paths(const void *a, const void *b)/*{{{*/
+{
+  int ia = *(const int *) a;
+  int ib = *(const int *) b;
+  return strcmp(sort_db->msgs[ia].src.mpf.path, sort_db->msgs[ib].src.mpf.path);
+}
+/*}}}*/
+static void init_known_paths(struct known_paths *kp, struct database *db)/*{{{*/
 {
-  char *subdir, *fname;
   int i;
-  static char *subdirs[] = {"new", "cur"};
+  kp->db = db;
+  kp->idx = new_array(int, db->n_msgs + 1);
+  kp->n = 0;
+  for (i=0; i<db->n_msgs; i++) {
+    if (db->type[i] == MTY_FILE) {
+      kp->idx[kp->n++] = i;
+    }
+  }
+  sort_db = db;
+  qsort(kp->idx, kp->n, sizeof(int), compare_db_paths);
+}
+/*}}}*/
+static struct dirstamp *lookup_dirstamp(struct database *db, const char *path)/*{{{*/
+{
+  int l, h, m, r;
+  l = 0, h = db->n_dirs;
+  while (l < h) {
+    m = (l + h) >> 1;
+    r = strcmp(path, db->dirs[m].path);
+    if (r == 0) return &db->dirs[m];
+    if (r < 0) h = m;
+    else l = m + 1;
+  }
+  return NULL;
+}
+/*}}}*/
+static int carry_over_entries(const char *dir, enum folder_type ft, int expected, struct known_paths *kp, struct msgpath_array *arr)/*{{{*/
+{
+  /* Copy the entries the database already has for dir into arr.  If expected
+   * isn't negative, only do so if there are that many of them.  Returns the
+   * number of entries copied, or -1 if there was a mismatch. */
+  struct database *db = kp->db;
+  char *prefix;
+  const char *path;
+  int plen, l, h, m, i, first, count;
+
+  plen = strlen(dir) + 1;
+  prefix = new_array(char, plen + 1);
+  strcpy(prefix, dir);
+  strcat(prefix, "/");
+
+  l = 0, h = kp->n;
+  while (l < h) {
+    m = (l + h) >> 1;
+    if (strcmp(db->msgs[kp->idx[m]].src.mpf.path, prefix) < 0) l = m + 1;
+    else h = m;
+  }
+  first = l;
+
+  count = 0;
+  for (i=first; i<kp->n; i++) {
+    path = db->msgs[kp->idx[i]].src.mpf.path;
+    if (strncmp(path, prefix, plen)) break;
+    if (!strchr(path + plen, '/')) ++count;
+  }
+
+  if ((expected >= 0) && (count != expected)) {
+    free(prefix);
+    return -1;
+  }
+
+  for (i=first; i<kp->n; i++) {
+    struct msgpath *mp;
+    int j = kp->idx[i];
+    path = db->msgs[j].src.mpf.path;
+    if (strncmp(path, prefix, plen)) break;
+    if (strchr(path + plen, '/')) continue;
+    add_file_to_list((char *) path, arr, ft);
+    mp = &arr->paths[arr->n - 1];
+    mp->src.mpf.mtime = db->msgs[j].src.mpf.mtime;
+    mp->src.mpf.size = db->msgs[j].src.mpf.size;
+    mp->dir_unchanged = 1;
+  }
+
+  free(prefix);
+  return count;
+}
+/*}}}*/
+static int carry_over_dir(const char *dir, time_t mtime, struct known_paths *kp, struct msgpath_array *arr)/*{{{*/
+{
+  /* If the directory hasn't changed since the last run, copy the entries the
+   * database already has for it into arr instead of reading it.  Returns the
+   * number of entries, or -1 if the directory has to be read afresh. */
+  struct dirstamp *ds;
+
+  ds = lookup_dirstamp(kp->db, dir);
+  if (!ds || (ds->mtime != mtime)) return -1;
+
+  /* A mismatch in the number of entries means some never made it into the
+   * database (e.g. they couldn't be stat'd); read the directory again to pick
+   * them up. */
+  return carry_over_entries(dir, FT_MAILDIR, ds->n_entries, kp, arr);
+}
+/*}}}*/
+static void get_maildir_subdir_paths(char *subdir, struct msgpath_array *arr, struct known_paths *kp)/*{{{*/
+{
+  char *fname;
+  int n_entries;
   DIR *d;
   struct dirent *de;
+  struct stat sb;
+  time_t started;
+  int fd;
+
+  /* Delivery and flag changes in a maildir are all done by creating or
+   * renaming files, so an unchanged mtime on new/ or cur/ means an
+   * unchanged set of messages. */
+  started = time(NULL);
+  fd = open(subdir, O_RDONLY | O_DIRECTORY);
+  if (fd < 0) return;
+  if (fstat(fd, &sb) < 0) {
+    close(fd);
+    return;
+  }
+  if (kp) {
+    n_entries = carry_over_dir(subdir, sb.st_mtime, kp, arr);
+    if (n_entries >= 0) {
+      add_dirstamp(arr, subdir, sb.st_mtime, n_entries);
+      close(fd);
+      return;
+    }
+  }
+
+  d = fdopendir(fd);
+  if (!d) {
+    close(fd);
+    return;
+  }
+  fname = new_array(char, strlen(subdir) + 2 + NAME_MAX);
+  n_entries = 0;
+  while ((de = readdir(d))) {
+    /* TODO : Perhaps we ought to do some validation on the path here?
+       i.e. check that the filename looks valid for a maildir message. */
+    if (!strcmp(de->d_name, ".") ||
+        !strcmp(de->d_name, "..")) {
+      continue;
+    }
+    strcpy(fname, subdir);
+    strcat(fname, "/");
+    strcat(fname, de->d_name);
+    add_file_to_list(fname, arr, FT_MAILDIR);
+    ++n_entries;
+  }
+  closedir(d);
+  free(fname);
+  /* mtimes only have 1 second resolution.  If the directory was changed
+   * within the second we read it, a further change in that same second
+   * wouldn't show up next time, so don't trust it. */
+  if (sb.st_mtime < started) {
+    add_dirstamp(arr, subdir, sb.st_mtime, n_entries);
+  }
+}
+/*}}}*/
+static void get_maildir_message_paths(char *folder, struct msgpath_array *arr, struct known_paths *kp)/*{{{*/
+{
+  char *subdir;
+  int i;
+  static char *subdirs[] = {"new", "cur"};
   int folder_len = strlen(folder);
 
   /* FIXME : just store mdir-rooted paths in array and have common prefix elsewhere. */
 
   subdir = new_array(char, folder_len + 6);
-  fname = new_array(char, folder_len + 8 + NAME_MAX);
   for (i=0; i<2; i++) {
     strcpy(subdir, folder);
     strcat(subdir, "/");
     strcat(subdir, subdirs[i]);
-    d = opendir(subdir);
-    if (d) {
-      while ((de = readdir(d))) {
-        /* TODO : Perhaps we ought to do some validation on the path here?
-           i.e. check that the filename looks valid for a maildir message. */
-        if (!strcmp(de->d_name, ".") ||
-            !strcmp(de->d_name, "..")) {
-          continue;
-        }
-        strcpy(fname, subdir);
-        strcat(fname, "/");
-        strcat(fname, de->d_name);
-        add_file_to_list(fname, arr, FT_MAILDIR);
-      }
-      closedir(d);
-    }
+    get_maildir_subdir_paths(subdir, arr, kp);
   }
   free(subdir);
-  free(fname);
   return;
 }
 /*}}}*/
@@ -131,14 +317,111 @@ int valid_mh_filename_p(const char *x)/*{{{*/
   return 1;
 }
 /*}}}*/
+/* The message files found in each MH folder while filter_is_mh() was reading
+ * it to look for the marker files, so that get_mh_message_paths() doesn't
+ * have to read the folder again.  The traversal may be running on several
+ * threads, hence the lock.  Listings are only kept while build_message_list()
+ * is expanding the folders it is about to read; other callers of the
+ * traversal (the mfolder check, the watches) would otherwise leave them
+ * behind to be taken, out of date, by a later pass. */
+#define MH_LISTING_BUCKETS 256
+
+struct mh_listing {/*{{{*/
+  struct mh_listing *next;
+  char *folder;
+  char *names; /* each followed by a '\0' */
+  int n_names;
+};
+/*}}}*/
+static struct mh_listing *mh_listings[MH_LISTING_BUCKETS];
+static int keeping_mh_listings = 0;
+#ifdef USE_PTHREADS
+static pthread_mutex_t mh_listings_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static unsigned int mh_listing_bucket(const char *folder)/*{{{*/
+{
+  return hashfn((unsigned char *) folder, strlen(folder), 0) % MH_LISTING_BUCKETS;
+}
+/*}}}*/
+static void keep_mh_listing(const char *folder, char *names, int n_names)/*{{{*/
+{
+  struct mh_listing *l;
+  unsigned int b;
+
+  l = new(struct mh_listing);
+  l->folder = new_string(folder);
+  l->names = names;
+  l->n_names = n_names;
+  b = mh_listing_bucket(folder);
+#ifdef USE_PTHREADS
+  pthread_mutex_lock(&mh_listings_lock);
+#endif
+  l->next = mh_listings[b];
+  mh_listings[b] = l;
+#ifdef USE_PTHREADS
+  pthread_mutex_unlock(&mh_listings_lock);
+#endif
+}
+/*}}}*/
+static struct mh_listing *take_mh_listing(const char *folder)/*{{{*/
+{
+  struct mh_listing **pl, *l;
+  for (pl=&mh_listings[mh_listing_bucket(folder)]; (l = *pl); pl=&l->next) {
+    if (!strcmp(l->folder, folder)) {
+      *pl = l->next;
+      return l;
+    }
+  }
+  return NULL;
+}
+/*}}}*/
+static void free_mh_listing(struct mh_listing *l)/*{{{*/
+{
+  free(l->folder);
+  free(l->names);
+  free(l);
+}
+/*}}}*/
+static void free_mh_listings(void)/*{{{*/
+{
+  /* Drop any listings not used, e.g. for folders that were omitted */
+  struct mh_listing *l, *next;
+  int i;
+  for (i=0; i<MH_LISTING_BUCKETS; i++) {
+    for (l=mh_listings[i]; l; l=next) {
+      next = l->next;
+      free_mh_listing(l);
+    }
+    mh_listings[i] = NULL;
+  }
+}
+/*}}}*/
 static void get_mh_message_paths(char *folder, struct msgpath_array *arr)/*{{{*/
 {
   char *fname;
   DIR *d;
   struct dirent *de;
+  struct mh_listing *l;
   int folder_len = strlen(folder);
 
   fname = new_array(char, folder_len + 8 + NAME_MAX);
+
+  l = take_mh_listing(folder);
+  if (l) {
+    char *name;
+    int i;
+    for (i=0, name=l->names; i<l->n_names; i++, name+=strlen(name)+1) {
+      strcpy(fname, folder);
+      strcat(fname, "/");
+      strcat(fname, name);
+      add_file_to_list(fname, arr, FT_MH);
+    }
+    free_mh_listing(l);
+    free(fname);
+    return;
+  }
+
   d = opendir(folder);
   if (d) {
     while ((de = readdir(d))) {
@@ -177,20 +460,6 @@ static int child_stat(const char *base, const char *child, struct stat *sb)/*{{{
   return result;
 }
 /*}}}*/
-static int has_child_file(const char *base, const char *child)/*{{{*/
-{
-  int result = 0;
-  int status;
-  struct stat sb;
-
-  status = child_stat(base, child, &sb);
-  if ((status >= 0) && S_ISREG(sb.st_mode)) {
-    result = 1;
-  }
-
-  return result;
-}
-/*}}}*/
 static int has_child_dir(const char *base, const char *child)/*{{{*/
 {
   int result = 0;
@@ -249,35 +518,106 @@ static enum traverse_check scrutinize_mh_entry(int parent_is_mh, const char *de_
   }
 }
 /*}}}*/
+/* Files whose presence marks a directory as an MH folder. */
+static const char *mh_markers[] = {/*{{{*/
+  ".xmhcache",
+  ".mh_sequences",
+  /* Sylpheed */
+  ".sylpheed_cache",
+  ".sylpheed_mark",
+  /* claws-mail */
+  ".claws_cache",
+  ".claws_mark",
+  /* NNML (Gnus) */
+  ".marks",
+  ".overview",
+  /* Evolution */
+  "cmeta",
+  "summary",
+  /* Mew */
+  ".mew-summary",
+  /* ezmlm/archive */
+  "index",
+  NULL
+};
+/*}}}*/
+static int is_mh_marker(const char *name)/*{{{*/
+{
+  const char **m;
+  /* Message files (the bulk of the entries) are all digits. */
+  if (isdigit(*(unsigned char *) name)) return 0;
+  for (m=mh_markers; *m; m++) {
+    if (!strcmp(name, *m)) return 1;
+  }
+  return 0;
+}
+/*}}}*/
+/* A directory that has shown this many entries without a single message file
+ * among them is most likely not an MH folder, e.g. a maildir's cur/. */
+#define MH_GIVE_UP_AFTER 16
+
+static int probe_mh_markers(const char *path)/*{{{*/
+{
+  const char **m;
+  struct stat sb;
+  for (m=mh_markers; *m; m++) {
+    if ((child_stat(path, *m, &sb) >= 0) && S_ISREG(sb.st_mode)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+/*}}}*/
 static int filter_is_mh(const char *path, const struct stat *sb)/*{{{*/
 {
+  /* Read the directory looking for any of the marker files, and keep the
+   * names of the message files seen on the way for get_mh_message_paths().
+   * If it doesn't look like an MH folder early on, stop reading and just
+   * probe for each marker file instead, which costs less for a large
+   * directory of something else. */
   int result = 0;
-  if (S_ISDIR(sb->st_mode)) {
-    /* TODO : find a way of making this more scalable?  e.g. if a folder of a
-     * particular subtype is found once, try that subtype first later, since
-     * the user presumably uses a consistent MH-subtype (i.e. a single MUA). */
-    if (has_child_file(path, ".xmhcache") ||
-        has_child_file(path, ".mh_sequences") ||
-        /* Sylpheed */
-        has_child_file(path, ".sylpheed_cache") ||
-        has_child_file(path, ".sylpheed_mark") ||
-        /* claws-mail */
-        has_child_file(path, ".claws_cache") ||
-        has_child_file(path, ".claws_mark") ||
-        /* NNML (Gnus) */
-        has_child_file(path, ".marks") ||
-        has_child_file(path, ".overview") ||
-        /* Evolution */
-        has_child_file(path, "cmeta") ||
-        has_child_file(path, "summary") ||
-        /* Mew */
-        has_child_file(path, ".mew-summary") ||
-        /* ezmlm/archive */
-        has_child_file(path, "index")
-        ) {
-      result = 1;
+  int gave_up = 0;
+  DIR *d;
+  struct dirent *de;
+  struct stat sb2;
+  char *names = NULL;
+  int names_len = 0, names_max = 0;
+  int n_names = 0, n_seen = 0;
+
+  if (!S_ISDIR(sb->st_mode)) return 0;
+
+  d = opendir(path);
+  if (!d) return 0;
+  while ((de = readdir(d))) {
+    if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, "..")) continue;
+    if (valid_mh_filename_p(de->d_name)) {
+      int len = strlen(de->d_name) + 1;
+      if (names_len + len > names_max) {
+        names_max = names_max ? 2 * names_max + len : 4096;
+        names = grow_array(char, names_max, names);
+      }
+      memcpy(names + names_len, de->d_name, len);
+      names_len += len;
+      n_names++;
+    } else if (!result && is_mh_marker(de->d_name)) {
+      if ((child_stat(path, de->d_name, &sb2) >= 0) && S_ISREG(sb2.st_mode)) {
+        result = 1;
+      }
+    }
+    if (!result && !n_names && (++n_seen >= MH_GIVE_UP_AFTER)) {
+      gave_up = 1;
+      break;
     }
   }
+  closedir(d);
+
+  if (gave_up) {
+    result = probe_mh_markers(path);
+  } else if (result && keeping_mh_listings) {
+    keep_mh_listing(path, names, n_names);
+    names = NULL;
+  }
+  if (names) free(names);
   return result;
 }
 /*}}}*/
@@ -350,39 +690,140 @@ static void scan_directory(char *folder_base, char *this_folder, enum folder_typ
 }
 /*}}}*/
 #endif
+/*{{{ void expand_message_folders */
+void expand_message_folders(char *folder_base, char *folders, enum folder_type ft,
+    struct globber_array *omit_globs,
+    int *n_paths, char ***paths)
+{
+  char **raw_paths;
+  int n_raw_paths;
+
+  split_on_colons(folders, &n_raw_paths, &raw_paths);
+  switch (ft) {
+    case FT_MAILDIR:
+      glob_and_expand_paths(folder_base, raw_paths, n_raw_paths, paths, n_paths, &maildir_traverse_methods, omit_globs);
+      break;
+    case FT_MH:
+      glob_and_expand_paths(folder_base, raw_paths, n_raw_paths, paths, n_paths, &mh_traverse_methods, omit_globs);
+      break;
+    default:
+      assert(0);
+      break;
+  }
+  free_string_array(n_raw_paths, &raw_paths);
+}
+/*}}}*/
 /*{{{ void build_message_list */
 void build_message_list(char *folder_base, char *folders, enum folder_type ft,
     struct msgpath_array *msgs,
-    struct globber_array *omit_globs)
+    struct globber_array *omit_globs,
+    struct database *db)
 {
-  char **raw_paths, **paths = NULL;
-  int n_raw_paths, n_paths, i;
+  char **paths = NULL;
+  int n_paths, i;
+  struct known_paths kp;
 
-  split_on_colons(folders, &n_raw_paths, &raw_paths);
+  keeping_mh_listings = (ft == FT_MH);
+  expand_message_folders(folder_base, folders, ft, omit_globs, &n_paths, &paths);
+  keeping_mh_listings = 0;
   switch (ft) {
     case FT_MAILDIR:
-      glob_and_expand_paths(folder_base, raw_paths, n_raw_paths, &paths, &n_paths, &maildir_traverse_methods, omit_globs);
+      if (db->n_dirs > 0) {
+        init_known_paths(&kp, db);
+      }
       for (i=0; i<n_paths; i++) {
-        get_maildir_message_paths(paths[i], msgs);
+        get_maildir_message_paths(paths[i], msgs, (db->n_dirs > 0) ? &kp : NULL);
+      }
+      if (db->n_dirs > 0) {
+        free(kp.idx);
       }
       break;
     case FT_MH:
-      glob_and_expand_paths(folder_base, raw_paths, n_raw_paths, &paths, &n_paths, &mh_traverse_methods, omit_globs);
       for (i=0; i<n_paths; i++) {
         get_mh_message_paths(paths[i], msgs);
       }
+      free_mh_listings();
       break;
     default:
       assert(0);
       break;
   }
 
-  free_string_array(n_raw_paths, &raw_paths);
   free_string_array(n_paths, &paths);
 
   return;
 }
 /*}}}*/
+void build_watched_message_list(int n_dirs, char **dirs, enum folder_type *fts,
+    char *changed, struct msgpath_array *msgs, struct database *db)/*{{{*/
+{
+  /* Build the message list from a known set of message directories (maildir
+   * new/ and cur/ directories, and MH folders).  Directories not flagged as
+   * changed are taken from the database without going near the filesystem. */
+  struct known_paths kp;
+  struct dirstamp *ds;
+  int i;
+
+  init_known_paths(&kp, db);
+  for (i=0; i<n_dirs; i++) {
+    if (!changed[i]) {
+      carry_over_entries(dirs[i], fts[i], -1, &kp, msgs);
+      if ((fts[i] == FT_MAILDIR) && (ds = lookup_dirstamp(db, dirs[i]))) {
+        add_dirstamp(msgs, ds->path, ds->mtime, ds->n_entries);
+      }
+    } else if (fts[i] == FT_MAILDIR) {
+      get_maildir_subdir_paths(dirs[i], msgs, &kp);
+    } else {
+      get_mh_message_paths(dirs[i], msgs);
+    }
+  }
+  free(kp.idx);
+
+  /* IMAP folders aren't watched; keep whatever the database has for them. */
+  for (i=0; i<db->n_msgs; i++) {
+    if (db->type[i] == MTY_IMAP) {
+      add_file_to_list(db->msgs[i].src.mpf.path, msgs, FT_IMAP);
+      msgs->paths[msgs->n - 1].type = MTY_IMAP;
+    }
+  }
+}
+/*}}}*/
+static int compare_dirstamps(const void *a, const void *b)/*{{{*/
+{
+  const struct dirstamp *aa = (const struct dirstamp *) a;
+  const struct dirstamp *bb = (const struct dirstamp *) b;
+  return strcmp(aa->path, bb->path);
+}
+/*}}}*/
+int set_database_dirs(struct database *db, struct msgpath_array *msgs)/*{{{*/
+{
+  /* Hand the directory stamps gathered while building the message list over
+   * to the database, so they get written out.  Returns non-zero if they
+   * differ from the ones the database had already. */
+  int i, changed;
+
+  if (msgs->dirs) {
+    qsort(msgs->dirs, msgs->n_dirs, sizeof(struct dirstamp), compare_dirstamps);
+  }
+
+  changed = (msgs->n_dirs != db->n_dirs);
+  for (i=0; !changed && i<msgs->n_dirs; i++) {
+    if (strcmp(msgs->dirs[i].path, db->dirs[i].path) ||
+        (msgs->dirs[i].mtime != db->dirs[i].mtime) ||
+        (msgs->dirs[i].n_entries != db->dirs[i].n_entries)) {
+      changed = 1;
+    }
+  }
+
+  free_dirstamps(db->dirs, db->n_dirs);
+  db->dirs = msgs->dirs;
+  db->n_dirs = msgs->n_dirs;
+  msgs->dirs = NULL;
+  msgs->n_dirs = msgs->max_dirs = 0;
+
+  return changed;
+}
+/*}}}*/
 
 #ifdef TEST
 int main (int argc, char **argv)
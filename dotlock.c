@@ -30,8 +30,10 @@ static char *lock_file_name = NULL;
 
 /* This locking code was originally written for tdl */
 
-void lock_database(char *path, int forced_unlock)/*{{{*/
+static int acquire_lock(char *path, int forced_unlock, int quiet)/*{{{*/
 {
+  /* Returns 1 if the lock was obtained, or 0 if it is held by someone else
+   * (having complained about it unless quiet is set). */
   struct utsname uu;
   struct passwd *pw;
   int pid;
@@ -51,11 +53,12 @@ void lock_database(char *path, int forced_unlock)/*{{{*/
   }
   pid = getpid();
   len = 1 + strlen(path) + 5;
+  if (lock_file_name) free(lock_file_name);
   lock_file_name = new_array(char, len);
   sprintf(lock_file_name, "%s.lock", path);
 
   if (forced_unlock) {
-    unlock_database();
+    unlink(lock_file_name);
     forced_unlock = 0;
   }
 
@@ -86,9 +89,15 @@ void lock_database(char *path, int forced_unlock)/*{{{*/
           char line[2048];
           fgets(line, sizeof(line), in);
           line[strlen(line)-1] = 0; /* strip trailing newline */
-          fprintf(stderr, "Database %s appears to be locked by (pid,node,user)=(%s)\n", path, line);
+          if (!quiet) {
+            fprintf(stderr, "Database %s appears to be locked by (pid,node,user)=(%s)\n", path, line);
+          }
+          fclose(in);
           unlink(tname);
-          exit(1);
+          free(tname);
+          free(lock_file_name);
+          lock_file_name = NULL;
+          return 0;
         }
       } else {
         /* lock succeeded apparently */
@@ -99,12 +108,31 @@ void lock_database(char *path, int forced_unlock)/*{{{*/
   }
   unlink(tname);
   free(tname);
+  return 1;
+}
+/*}}}*/
+void lock_database(char *path, int forced_unlock)/*{{{*/
+{
+  if (!acquire_lock(path, forced_unlock, 0)) {
+    exit(1);
+  }
   return;
 }
 /*}}}*/
+int try_lock_database(char *path)/*{{{*/
+{
+  /* As lock_database, but return 0 instead of exiting if the database is
+   * already locked. */
+  return acquire_lock(path, 0, 1);
+}
+/*}}}*/
 void unlock_database(void)/*{{{*/
 {
-  if (lock_file_name) unlink(lock_file_name);
+  if (lock_file_name) {
+    unlink(lock_file_name);
+    free(lock_file_name);
+    lock_file_name = NULL;
+  }
   return;
 }
 /*}}}*/
@@ -0,0 +1,144 @@
+#include "from.h"
+short fromcheck_char2tok[256] = {
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,   0,   1,  -1,  -1,   2,  -1,  -1, 
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, 
+    0,   3,   4,   3,   3,   3,   3,   3,  -1,  -1,   3,   5,   6,   7,   8,   3, 
+    9,   9,   9,   9,   9,   9,   9,   9,   9,   9,  10,  -1,  11,   3,  12,   3, 
+   13,  14,  14,  14,  14,  14,  14,  14,  14,  14,  14,  14,  14,  14,  14,  14, 
+   14,  14,  14,  14,  14,  14,  14,  14,  14,  14,  14,  15,  -1,  16,   3,  17, 
+    3,  18,  18,  18,  18,  19,  20,  18,  18,  18,  18,  18,  18,  21,  18,  22, 
+   18,  18,  23,  18,  24,  18,  18,  18,  18,  18,  18,   3,   3,   3,   3,  -1, 
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, 
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, 
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, 
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, 
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, 
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, 
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, 
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1
+};
+enum fromcheck_result fromcheck_attr[] = {
+  FROMCHECK_FAIL, /* State 0 */
+  FROMCHECK_FAIL, /* State 1 */
+  FROMCHECK_FAIL, /* State 2 */
+  FROMCHECK_FAIL, /* State 3 */
+  FROMCHECK_FAIL, /* State 4 */
+  FROMCHECK_FAIL, /* State 5 */
+  FROMCHECK_FAIL, /* State 6 */
+  FROMCHECK_FAIL, /* State 7 */
+  FROMCHECK_FAIL, /* State 8 */
+  FROMCHECK_FAIL, /* State 9 */
+  FROMCHECK_FAIL, /* State 10 */
+  FROMCHECK_FAIL, /* State 11 */
+  FROMCHECK_FAIL, /* State 12 */
+  FROMCHECK_FAIL, /* State 13 */
+  FROMCHECK_FAIL, /* State 14 */
+  FROMCHECK_FAIL, /* State 15 */
+  FROMCHECK_FAIL, /* State 16 */
+  FROMCHECK_FAIL, /* State 17 */
+  FROMCHECK_FAIL, /* State 18 */
+  FROMCHECK_FAIL, /* State 19 */
+  FROMCHECK_FAIL, /* State 20 */
+  FROMCHECK_FAIL, /* State 21 */
+  FROMCHECK_FAIL, /* State 22 */
+  FROMCHECK_FAIL, /* State 23 */
+  FROMCHECK_FAIL, /* State 24 */
+  FROMCHECK_FAIL, /* State 25 */
+  FROMCHECK_FAIL, /* State 26 */
+  FROMCHECK_FAIL, /* State 27 */
+  FROMCHECK_FAIL, /* State 28 */
+  FROMCHECK_FAIL, /* State 29 */
+  FROMCHECK_FAIL, /* State 30 */
+  FROMCHECK_FAIL, /* State 31 */
+  FROMCHECK_FAIL, /* State 32 */
+  FROMCHECK_FAIL, /* State 33 */
+  FROMCHECK_FAIL, /* State 34 */
+  FROMCHECK_FAIL, /* State 35 */
+  FROMCHECK_FAIL, /* State 36 */
+  FROMCHECK_FAIL, /* State 37 */
+  FROMCHECK_FAIL, /* State 38 */
+  FROMCHECK_FAIL, /* State 39 */
+  FROMCHECK_FAIL, /* State 40 */
+  FROMCHECK_FAIL, /* State 41 */
+  FROMCHECK_FAIL, /* State 42 */
+  FROMCHECK_FAIL, /* State 43 */
+  FROMCHECK_FAIL, /* State 44 */
+  FROMCHECK_FAIL, /* State 45 */
+  FROMCHECK_FAIL, /* State 46 */
+  FROMCHECK_FAIL, /* State 47 */
+  FROMCHECK_FAIL, /* State 48 */
+  FROMCHECK_FAIL, /* State 49 */
+  FROMCHECK_FAIL, /* State 50 */
+  FROMCHECK_FAIL, /* State 51 */
+  FROMCHECK_FAIL, /* State 52 */
+  FROMCHECK_FAIL, /* State 53 */
+  FROMCHECK_FAIL, /* State 54 */
+  FROMCHECK_FAIL, /* State 55 */
+  FROMCHECK_FAIL, /* State 56 */
+  FROMCHECK_FAIL, /* State 57 */
+  FROMCHECK_FAIL, /* State 58 */
+  FROMCHECK_FAIL, /* State 59 */
+  FROMCHECK_FAIL, /* State 60 */
+  FROMCHECK_FAIL, /* State 61 */
+  FROMCHECK_FAIL, /* State 62 */
+  FROMCHECK_FAIL, /* State 63 */
+  FROMCHECK_FAIL, /* State 64 */
+  FROMCHECK_FAIL, /* State 65 */
+  FROMCHECK_FAIL, /* State 66 */
+  FROMCHECK_FAIL, /* State 67 */
+  FROMCHECK_FAIL, /* State 68 */
+  FROMCHECK_FAIL, /* State 69 */
+  FROMCHECK_FAIL, /* State 70 */
+  FROMCHECK_FAIL, /* State 71 */
+  FROMCHECK_FAIL, /* State 72 */
+  FROMCHECK_FAIL, /* State 73 */
+  FROMCHECK_FAIL, /* State 74 */
+  FROMCHECK_FAIL, /* State 75 */
+  FROMCHECK_FAIL, /* State 76 */
+  FROMCHECK_FAIL, /* State 77 */
+  FROMCHECK_FAIL, /* State 78 */
+  FROMCHECK_FAIL, /* State 79 */
+  FROMCHECK_FAIL, /* State 80 */
+  FROMCHECK_FAIL, /* State 81 */
+  FROMCHECK_FAIL, /* State 82 */
+  FROMCHECK_FAIL, /* State 83 */
+  FROMCHECK_FAIL, /* State 84 */
+  FROMCHECK_PASS, /* State 85 */
+  FROMCHECK_FAIL, /* State 86 */
+  FROMCHECK_PASS, /* State 87 */
+  FROMCHECK_FAIL, /* State 88 */
+  FROMCHECK_FAIL, /* State 89 */
+  FROMCHECK_PASS, /* State 90 */
+  FROMCHECK_FAIL, /* State 91 */
+  FROMCHECK_PASS, /* State 92 */
+  FROMCHECK_FAIL, /* State 93 */
+  FROMCHECK_PASS, /* State 94 */
+  FROMCHECK_FAIL, /* State 95 */
+  FROMCHECK_FAIL, /* State 96 */
+  FROMCHECK_PASS, /* State 97 */
+  FROMCHECK_FAIL, /* State 98 */
+  FROMCHECK_FAIL, /* State 99 */
+  FROMCHECK_PASS, /* State 100 */
+  FROMCHECK_FAIL, /* State 101 */
+  FROMCHECK_PASS, /* State 102 */
+  FROMCHECK_PASS, /* State 103 */
+  FROMCHECK_PASS, /* State 104 */
+  FROMCHECK_FAIL, /* State 105 */
+  FROMCHECK_FAIL, /* State 106 */
+  FROMCHECK_PASS, /* State 107 */
+  FROMCHECK_FAIL, /* State 108 */
+  FROMCHECK_PASS, /* State 109 */
+  FROMCHECK_PASS, /* State 110 */
+  FROMCHECK_FAIL, /* State 111 */
+  FROMCHECK_PASS, /* State 112 */
+  FROMCHECK_FAIL, /* State 113 */
+  FROMCHECK_FAIL, /* State 114 */
+  FROMCHECK_FAIL, /* State 115 */
+  FROMCHECK_FAIL, /* State 116 */
+  FROMCHECK_FAIL, /* State 117 */
+  FROMCHECK_FAIL, /* State 118 */
+  FROMCHECK_FAIL, /* State 119 */
+  FROMCHECK_FAIL, /* State 120 */
+  FROMCHECK_FAIL  /* State 121 */
+};
+
@@ -0,0 +1,1010 @@
+#ifndef fromcheck_HEADER_H
+#define fromcheck_HEADER_H
+extern short fromcheck_char2tok[256];
+extern enum fromcheck_result fromcheck_attr[];
+static inline int fromcheck_next_state(int current_state, int next_token) {
+  switch (current_state) {
+    case 0:
+      switch (next_token) {
+        case 0:
+          return 1;
+        case 3: case 5: case 7: case 8: case 9: case 14: case 17: case 18:
+        case 19: case 20: case 21: case 22: case 23: case 24:
+          return 2;
+        case 4:
+          return 3;
+        case 11:
+          return 4;
+        case 13:
+          return 5;
+      }
+      return -1;
+    case 1:
+      switch (next_token) {
+        case 0:
+          return 1;
+        case 3: case 5: case 7: case 8: case 9: case 17: case 18: case 19:
+        case 20: case 21: case 22: case 23: case 24:
+          return 2;
+        case 4:
+          return 3;
+        case 11:
+          return 4;
+        case 13:
+          return 5;
+        case 14:
+          return 6;
+      }
+      return -1;
+    case 2:
+      switch (next_token) {
+        case 0:
+          return 7;
+        case 3: case 5: case 7: case 8: case 9: case 14: case 17: case 18:
+        case 19: case 20: case 21: case 22: case 23: case 24:
+          return 2;
+        case 4:
+          return 3;
+        case 13:
+          return 8;
+      }
+      return -1;
+    case 3:
+      switch (next_token) {
+        case 0: case 3: case 5: case 7: case 8: case 9: case 10: case 11:
+        case 12: case 13: case 14: case 17: case 18: case 19: case 20: case 21:
+        case 22: case 23: case 24:
+          return 3;
+        case 4:
+          return 9;
+      }
+      return -1;
+    case 4:
+      switch (next_token) {
+        case 3: case 5: case 7: case 8: case 9: case 14: case 17: case 18:
+        case 19: case 20: case 21: case 22: case 23: case 24:
+          return 10;
+        case 4:
+          return 11;
+        case 13:
+          return 12;
+      }
+      return -1;
+    case 5:
+      switch (next_token) {
+        case 7: case 8: case 9: case 14: case 17: case 18: case 19: case 20:
+        case 21: case 22: case 23: case 24:
+          return 5;
+        case 10:
+          return 13;
+      }
+      return -1;
+    case 6:
+      switch (next_token) {
+        case 0:
+          return 7;
+        case 3: case 5: case 7: case 8: case 9: case 14: case 17:
+          return 2;
+        case 4:
+          return 3;
+        case 13:
+          return 8;
+        case 18: case 19: case 20: case 21: case 22: case 23: case 24:
+          return 14;
+      }
+      return -1;
+    case 7:
+      switch (next_token) {
+        case 0:
+          return 7;
+        case 14:
+          return 15;
+      }
+      return -1;
+    case 8:
+      switch (next_token) {
+        case 7: case 8: case 9: case 14: case 17: case 18: case 19: case 20:
+        case 21: case 22: case 23: case 24:
+          return 16;
+        case 10:
+          return 13;
+        case 15:
+          return 17;
+      }
+      return -1;
+    case 9:
+      switch (next_token) {
+        case 0:
+          return 7;
+        case 3: case 5: case 7: case 8: case 9: case 14: case 17: case 18:
+        case 19: case 20: case 21: case 22: case 23: case 24:
+          return 9;
+        case 4:
+          return 3;
+        case 13:
+          return 18;
+      }
+      return -1;
+    case 10:
+      switch (next_token) {
+        case 3: case 5: case 7: case 8: case 9: case 14: case 17: case 18:
+        case 19: case 20: case 21: case 22: case 23: case 24:
+          return 10;
+        case 4:
+          return 11;
+        case 12:
+          return 19;
+        case 13:
+          return 20;
+      }
+      return -1;
+    case 11:
+      switch (next_token) {
+        case 0: case 3: case 5: case 7: case 8: case 9: case 10: case 11:
+        case 12: case 13: case 14: case 17: case 18: case 19: case 20: case 21:
+        case 22: case 23: case 24:
+          return 11;
+        case 4:
+          return 21;
+      }
+      return -1;
+    case 12:
+      switch (next_token) {
+        case 7: case 8: case 9: case 14: case 17: case 18: case 19: case 20:
+        case 21: case 22: case 23: case 24:
+          return 12;
+        case 10:
+          return 4;
+      }
+      return -1;
+    case 13:
+      switch (next_token) {
+        case 3: case 5: case 7: case 8: case 9: case 14: case 17: case 18:
+        case 19: case 20: case 21: case 22: case 23: case 24:
+          return 2;
+        case 4:
+          return 3;
+        case 13:
+          return 5;
+      }
+      return -1;
+    case 14:
+      switch (next_token) {
+        case 0:
+          return 7;
+        case 3: case 5: case 7: case 8: case 9: case 14: case 17:
+          return 2;
+        case 4:
+          return 3;
+        case 13:
+          return 8;
+        case 18: case 19: case 20: case 21: case 22: case 23: case 24:
+          return 22;
+      }
+      return -1;
+    case 15:
+      switch (next_token) {
+        case 18: case 19: case 20: case 21: case 22: case 23: case 24:
+          return 23;
+      }
+      return -1;
+    case 16:
+      switch (next_token) {
+        case 7: case 8: case 9: case 14: case 17: case 18: case 19: case 20:
+        case 21: case 22: case 23: case 24:
+          return 24;
+        case 10:
+          return 13;
+      }
+      return -1;
+    case 17:
+      switch (next_token) {
+        case 8: case 9:
+          return 17;
+        case 16:
+          return 19;
+      }
+      return -1;
+    case 18:
+      switch (next_token) {
+        case 7: case 8: case 9: case 14: case 17: case 18: case 19: case 20:
+        case 21: case 22: case 23: case 24:
+          return 25;
+        case 15:
+          return 17;
+      }
+      return -1;
+    case 19:
+      switch (next_token) {
+        case 0:
+          return 7;
+      }
+      return -1;
+    case 20:
+      switch (next_token) {
+        case 7: case 8: case 9: case 14: case 17: case 18: case 19: case 20:
+        case 21: case 22: case 23: case 24:
+          return 26;
+        case 10:
+          return 4;
+        case 15:
+          return 27;
+      }
+      return -1;
+    case 21:
+      switch (next_token) {
+        case 3: case 5: case 7: case 8: case 9: case 14: case 17: case 18:
+        case 19: case 20: case 21: case 22: case 23: case 24:
+          return 21;
+        case 4:
+          return 11;
+        case 12:
+          return 19;
+        case 13:
+          return 28;
+      }
+      return -1;
+    case 22:
+      switch (next_token) {
+        case 0:
+          return 29;
+        case 3: case 5: case 7: case 8: case 9: case 14: case 17: case 18:
+        case 19: case 20: case 21: case 22: case 23: case 24:
+          return 2;
+        case 4:
+          return 3;
+        case 6:
+          return 30;
+        case 13:
+          return 8;
+      }
+      return -1;
+    case 23:
+      switch (next_token) {
+        case 18: case 19: case 20: case 21: case 22: case 23: case 24:
+          return 31;
+      }
+      return -1;
+    case 24:
+      switch (next_token) {
+        case 0:
+          return 7;
+        case 7: case 8: case 9: case 14: case 17: case 18: case 19: case 20:
+        case 21: case 22: case 23: case 24:
+          return 24;
+        case 10:
+          return 13;
+      }
+      return -1;
+    case 25:
+      switch (next_token) {
+        case 7: case 8: case 9: case 14: case 17: case 18: case 19: case 20:
+        case 21: case 22: case 23: case 24:
+          return 32;
+      }
+      return -1;
+    case 26:
+      switch (next_token) {
+        case 7: case 8: case 9: case 14: case 17: case 18: case 19: case 20:
+        case 21: case 22: case 23: case 24:
+          return 33;
+        case 10:
+          return 4;
+      }
+      return -1;
+    case 27:
+      switch (next_token) {
+        case 8: case 9:
+          return 27;
+        case 16:
+          return 34;
+      }
+      return -1;
+    case 28:
+      switch (next_token) {
+        case 7: case 8: case 9: case 14: case 17: case 18: case 19: case 20:
+        case 21: case 22: case 23: case 24:
+          return 35;
+        case 15:
+          return 27;
+      }
+      return -1;
+    case 29:
+      switch (next_token) {
+        case 0:
+          return 29;
+        case 14:
+          return 36;
+      }
+      return -1;
+    case 30:
+      switch (next_token) {
+        case 0:
+          return 37;
+      }
+      return -1;
+    case 31:
+      switch (next_token) {
+        case 0:
+          return 38;
+        case 6:
+          return 30;
+      }
+      return -1;
+    case 32:
+      switch (next_token) {
+        case 0:
+          return 7;
+        case 7: case 8: case 9: case 14: case 17: case 18: case 19: case 20:
+        case 21: case 22: case 23: case 24:
+          return 32;
+      }
+      return -1;
+    case 33:
+      switch (next_token) {
+        case 7: case 8: case 9: case 14: case 17: case 18: case 19: case 20:
+        case 21: case 22: case 23: case 24:
+          return 33;
+        case 10:
+          return 4;
+        case 12:
+          return 19;
+      }
+      return -1;
+    case 34:
+      switch (next_token) {
+        case 12:
+          return 19;
+      }
+      return -1;
+    case 35:
+      switch (next_token) {
+        case 7: case 8: case 9: case 14: case 17: case 18: case 19: case 20:
+        case 21: case 22: case 23: case 24:
+          return 39;
+      }
+      return -1;
+    case 36:
+      switch (next_token) {
+        case 18: case 19: case 20: case 21: case 22: case 23: case 24:
+          return 40;
+      }
+      return -1;
+    case 37:
+      switch (next_token) {
+        case 0:
+          return 37;
+        case 9:
+          return 41;
+      }
+      return -1;
+    case 38:
+      switch (next_token) {
+        case 0:
+          return 38;
+        case 14:
+          return 42;
+      }
+      return -1;
+    case 39:
+      switch (next_token) {
+        case 7: case 8: case 9: case 14: case 17: case 18: case 19: case 20:
+        case 21: case 22: case 23: case 24:
+          return 39;
+        case 12:
+          return 19;
+      }
+      return -1;
+    case 40:
+      switch (next_token) {
+        case 18: case 19: case 20: case 21: case 22: case 23: case 24:
+          return 43;
+      }
+      return -1;
+    case 41:
+      switch (next_token) {
+        case 0:
+          return 44;
+        case 9:
+          return 45;
+      }
+      return -1;
+    case 42:
+      switch (next_token) {
+        case 18: case 19: case 20: case 21: case 22: case 23: case 24:
+          return 46;
+      }
+      return -1;
+    case 43:
+      switch (next_token) {
+        case 0:
+          return 47;
+        case 6:
+          return 30;
+      }
+      return -1;
+    case 44:
+      switch (next_token) {
+        case 0:
+          return 44;
+        case 14:
+          return 48;
+      }
+      return -1;
+    case 45:
+      switch (next_token) {
+        case 0:
+          return 44;
+      }
+      return -1;
+    case 46:
+      switch (next_token) {
+        case 18: case 19: case 20: case 21: case 22: case 23: case 24:
+          return 49;
+      }
+      return -1;
+    case 47:
+      switch (next_token) {
+        case 0:
+          return 47;
+        case 9:
+          return 50;
+        case 14:
+          return 42;
+      }
+      return -1;
+    case 48:
+      switch (next_token) {
+        case 18: case 19: case 20: case 21: case 22: case 23: case 24:
+          return 51;
+      }
+      return -1;
+    case 49:
+      switch (next_token) {
+        case 0:
+          return 52;
+      }
+      return -1;
+    case 50:
+      switch (next_token) {
+        case 0:
+          return 53;
+        case 9:
+          return 54;
+      }
+      return -1;
+    case 51:
+      switch (next_token) {
+        case 18: case 19: case 20: case 21: case 22: case 23: case 24:
+          return 55;
+      }
+      return -1;
+    case 52:
+      switch (next_token) {
+        case 0:
+          return 52;
+        case 9:
+          return 50;
+      }
+      return -1;
+    case 53:
+      switch (next_token) {
+        case 0:
+          return 53;
+        case 9:
+          return 56;
+      }
+      return -1;
+    case 54:
+      switch (next_token) {
+        case 0:
+          return 53;
+      }
+      return -1;
+    case 55:
+      switch (next_token) {
+        case 0:
+          return 57;
+      }
+      return -1;
+    case 56:
+      switch (next_token) {
+        case 9:
+          return 58;
+      }
+      return -1;
+    case 57:
+      switch (next_token) {
+        case 9:
+          return 59;
+      }
+      return -1;
+    case 58:
+      switch (next_token) {
+        case 10:
+          return 60;
+      }
+      return -1;
+    case 59:
+      switch (next_token) {
+        case 9:
+          return 61;
+      }
+      return -1;
+    case 60:
+      switch (next_token) {
+        case 9:
+          return 62;
+      }
+      return -1;
+    case 61:
+      switch (next_token) {
+        case 0:
+          return 63;
+        case 9:
+          return 64;
+      }
+      return -1;
+    case 62:
+      switch (next_token) {
+        case 9:
+          return 65;
+      }
+      return -1;
+    case 63:
+      switch (next_token) {
+        case 0:
+          return 63;
+        case 9:
+          return 66;
+      }
+      return -1;
+    case 64:
+      switch (next_token) {
+        case 9:
+          return 67;
+      }
+      return -1;
+    case 65:
+      switch (next_token) {
+        case 0:
+          return 68;
+        case 10:
+          return 69;
+      }
+      return -1;
+    case 66:
+      switch (next_token) {
+        case 9:
+          return 70;
+      }
+      return -1;
+    case 67:
+      switch (next_token) {
+        case 0:
+          return 63;
+        case 9:
+          return 66;
+        case 10:
+          return 71;
+      }
+      return -1;
+    case 68:
+      switch (next_token) {
+        case 0:
+          return 68;
+        case 5: case 7:
+          return 72;
+        case 9:
+          return 73;
+        case 14:
+          return 74;
+      }
+      return -1;
+    case 69:
+      switch (next_token) {
+        case 9:
+          return 75;
+      }
+      return -1;
+    case 70:
+      switch (next_token) {
+        case 10:
+          return 71;
+      }
+      return -1;
+    case 71:
+      switch (next_token) {
+        case 9:
+          return 76;
+      }
+      return -1;
+    case 72:
+      switch (next_token) {
+        case 9: case 14: case 18: case 19: case 20: case 21: case 22: case 23:
+        case 24:
+          return 74;
+      }
+      return -1;
+    case 73:
+      switch (next_token) {
+        case 9:
+          return 77;
+      }
+      return -1;
+    case 74:
+      switch (next_token) {
+        case 0:
+          return 78;
+        case 9: case 14: case 18: case 19: case 20: case 21: case 22: case 23:
+        case 24:
+          return 74;
+      }
+      return -1;
+    case 75:
+      switch (next_token) {
+        case 9:
+          return 79;
+      }
+      return -1;
+    case 76:
+      switch (next_token) {
+        case 9:
+          return 80;
+      }
+      return -1;
+    case 77:
+      switch (next_token) {
+        case 9:
+          return 81;
+      }
+      return -1;
+    case 78:
+      switch (next_token) {
+        case 0:
+          return 78;
+        case 5: case 7:
+          return 82;
+        case 9:
+          return 83;
+        case 14:
+          return 84;
+      }
+      return -1;
+    case 79:
+      switch (next_token) {
+        case 0:
+          return 68;
+      }
+      return -1;
+    case 80:
+      switch (next_token) {
+        case 0:
+          return 85;
+        case 10:
+          return 86;
+      }
+      return -1;
+    case 81:
+      switch (next_token) {
+        case 9:
+          return 87;
+      }
+      return -1;
+    case 82:
+      switch (next_token) {
+        case 9: case 14: case 18: case 19: case 20: case 21: case 22: case 23:
+        case 24:
+          return 84;
+      }
+      return -1;
+    case 83:
+      switch (next_token) {
+        case 9:
+          return 88;
+      }
+      return -1;
+    case 84:
+      switch (next_token) {
+        case 0:
+          return 89;
+        case 9: case 14: case 18: case 19: case 20: case 21: case 22: case 23:
+        case 24:
+          return 84;
+      }
+      return -1;
+    case 85:
+      switch (next_token) {
+        case 0:
+          return 90;
+        case 5: case 7:
+          return 91;
+        case 14:
+          return 92;
+      }
+      return -1;
+    case 86:
+      switch (next_token) {
+        case 9:
+          return 93;
+      }
+      return -1;
+    case 87:
+      switch (next_token) {
+        case 0:
+          return 94;
+        case 2:
+          return 95;
+        case 5: case 7:
+          return 96;
+        case 14:
+          return 97;
+      }
+      return -1;
+    case 88:
+      switch (next_token) {
+        case 9:
+          return 98;
+      }
+      return -1;
+    case 89:
+      switch (next_token) {
+        case 0:
+          return 89;
+        case 9:
+          return 83;
+      }
+      return -1;
+    case 90:
+      switch (next_token) {
+        case 0:
+          return 90;
+        case 5: case 7:
+          return 91;
+        case 14:
+          return 92;
+        case 23:
+          return 99;
+      }
+      return -1;
+    case 91:
+      switch (next_token) {
+        case 9: case 14: case 18: case 19: case 20: case 21: case 22: case 23:
+        case 24:
+          return 92;
+      }
+      return -1;
+    case 92:
+      switch (next_token) {
+        case 0:
+          return 100;
+        case 9: case 14: case 18: case 19: case 20: case 21: case 22: case 23:
+        case 24:
+          return 92;
+      }
+      return -1;
+    case 93:
+      switch (next_token) {
+        case 9:
+          return 101;
+      }
+      return -1;
+    case 94:
+      switch (next_token) {
+        case 0:
+          return 94;
+        case 2:
+          return 95;
+        case 5: case 7:
+          return 96;
+        case 14:
+          return 97;
+        case 23:
+          return 99;
+      }
+      return -1;
+    case 95:
+      switch (next_token) {
+        case 1:
+          return 102;
+      }
+      return -1;
+    case 96:
+      switch (next_token) {
+        case 9: case 14: case 18: case 19: case 20: case 21: case 22: case 23:
+        case 24:
+          return 97;
+      }
+      return -1;
+    case 97:
+      switch (next_token) {
+        case 0:
+          return 103;
+        case 2:
+          return 95;
+        case 9: case 14: case 18: case 19: case 20: case 21: case 22: case 23:
+        case 24:
+          return 97;
+      }
+      return -1;
+    case 98:
+      switch (next_token) {
+        case 9:
+          return 104;
+      }
+      return -1;
+    case 99:
+      switch (next_token) {
+        case 19:
+          return 105;
+      }
+      return -1;
+    case 100:
+      switch (next_token) {
+        case 0:
+          return 100;
+        case 5: case 7:
+          return 106;
+        case 14:
+          return 107;
+        case 23:
+          return 99;
+      }
+      return -1;
+    case 101:
+      switch (next_token) {
+        case 0:
+          return 85;
+      }
+      return -1;
+    case 102:
+      switch (next_token) {
+      }
+      return -1;
+    case 103:
+      switch (next_token) {
+        case 0:
+          return 103;
+        case 2:
+          return 95;
+        case 5: case 7:
+          return 108;
+        case 14:
+          return 109;
+        case 23:
+          return 99;
+      }
+      return -1;
+    case 104:
+      switch (next_token) {
+        case 0:
+          return 110;
+        case 2:
+          return 95;
+      }
+      return -1;
+    case 105:
+      switch (next_token) {
+        case 21:
+          return 111;
+      }
+      return -1;
+    case 106:
+      switch (next_token) {
+        case 9: case 14: case 18: case 19: case 20: case 21: case 22: case 23:
+        case 24:
+          return 107;
+      }
+      return -1;
+    case 107:
+      switch (next_token) {
+        case 0:
+          return 112;
+        case 9: case 14: case 18: case 19: case 20: case 21: case 22: case 23:
+        case 24:
+          return 107;
+      }
+      return -1;
+    case 108:
+      switch (next_token) {
+        case 9: case 14: case 18: case 19: case 20: case 21: case 22: case 23:
+        case 24:
+          return 109;
+      }
+      return -1;
+    case 109:
+      switch (next_token) {
+        case 0:
+          return 110;
+        case 2:
+          return 95;
+        case 9: case 14: case 18: case 19: case 20: case 21: case 22: case 23:
+        case 24:
+          return 109;
+      }
+      return -1;
+    case 110:
+      switch (next_token) {
+        case 0:
+          return 110;
+        case 2:
+          return 95;
+        case 23:
+          return 99;
+      }
+      return -1;
+    case 111:
+      switch (next_token) {
+        case 22:
+          return 113;
+      }
+      return -1;
+    case 112:
+      switch (next_token) {
+        case 0:
+          return 112;
+        case 23:
+          return 99;
+      }
+      return -1;
+    case 113:
+      switch (next_token) {
+        case 24:
+          return 114;
+      }
+      return -1;
+    case 114:
+      switch (next_token) {
+        case 19:
+          return 115;
+      }
+      return -1;
+    case 115:
+      switch (next_token) {
+        case 0:
+          return 116;
+      }
+      return -1;
+    case 116:
+      switch (next_token) {
+        case 20:
+          return 117;
+      }
+      return -1;
+    case 117:
+      switch (next_token) {
+        case 23:
+          return 118;
+      }
+      return -1;
+    case 118:
+      switch (next_token) {
+        case 22:
+          return 119;
+      }
+      return -1;
+    case 119:
+      switch (next_token) {
+        case 21:
+          return 120;
+      }
+      return -1;
+    case 120:
+      switch (next_token) {
+        case 0:
+          return 121;
+      }
+      return -1;
+    case 121:
+      switch (next_token) {
+        case 1:
+          return 102;
+        case 7: case 8: case 9: case 14: case 17: case 18: case 19: case 20:
+        case 21: case 22: case 23: case 24:
+          return 121;
+      }
+      return -1;
+  }
+  return -1;
+}
+#endif
@@ -98,27 +98,10 @@ acceptable.  Do NOT use for cryptographic purposes.
 --------------------------------------------------------------------
 */
 
-unsigned int hashfn( unsigned char *k, unsigned int length, unsigned int initval)
+static inline unsigned int hash_tail(unsigned int a, unsigned int b, unsigned int c,
+    const unsigned char *k, unsigned int len)
 {
-   register unsigned int a,b,c,len;
-
-   /* Set up the internal state */
-   len = length;
-   a = b = 0x9e3779b9;  /* the golden ratio; an arbitrary value */
-   c = initval;           /* the previous hash value */
-
-   /*---------------------------------------- handle most of the key */
-   while (len >= 12)
-   {
-      a += (k[0] +((unsigned int)k[1]<<8) +((unsigned int)k[2]<<16) +((unsigned int)k[3]<<24));
-      b += (k[4] +((unsigned int)k[5]<<8) +((unsigned int)k[6]<<16) +((unsigned int)k[7]<<24));
-      c += (k[8] +((unsigned int)k[9]<<8) +((unsigned int)k[10]<<16)+((unsigned int)k[11]<<24));
-      mix(a,b,c);
-      k += 12; len -= 12;
-   }
-
    /*------------------------------------- handle the last 11 bytes */
-   c += length;
    switch(len)              /* all the case statements fall through */
    {
    case 11: c+=((unsigned int)k[10]<<24);
@@ -140,4 +123,56 @@ unsigned int hashfn( unsigned char *k, unsigned int length, unsigned int initval
    return c;
 }
 
+unsigned int hashfn( unsigned char *k, unsigned int length, unsigned int initval)
+{
+   register unsigned int a,b,c,len;
+
+   /* Set up the internal state */
+   len = length;
+   a = b = 0x9e3779b9;  /* the golden ratio; an arbitrary value */
+   c = initval;           /* the previous hash value */
+
+   /*---------------------------------------- handle most of the key */
+   while (len >= 12)
+   {
+      a += (k[0] +((unsigned int)k[1]<<8) +((unsigned int)k[2]<<16) +((unsigned int)k[3]<<24));
+      b += (k[4] +((unsigned int)k[5]<<8) +((unsigned int)k[6]<<16) +((unsigned int)k[7]<<24));
+      c += (k[8] +((unsigned int)k[9]<<8) +((unsigned int)k[10]<<16)+((unsigned int)k[11]<<24));
+      mix(a,b,c);
+      k += 12; len -= 12;
+   }
+
+   return hash_tail(a, b, c + length, k, len);
+}
+
+/* Case fold the length bytes of UTF-8 at text into folded (as fold_case()
+ * does) and return hashfn() of the result, in a single pass : each 12 byte
+ * block is mixed in as soon as it has been folded, while it's still to hand.
+ * folded needs room for length bytes. */
+unsigned int fold_and_hash(const char *text, int length, char *folded, unsigned int initval)
+{
+   unsigned int a,b,c;
+   const unsigned char *k = (const unsigned char *) folded;
+   int i, done;
+
+   a = b = 0x9e3779b9;
+   c = initval;
+
+   for (i = done = 0; i < length; ) {
+      unsigned char x = text[i];
+      if (x < 0x80) {
+         folded[i++] = ((x >= 'A') && (x <= 'Z')) ? x + ('a' - 'A') : x;
+      } else {
+         i += fold_case_character(folded + i, text + i, length - i);
+      }
+      while (i - done >= 12) {
+         a += (k[0] +((unsigned int)k[1]<<8) +((unsigned int)k[2]<<16) +((unsigned int)k[3]<<24));
+         b += (k[4] +((unsigned int)k[5]<<8) +((unsigned int)k[6]<<16) +((unsigned int)k[7]<<24));
+         c += (k[8] +((unsigned int)k[9]<<8) +((unsigned int)k[10]<<16)+((unsigned int)k[11]<<24));
+         mix(a,b,c);
+         k += 12; done += 12;
+      }
+   }
 
+   return hash_tail(a, b, c + length, k, length - done);
+}
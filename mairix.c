@@ -146,6 +146,37 @@ static char *copy_value(char *text)/*{{{*/
   return result;
 }
 /*}}}*/
+static int parse_memory_size(const char *text, size_t *result)/*{{{*/
+{
+  /* A number of megabytes, or of kilo/mega/gigabytes with a suffix */
+  unsigned long n;
+  char *end;
+  int shift;
+
+  n = strtoul(text, &end, 10);
+  if (end == text) return 0;
+  switch (*end) {
+    case 'k': case 'K': shift = 10; end++; break;
+    case 'm': case 'M': shift = 20; end++; break;
+    case 'g': case 'G': shift = 30; end++; break;
+    default:            shift = 20; break;
+  }
+  if (*end) return 0;
+  *result = (size_t) n << shift;
+  return 1;
+}
+/*}}}*/
+static int copy_int_value(char *text)/*{{{*/
+{
+  char *value;
+  int result;
+  value = copy_value(text);
+  if (!value) return 0;
+  result = atoi(value);
+  free(value);
+  return result;
+}
+/*}}}*/
 static void add_folders(char **folders, char *extra_folders)/*{{{*/
 {
   /* note : extra_pointers is stale after this routine exits. */
@@ -279,6 +310,14 @@ static void parse_rc_file(char *name)/*{{{*/
     else if (!strncasecmp(p, "database=", 9)) database_path = copy_value(p);
     else if (!strncasecmp(p, "nochecks", 8)) skip_integrity_checks = 1;
     else if (!strncasecmp(p, "sort=date+", 10)) sort_by_date = 1;
+    else if (!strncasecmp(p, "index_order=date", 16)) message_order = MO_DATE;
+    else if (!strncasecmp(p, "index_order=thread", 18)) message_order = MO_THREAD;
+    else if (!strncasecmp(p, "checkpoint_interval=", 20)) checkpoint_interval = copy_int_value(p);
+    else if (!strncasecmp(p, "max_token_length=", 17)) junk_rules.max_token_length = copy_int_value(p);
+    else if (!strncasecmp(p, "max_token_digits=", 17)) junk_rules.max_digit_percent = copy_int_value(p);
+    else if (!strncasecmp(p, "max_token_shifts=", 17)) junk_rules.max_shift_percent = copy_int_value(p);
+    else if (!strncasecmp(p, "max_part_bytes=", 15)) junk_rules.max_part_bytes = copy_int_value(p);
+    else if (!strncasecmp(p, "index_armor", 11)) junk_rules.skip_armor = 0;
     else {
       if (verbose) {
         fprintf(stderr, "Unrecognized option at line %d in %s\n", lineno, name);
@@ -302,7 +341,7 @@ static int message_compare(const void *a, const void *b)/*{{{*/
   return strcmp(aa->src.mpf.path, bb->src.mpf.path);
 }
 /*}}}*/
-static void sort_message_list(struct msgpath_array *arr)/*{{{*/
+void sort_message_list(struct msgpath_array *arr)/*{{{*/
 {
   if (arr->paths)
     qsort(arr->paths, arr->n, sizeof(struct msgpath), message_compare);
@@ -316,7 +355,7 @@ static int compare_strings(const void *a, const void *b)/*{{{*/
   return strcmp(*aa, *bb);
 }
 /*}}}*/
-static int check_message_list_for_duplicates(struct msgpath_array *msgs)/*{{{*/
+int check_message_list_for_duplicates(struct msgpath_array *msgs)/*{{{*/
 {
   /* Caveat : only examines the file-per-message case */
   char **sorted_paths, **sorted_imap;
@@ -446,6 +485,12 @@ static void print_version(void)/*{{{*/
 /*}}}*/
 static void handlesig(int signo)/*{{{*/
 {
+  /* Part way through indexing, stop once the current message is done and
+   * save what's been indexed so far.  A second signal stops at once. */
+  if (checkpoint_path && !index_interrupted) {
+    index_interrupted = 1;
+    return;
+  }
   unlock_and_exit(7);
 }
 /*}}}*/
@@ -455,6 +500,7 @@ static void usage(void)/*{{{*/
 
   printf("mairix [-h]                                    : Show help\n"
          "mairix [-f <rcfile>] [-v] [-p] [-F]            : Build index\n"
+         "mairix [-f <rcfile>] [-v] [-p] [-F] --watch    : Build index, then keep it up to date\n"
          "mairix [-f <rcfile>] [-a] [-t] expr1 ... exprN : Run search\n"
          "mairix [-f <rcfile>] -d                        : Dump database to stdout\n"
          "-h           : show this help\n"
@@ -463,6 +509,9 @@ static void usage(void)/*{{{*/
          "-v           : be verbose\n"
          "-p           : purge messages that no longer exist\n"
          "-F           : fast scan for maildir and MH folders (no mtime or size checks)\n"
+         "--watch      : after indexing, keep watching the folders and update the index as they change\n"
+         "--max-memory <size> : spill words to disk while indexing when they take more than <size>\n"
+         "               megabytes (or use a k, m or g suffix)\n"
          "-a           : add new matches to match folder (default : clear it first)\n"
          "-x           : display excerpt of message headers (default : use match folder)\n" 
          "-t           : include all messages in same threads as matching messages\n"
@@ -542,6 +591,7 @@ int main (int argc, char **argv)/*{{{*/
   int do_integrity_checks = 1;
   int do_forced_unlock = 0;
   int do_fast_index = 0;
+  int do_watch = 0;
   int do_mbox_symlinks = 0;
   struct imap_ll *imapc = NULL;
 
@@ -593,6 +643,18 @@ int main (int argc, char **argv)/*{{{*/
     } else if (!strcmp(*argv, "-F") ||
                !strcmp(*argv, "--fast-index")) {
       do_fast_index = 1;
+    } else if (!strcmp(*argv, "--watch")) {
+      do_watch = 1;
+    } else if (!strcmp(*argv, "--max-memory")) {
+      ++argv, --argc;
+      if (!argc) {
+        fprintf(stderr, "No size given after --max-memory\n");
+        exit(1);
+      }
+      if (!parse_memory_size(*argv, &max_token_memory)) {
+        fprintf(stderr, "Size given after --max-memory could not be parsed\n");
+        exit(1);
+      }
     } else if (!strcmp(*argv, "--force-hash-key-new-database")) {
       ++argv, --argc;
       if (!argc) {
@@ -640,6 +702,18 @@ int main (int argc, char **argv)/*{{{*/
     do_search = 1;
   }
 
+  if (do_watch && (do_search || do_dump)) {
+    fprintf(stderr, "--watch can only be used when indexing\n");
+    exit(2);
+  }
+
+#ifndef USE_INOTIFY
+  if (do_watch) {
+    fprintf(stderr, "This mairix was built without support for --watch\n");
+    exit(2);
+  }
+#endif
+
   parse_rc_file(arg_rc_file_path);
 
   if (getenv("MAIRIX_FOLDER_BASE")) {
@@ -710,6 +784,7 @@ int main (int argc, char **argv)/*{{{*/
   signal(SIGQUIT, handlesig);
 
   lock_database(database_path, do_forced_unlock);
+  spill_path = database_path;
 
   if (do_dump) {
     dump_database(database_path);
@@ -795,6 +870,21 @@ int main (int argc, char **argv)/*{{{*/
       unlock_and_exit(2);
     }
 
+    /* Try to open existing database.  This is done first, so that the
+     * directory information in it can save re-reading unchanged maildirs. */
+    ftype = classify_file(database_path);
+    if (ftype == M_FILE) {
+      if (verbose) printf("Reading existing database...\n");
+      db = new_database_from_file(database_path, do_integrity_checks);
+      if (verbose) printf("Loaded %d existing messages\n", db->n_msgs);
+    } else if (ftype == M_NONE) {
+      if (verbose) printf("Starting new database\n");
+      db = new_database( forced_hash_key );
+    } else {
+      fprintf(stderr, "database path %s is not a file; you can't put the database there\n", database_path);
+      unlock_and_exit(2);
+    }
+
     if (verbose) printf("Finding all currently existing messages...\n");
     msgs = new_msgpath_array();
     if (imap_folders) {
@@ -803,10 +893,10 @@ int main (int argc, char **argv)/*{{{*/
       build_imap_message_list(imap_folders, msgs, omit_globs, imapc);
     }
     if (maildir_folders) {
-      build_message_list(folder_base, maildir_folders, FT_MAILDIR, msgs, omit_globs);
+      build_message_list(folder_base, maildir_folders, FT_MAILDIR, msgs, omit_globs, db);
     }
     if (mh_folders) {
-      build_message_list(folder_base, mh_folders, FT_MH, msgs, omit_globs);
+      build_message_list(folder_base, mh_folders, FT_MH, msgs, omit_globs, db);
     }
     sort_message_list(msgs);
 
@@ -816,31 +906,51 @@ int main (int argc, char **argv)/*{{{*/
       unlock_and_exit(2);
     }
 
-    /* Try to open existing database */
-    ftype = classify_file(database_path);
-    if (ftype == M_FILE) {
-      if (verbose) printf("Reading existing database...\n");
-      db = new_database_from_file(database_path, do_integrity_checks);
-      if (verbose) printf("Loaded %d existing messages\n", db->n_msgs);
-    } else if (ftype == M_NONE) {
-      if (verbose) printf("Starting new database\n");
-      db = new_database( forced_hash_key );
-    } else {
-      fprintf(stderr, "database path %s is not a file; you can't put the database there\n", database_path);
-      unlock_and_exit(2);
-    }
-
     build_mbox_lists(db, folder_base, mboxen, omit_globs, do_mbox_symlinks);
 
+    if (checkpoint_interval > 0) checkpoint_path = database_path;
     any_updates = update_database(db, msgs->paths, msgs->n, do_fast_index, imapc);
+    checkpoint_path = NULL;
+    any_updates |= set_database_dirs(db, msgs);
+    if (index_interrupted) {
+      /* Stopped after the last message was indexed : keep the lot */
+      write_database(db, database_path, do_integrity_checks);
+      unlock_and_exit(7);
+    }
     if (do_purge) {
-      any_purges = cull_dead_messages(db, do_integrity_checks);
+      any_purges = cull_dead_messages(db, do_integrity_checks, 1);
     }
     if (any_updates || any_purges) {
       /* For now write it every time.  This is obviously the most reliable method. */
       write_database(db, database_path, do_integrity_checks);
     }
 
+    if (do_watch) {
+      struct watch_settings ws;
+      if (max_token_memory) {
+        /* Words spilled to disk were only merged into the file, so read them
+         * back.  The updates while watching are small, so don't spill them. */
+        free_database(db);
+        db = new_database_from_file(database_path, do_integrity_checks);
+        max_token_memory = 0;
+      }
+      ws.folder_base = folder_base;
+      ws.maildir_folders = maildir_folders;
+      ws.mh_folders = mh_folders;
+      ws.mboxen = mboxen;
+      ws.database_path = database_path;
+      ws.omit_globs = omit_globs;
+      ws.do_mbox_symlinks = do_mbox_symlinks;
+      ws.do_fast_index = do_fast_index;
+      ws.do_purge = do_purge;
+      ws.do_integrity_checks = do_integrity_checks;
+      /* IMAP folders aren't watched; the messages already indexed from them
+       * are just kept. */
+      free_msgpath_array(msgs);
+      unlock_database();
+      watch_folders(db, &ws);
+    }
+
 #if 0
     get_db_stats(db);
 #endif
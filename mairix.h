@@ -36,6 +36,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <signal.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 
@@ -86,15 +87,36 @@ struct msgpath {/*{{{*/
   unsigned int seen:1;
   unsigned int replied:1;
   unsigned int flagged:1;
+
+  /* Set when the entry was carried over from the database because its
+     directory was unchanged since the last run; mtime and size are then
+     the database's, and the file needn't be stat'd again. */
+  unsigned int dir_unchanged:1;
     
   /* + other stuff eventually */
 };
 /*}}}*/
 
+struct dirstamp {/*{{{*/
+  /* A maildir new/ or cur/ directory, with the mtime it had and the number of
+   * message entries it held when it was last scanned.  MH folders are not
+   * stamped, since their messages can be edited in place. */
+  char *path;
+  time_t mtime;
+  int n_entries;
+};
+/*}}}*/
+
 struct msgpath_array {/*{{{*/
   struct msgpath *paths;
   int n;
   int max;
+
+  /* Directories read while building the list, to be saved in the
+   * database. */
+  struct dirstamp *dirs;
+  int n_dirs;
+  int max_dirs;
 };
 /*}}}*/
 
@@ -106,22 +128,31 @@ struct matches {/*{{{*/
 };
 /*}}}*/
 struct token {/*{{{*/
-  char *text;
-  unsigned long hashval;
+  char *text; /* in the table's text blocks */
   /* to store delta-compressed info of which msgpaths match the token */
   struct matches match0;
 };
 /*}}}*/
 struct token2 {/*{{{*/
-  char *text;
-  unsigned long hashval;
+  char *text; /* in the table's text blocks */
   /* to store delta-compressed info of which msgpaths match the token */
   struct matches match0;
   struct matches match1;
 };
 /*}}}*/
+struct token_slot {/*{{{*/
+  /* What a probe needs to know about the token in a hash table slot, kept
+   * apart from the token itself so that only a likely match has to be looked
+   * at. */
+  unsigned int hashval; /* full width, not masked */
+  unsigned int len; /* length of the text, 0 if the slot is empty */
+};
+/*}}}*/
+struct text_block;
 struct toktable {/*{{{*/
   struct token **tokens;
+  struct token_slot *slots; /* parallel to tokens */
+  struct text_block *text; /* where the token texts are kept */
   int n; /* # in use */
   int size; /* # allocated */
   unsigned int mask; /* for masking down hash values */
@@ -130,6 +161,8 @@ struct toktable {/*{{{*/
 /*}}}*/
 struct toktable2 {/*{{{*/
   struct token2 **tokens;
+  struct token_slot *slots; /* parallel to tokens */
+  struct text_block *text; /* where the token texts are kept */
   int n; /* # in use */
   int size; /* # allocated */
   unsigned int mask; /* for masking down hash values */
@@ -244,6 +277,10 @@ struct database {/*{{{*/
   int n_mboxen; /* number in use. */
   int max_mboxen; /* space allocated */
 
+  /* Message directories as of the last run, sorted by path. */
+  struct dirstamp *dirs;
+  int n_dirs;
+
   /* Seed for hashing in the token tables.  Randomly created for
    * each new database - avoid DoS attacks through carefully
    * crafted messages. */
@@ -262,9 +299,29 @@ struct database {/*{{{*/
    * Encoding chain 1 stores just the Message-Id.  Used for search by message ID.
   */
   struct toktable2 *msg_ids;
+
+  /* Word tables written out to disk to save memory while indexing, or NULL */
+  struct spill *spill;
+};
+/*}}}*/
+
+struct junk_rules {/*{{{*/
+  /* Limits on the words indexed from message bodies; 0 turns each one off */
+  int max_token_length;  /* longest word indexed, in bytes */
+  int max_digit_percent; /* of a long word mixing letters and digits */
+  int max_shift_percent; /* changes between upper case, lower case and digits */
+  int skip_armor;        /* leave out PGP armor and uuencoded files */
+  int max_part_bytes;    /* how much of each text part to index */
 };
 /*}}}*/
 
+/* How the messages are numbered when dead ones are purged from the database */
+enum message_order {
+  MO_FOUND,  /* in the order they were found */
+  MO_DATE,   /* by date */
+  MO_THREAD  /* by thread, threads in order of their earliest message */
+};
+
 struct string_list {/*{{{*/
   struct string_list *next;
   struct string_list *prev;
@@ -298,6 +355,9 @@ extern struct traverse_methods mbox_traverse_methods;
 
 extern int verbose; /* cmd line -v switch */
 extern int do_hardlinks; /* cmd line -H switch */
+extern struct junk_rules junk_rules; /* rc file settings */
+extern enum message_order message_order; /* rc file setting */
+extern int checkpoint_interval; /* rc file setting */
 
 /* Lame fix for systems where NAME_MAX isn't defined after including the above
  * set of .h files (Solaris, FreeBSD so far).  Probably grossly oversized but
@@ -321,6 +381,7 @@ void free_string_array(int n, char ***arr);
 
 /* In hash.c */
 unsigned int hashfn( unsigned char *k, unsigned int length, unsigned int initval);
+unsigned int fold_and_hash(const char *text, int length, char *folded, unsigned int initval);
 
 /* In dirscan.c */
 struct msgpath_array *new_msgpath_array(void);
@@ -329,7 +390,14 @@ void free_msgpath_array(struct msgpath_array *x);
 void string_list_to_array(struct string_list *list, int *n, char ***arr);
 void split_on_colons(const char *str, int *n, char ***arr);
 void build_message_list(char *folder_base, char *folders, enum folder_type ft,
-    struct msgpath_array *msgs, struct globber_array *omit_globs);
+    struct msgpath_array *msgs, struct globber_array *omit_globs,
+    struct database *db);
+void expand_message_folders(char *folder_base, char *folders, enum folder_type ft,
+    struct globber_array *omit_globs, int *n_paths, char ***paths);
+void build_watched_message_list(int n_dirs, char **dirs, enum folder_type *fts,
+    char *changed, struct msgpath_array *msgs, struct database *db);
+int set_database_dirs(struct database *db, struct msgpath_array *msgs);
+void free_dirstamps(struct dirstamp *dirs, int n);
 
 /* In rfc822.c */
 struct rfc822 *make_rfc822(char *filename);
@@ -342,12 +410,30 @@ enum data_to_rfc822_error {
   DTR8_BAD_ATTACHMENT /* corrupt attachment (e.g. no body part) */
 };
 struct rfc822 *data_to_rfc822(struct msg_src *src, char *data, int length, enum data_to_rfc822_error *error);
+/* For parsing a message without building a struct rfc822 for it.
+ * start_message and end_message are called around each message, including
+ * ones embedded as message/rfc822 parts (depth > 0).  part is called for each
+ * leaf part in order; text is the decoded contents of text/plain and
+ * text/html parts (NULL for anything else), and is only valid until part
+ * returns.  A message/rfc822 part is reported after its contents. */
+struct rfc822_visitor {/*{{{*/
+  void (*start_message)(void *arg, struct headers *hdrs, int depth);
+  void (*part)(void *arg, enum content_type ct, char *text, const char *filename);
+  void (*end_message)(void *arg, struct headers *hdrs, int depth);
+  void *arg;
+};
+/*}}}*/
+int visit_rfc822(struct msg_src *src, char *data, int length, struct rfc822_visitor *v, enum data_to_rfc822_error *error);
 enum ro_map_compressed_behaviour {
   MAP_DECOMPRESS_IF_APPLICABLE,
   MAP_NO_DECOMPRESSION
 };
 void create_ro_mapping(const char *filename, unsigned char **data, int *len, enum ro_map_compressed_behaviour cb);
 void free_ro_mapping(unsigned char *data, int len);
+struct prefetch;
+struct prefetch *start_prefetch(char **paths, int n);
+int visit_prefetched_file(struct prefetch *p, int k, struct rfc822_visitor *v);
+void end_prefetch(struct prefetch *p);
 char *format_msg_src(struct msg_src *src);
 
 /* In tok.c */
@@ -357,10 +443,27 @@ void free_token(struct token *x);
 void free_token2(struct token2 *x);
 void free_toktable(struct toktable *x);
 void free_toktable2(struct toktable2 *x);
-void add_token_in_file(int file_index, unsigned int hash_key, char *tok_text, struct toktable *table);
-void check_and_enlarge_encoding(struct matches *m);
+char *store_token_text(struct text_block **blocks, const char *text, int len);
+void reset_token_filter(void);
+void add_token_in_file(int file_index, unsigned int hash_key, const char *tok_text, int len, struct toktable *table);
+void enlarge_encoding(struct matches *m, int extra);
+void free_encoding(struct matches *m);
 void insert_index_on_encoding(struct matches *m, int idx);
-void add_token2_in_file(int file_index, unsigned int hash_key, char *tok_text, struct toktable2 *table, int add_to_chain1);
+void add_token2_in_file(int file_index, unsigned int hash_key, const char *tok_text, int len, struct toktable2 *table, int add_to_chain1);
+extern size_t token_memory;
+
+/* In spill.c */
+struct spill;
+struct spill_merge;
+extern size_t max_token_memory; /* cmd line --max-memory switch */
+extern const char *spill_path;
+void spill_toktables(struct database *db);
+void check_token_memory(struct database *db);
+void recode_spilled_tables(struct spill *s, int *new_idx, int n_old);
+void free_spill(struct spill *s);
+struct spill_merge *start_spill_merge(struct spill *s);
+int next_merged_token(struct spill_merge *m, int *field, const char **text, int *len, const struct matches **match0);
+void end_spill_merge(struct spill_merge *m);
 
 /* In db.c */
 #define CREATE_RANDOM_DATABASE_HASH 0
@@ -372,12 +475,17 @@ void tokenise_message(int file_index, struct database *db, struct rfc822 *msg);
 struct imap_ll;
 int update_database(struct database *db, struct msgpath *sorted_paths, int n_paths, int do_fast_index, struct imap_ll *);
 void check_database_integrity(struct database *db);
-int cull_dead_messages(struct database *db, int do_integrity_checks);
+int cull_dead_messages(struct database *db, int do_integrity_checks, int allow_reorder);
+int compare_ints(const void *a, const void *b);
+extern char *checkpoint_path;
+extern volatile sig_atomic_t index_interrupted;
+void maybe_checkpoint(struct database *db, int n_done);
 
 /* In mbox.c */
 void build_mbox_lists(struct database *db, const char *folder_base,
     const char *mboxen_paths, struct globber_array *omit_globs,
     int do_mbox_symlinks);
+void build_changed_mbox_lists(struct database *db, int n_paths, char **paths, const char *changed);
 int add_mbox_messages(struct database *db);
 void compute_checksum(const char *data, size_t len, checksum_t *csum);
 void cull_dead_mboxen(struct database *db);
@@ -405,6 +513,22 @@ int is_glob_match(struct globber *g, const char *s);
 /* In writer.c */
 void write_database(struct database *db, char *filename, int do_integrity_checks);
 
+/* In watch.c */
+struct watch_settings {/*{{{*/
+  char *folder_base;
+  char *maildir_folders;
+  char *mh_folders;
+  char *mboxen;
+  char *database_path;
+  struct globber_array *omit_globs;
+  int do_mbox_symlinks;
+  int do_fast_index;
+  int do_purge;
+  int do_integrity_checks;
+};
+/*}}}*/
+void watch_folders(struct database *db, struct watch_settings *ws);
+
 /* In search.c */
 int search_top(int do_threads, int do_augment, char *database_path, char *complete_mfolder, char **argv, enum folder_type ft, int verbose, const char *imap_pipe, const char *imap_server, const char *imap_username, const char *imap_password, int sort_by_date);
 
@@ -420,12 +544,27 @@ void dump_database(char *filename);
 /* In strexpand.c */
 char *expand_string(const char *p);
 
+/* In charset.c */
+char *text_to_utf8(const char *charset, char *text, int len, int *out_len, char **buf, int *buf_size);
+int fold_case_character(char *dst, const char *src, int len);
+void fold_case(char *text);
+int utf8_separator_length(const char *text);
+char *put_utf8(char *q, unsigned int c);
+
+/* In arena.c */
+void *arena_alloc(size_t size);
+char *arena_string(const char *s, int len);
+void arena_reset(void);
+
 /* In dotlock.c */
 void lock_database(char *path, int forced_unlock);
+int try_lock_database(char *path);
 void unlock_database(void);
 void unlock_and_exit(int code);
 
 /* In mairix.c */
 void report_error(const char *str, const char *filename);
+void sort_message_list(struct msgpath_array *arr);
+int check_message_list_for_duplicates(struct msgpath_array *msgs);
 
 #endif /* MAIRIX_H */
@@ -25,10 +25,14 @@
 #include <unistd.h>
 #include <assert.h>
 #include <dirent.h>
+#include <fcntl.h>
 #include <ctype.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/mman.h>
+#ifdef USE_PTHREADS
+#  include <pthread.h>
+#endif
 #include "mairix.h"
 #include "from.h"
 #include "fromcheck.h"
@@ -416,6 +420,7 @@ static void rescan_mbox(struct mbox *mb, char *va, size_t len)/*{{{*/
 
   /* Find the last message in the box that appears to be intact. */
   mb->n_old_msgs_valid = find_number_intact(mb, va, len);
+  mb->n_msgs = mb->n_old_msgs_valid;
   mb->new_msgs = build_new_message_list(mb, va, len, &mb->n_new_msgs);
 }
 /*}}}*/
@@ -435,6 +440,32 @@ static void deaden_mbox(struct mbox *mb)/*{{{*/
   }
 }
 /*}}}*/
+static void check_mbox(struct mbox *mb)/*{{{*/
+{
+  /* Find how many of the messages the database has for the mbox are still
+   * valid, and the list of new ones to scan. */
+  mb->new_msgs = NULL;
+  if (mb->path) {
+    if ((mb->current_mtime == mb->file_mtime) &&
+        (mb->current_size  == mb->file_size)) {
+      mb->n_old_msgs_valid = mb->n_msgs;
+    } else {
+      unsigned char *va;
+      int len;
+      create_ro_mapping(mb->path, &va, &len, MAP_DECOMPRESS_IF_APPLICABLE);
+      if (va) {
+        rescan_mbox(mb, (char *) va, len);
+        free_ro_mapping(va, len);
+      } else if (!len) {
+        mb->n_old_msgs_valid = mb->n_msgs = 0;
+      } else {
+        /* Treat as dead mbox */
+        deaden_mbox(mb);
+      }
+    }
+  }
+}
+/*}}}*/
 void free_mboxen(struct database *db)/*{{{*/
 {
   int i;
@@ -515,6 +546,44 @@ static char *find_last_slash(char *in)/*{{{*/
   return result;
 }
 /*}}}*/
+static int dirent_stat(DIR *d, struct dirent *de, const char *xpath, struct stat *sb)/*{{{*/
+{
+  /* The traversal only looks at st_mode, so where readdir already tells us
+   * the type of the entry there is no need to stat it.  Symlinks still have to
+   * be followed, and some filesystems don't fill in d_type at all: those get
+   * stat'd relative to the directory being read, which saves walking the full
+   * path again. */
+#ifdef DT_UNKNOWN
+  switch (de->d_type) {
+    case DT_REG:
+      memset(sb, 0, sizeof(struct stat));
+      sb->st_mode = S_IFREG;
+      return 0;
+    case DT_DIR:
+      memset(sb, 0, sizeof(struct stat));
+      sb->st_mode = S_IFDIR;
+      return 0;
+    default:
+      break;
+  }
+#endif
+#ifdef AT_FDCWD
+  return fstatat(dirfd(d), de->d_name, sb, 0);
+#else
+  return stat(xpath, sb);
+#endif
+}
+/*}}}*/
+static void append_to_list(char *path, struct string_list *list)/*{{{*/
+{
+  struct string_list *nn = new(struct string_list);
+  nn->data = new_string(path);
+  nn->next = list;
+  nn->prev = list->prev;
+  list->prev->next = nn;
+  list->prev = nn;
+}
+/*}}}*/
 static int append_shallow(char *path, int base_len, struct stat *sb, struct string_list *list, /*{{{*/
                   const struct traverse_methods *methods,
                   struct globber_array *omit_globs)
@@ -522,18 +591,14 @@ static int append_shallow(char *path, int base_len, struct stat *sb, struct stri
   int result = 0;
   if ((methods->filter)(path, sb)) {
     if (!is_globber_array_match(omit_globs, path + base_len)) {
-      struct string_list *nn = new(struct string_list);
-      nn->data = new_string(path);
-      nn->next = list;
-      nn->prev = list->prev;
-      list->prev->next = nn;
-      list->prev = nn;
+      append_to_list(path, list);
       result = 1;
     }
   }
   return result;
 }
 /*}}}*/
+#ifndef USE_PTHREADS
 static int append_deep(char *path, int base_len, struct stat *sb, struct string_list *list, /*{{{*/
                         const struct traverse_methods *methods,
                         struct globber_array *omit_globs)
@@ -580,7 +645,7 @@ static int append_deep(char *path, int base_len, struct stat *sb, struct string_
             case TRAV_IGNORE:
               goto next_path;
             case TRAV_PROCESS:
-              if (stat(xpath, &sb2) >= 0) {
+              if (dirent_stat(d, de, xpath, &sb2) >= 0) {
                 if (S_ISREG(sb2.st_mode)) {
                   appended_any |= append_shallow(xpath, base_len, &sb2, list, methods, omit_globs);
                 } else if (S_ISDIR(sb2.st_mode)) {
@@ -601,6 +666,260 @@ done_this_dir:
   return appended_any;
 }
 /*}}}*/
+#else
+/* Parallel version of append_deep.  On network filesystems reading a
+ * directory is mostly a matter of waiting for the server, so several
+ * subtrees are walked at once.  Each worker keeps a deque of directories it
+ * has yet to read: it takes from the end of its own (depth first, as
+ * append_deep would) and, when that runs dry, steals from the front of
+ * another's, which is where the largest unexplored subtrees tend to be.  The
+ * per-entry logic (omit globs, scrutinize, filter) is the same as
+ * append_deep's; only the order in which matches reach the list differs. */
+
+#define TRAVERSE_THREADS 8
+
+struct trav_item {/*{{{*/
+  char *path;
+  int base_len;
+  struct stat sb;
+};
+/*}}}*/
+struct trav_deque {/*{{{*/
+  pthread_mutex_t lock;
+  struct trav_item *items;
+  int head; /* next item to steal */
+  int tail; /* one beyond the next item to take */
+  int max;
+};
+/*}}}*/
+struct traversal {/*{{{*/
+  struct trav_deque deques[TRAVERSE_THREADS];
+
+  /* lock protects the counters, the list and the condition. */
+  pthread_mutex_t lock;
+  pthread_cond_t more_work;
+  int queued;  /* items sitting in deques */
+  int pending; /* items queued or being processed */
+
+  struct string_list *list;
+  const struct traverse_methods *methods;
+  struct globber_array *omit_globs;
+};
+/*}}}*/
+struct trav_worker {/*{{{*/
+  struct traversal *t;
+  int index;
+};
+/*}}}*/
+
+/* The traversal that queue_deep adds roots to. */
+static struct traversal *current_traversal = NULL;
+
+static void trav_push(struct traversal *t, int index, const char *path, int base_len, const struct stat *sb)/*{{{*/
+{
+  struct trav_deque *q = &t->deques[index];
+
+  pthread_mutex_lock(&q->lock);
+  if (q->head == q->tail) {
+    q->head = q->tail = 0;
+  }
+  if (q->tail == q->max) {
+    if (q->head > 0) {
+      memmove(q->items, q->items + q->head, (q->tail - q->head) * sizeof(struct trav_item));
+      q->tail -= q->head;
+      q->head = 0;
+    } else {
+      q->max += 64;
+      q->items = grow_array(struct trav_item, q->max, q->items);
+    }
+  }
+  q->items[q->tail].path = new_string(path);
+  q->items[q->tail].base_len = base_len;
+  q->items[q->tail].sb = *sb;
+  ++q->tail;
+  pthread_mutex_unlock(&q->lock);
+
+  pthread_mutex_lock(&t->lock);
+  ++t->queued;
+  ++t->pending;
+  pthread_cond_signal(&t->more_work);
+  pthread_mutex_unlock(&t->lock);
+}
+/*}}}*/
+static int trav_pop(struct traversal *t, int index, int steal, struct trav_item *item)/*{{{*/
+{
+  struct trav_deque *q = &t->deques[index];
+  int got = 0;
+
+  pthread_mutex_lock(&q->lock);
+  if (q->head < q->tail) {
+    *item = steal ? q->items[q->head++] : q->items[--q->tail];
+    got = 1;
+  }
+  pthread_mutex_unlock(&q->lock);
+
+  if (got) {
+    pthread_mutex_lock(&t->lock);
+    --t->queued;
+    pthread_mutex_unlock(&t->lock);
+  }
+  return got;
+}
+/*}}}*/
+static int trav_take(struct traversal *t, int index, struct trav_item *item)/*{{{*/
+{
+  int i;
+  if (trav_pop(t, index, 0, item)) return 1;
+  for (i=1; i<TRAVERSE_THREADS; i++) {
+    if (trav_pop(t, (index + i) % TRAVERSE_THREADS, 1, item)) return 1;
+  }
+  return 0;
+}
+/*}}}*/
+static void trav_append_shallow(struct traversal *t, char *path, int base_len, struct stat *sb, int *matched)/*{{{*/
+{
+  *matched = 0;
+  if ((t->methods->filter)(path, sb)) {
+    if (!is_globber_array_match(t->omit_globs, path + base_len)) {
+      pthread_mutex_lock(&t->lock);
+      append_to_list(path, t->list);
+      pthread_mutex_unlock(&t->lock);
+      *matched = 1;
+    }
+  }
+}
+/*}}}*/
+static void trav_process(struct traversal *t, int index, struct trav_item *item)/*{{{*/
+{
+  /* As append_deep, but subdirectories are queued rather than recursed
+   * into. */
+  struct stat sb2;
+  char *xpath;
+  DIR *d;
+  struct dirent *de;
+  int this_file_matched, matched;
+
+  trav_append_shallow(t, item->path, item->base_len, &item->sb, &this_file_matched);
+
+  if (S_ISDIR(item->sb.st_mode)) {
+    xpath = new_array(char, strlen(item->path) + 2 + NAME_MAX);
+    d = opendir(item->path);
+    if (d) {
+      while ((de = readdir(d))) {
+        enum traverse_check status;
+        if (!strcmp(de->d_name, ".")) continue;
+        if (!strcmp(de->d_name, "..")) continue;
+        strcpy(xpath, item->path);
+        strcat(xpath, "/");
+        strcat(xpath, de->d_name);
+        if (is_globber_array_match(t->omit_globs, xpath + item->base_len)) continue;
+        status = (t->methods->scrutinize)(this_file_matched, de->d_name);
+        if (status == TRAV_FINISH) break;
+        if (status == TRAV_IGNORE) continue;
+        if (dirent_stat(d, de, xpath, &sb2) >= 0) {
+          if (S_ISREG(sb2.st_mode)) {
+            trav_append_shallow(t, xpath, item->base_len, &sb2, &matched);
+          } else if (S_ISDIR(sb2.st_mode)) {
+            trav_push(t, index, xpath, item->base_len, &sb2);
+          }
+        }
+      }
+      closedir(d);
+    }
+    free(xpath);
+  }
+}
+/*}}}*/
+static void *trav_worker(void *arg)/*{{{*/
+{
+  struct trav_worker *w = (struct trav_worker *) arg;
+  struct traversal *t = w->t;
+  struct trav_item item;
+
+  while (1) {
+    if (trav_take(t, w->index, &item)) {
+      trav_process(t, w->index, &item);
+      free(item.path);
+      pthread_mutex_lock(&t->lock);
+      if (--t->pending == 0) {
+        pthread_cond_broadcast(&t->more_work);
+      }
+      pthread_mutex_unlock(&t->lock);
+    } else {
+      pthread_mutex_lock(&t->lock);
+      while ((t->queued == 0) && (t->pending > 0)) {
+        pthread_cond_wait(&t->more_work, &t->lock);
+      }
+      if (t->pending == 0) {
+        pthread_mutex_unlock(&t->lock);
+        break;
+      }
+      pthread_mutex_unlock(&t->lock);
+    }
+  }
+  return NULL;
+}
+/*}}}*/
+static int queue_deep(char *path, int base_len, struct stat *sb, struct string_list *list, /*{{{*/
+                      const struct traverse_methods *methods,
+                      struct globber_array *omit_globs)
+{
+  /* Stands in for append_deep when handling the top level paths: the walk
+   * itself is done by run_traversal. */
+  trav_push(current_traversal, 0, path, base_len, sb);
+  return 0;
+}
+/*}}}*/
+static void init_traversal(struct traversal *t, struct string_list *list,/*{{{*/
+                           const struct traverse_methods *methods,
+                           struct globber_array *omit_globs)
+{
+  int i;
+  for (i=0; i<TRAVERSE_THREADS; i++) {
+    pthread_mutex_init(&t->deques[i].lock, NULL);
+    t->deques[i].items = NULL;
+    t->deques[i].head = t->deques[i].tail = t->deques[i].max = 0;
+  }
+  pthread_mutex_init(&t->lock, NULL);
+  pthread_cond_init(&t->more_work, NULL);
+  t->queued = t->pending = 0;
+  t->list = list;
+  t->methods = methods;
+  t->omit_globs = omit_globs;
+}
+/*}}}*/
+static void run_traversal(struct traversal *t)/*{{{*/
+{
+  pthread_t threads[TRAVERSE_THREADS];
+  struct trav_worker workers[TRAVERSE_THREADS];
+  int started[TRAVERSE_THREADS];
+  int i;
+
+  if (t->pending > 0) {
+    for (i=0; i<TRAVERSE_THREADS; i++) {
+      workers[i].t = t;
+      workers[i].index = i;
+    }
+    /* Worker 0 is this thread.  If the others can't be started, it just has
+     * more to do. */
+    for (i=1; i<TRAVERSE_THREADS; i++) {
+      started[i] = (pthread_create(&threads[i], NULL, trav_worker, &workers[i]) == 0);
+    }
+    trav_worker(&workers[0]);
+    for (i=1; i<TRAVERSE_THREADS; i++) {
+      if (started[i]) pthread_join(threads[i], NULL);
+    }
+  }
+
+  for (i=0; i<TRAVERSE_THREADS; i++) {
+    pthread_mutex_destroy(&t->deques[i].lock);
+    if (t->deques[i].items) free(t->deques[i].items);
+  }
+  pthread_mutex_destroy(&t->lock);
+  pthread_cond_destroy(&t->more_work);
+}
+/*}}}*/
+#endif /* USE_PTHREADS */
 static void handle_wild(char *path, int base_len, char *last_comp, struct string_list *list,/*{{{*/
                         int (*append)(char *, int, struct stat *, struct string_list *,
                               const struct traverse_methods *, struct globber_array *),
@@ -644,7 +963,7 @@ static void handle_wild(char *path, int base_len, char *last_comp, struct string
            * a recursive expansion of a tree that's going to get pruned in full
            * later anyway. */
           had_matches = 1;
-          if (stat(xpath, &xsb) >= 0) {
+          if (dirent_stat(d, de, xpath, &xsb) >= 0) {
             (*append)(xpath, base_len, &xsb, list, methods, omit_globs);
           }
         }
@@ -714,9 +1033,13 @@ static int is_wild(const char *x)/*{{{*/
 }
 /*}}}*/
 /*{{{ handle_one_path() */
+typedef int (*append_fn)(char *, int, struct stat *, struct string_list *,
+                          const struct traverse_methods *, struct globber_array *);
+
 static void handle_one_path(const char *folder_base,
     const char *path,
     struct string_list *list,
+    append_fn deep,
     const struct traverse_methods *methods,
     struct globber_array *omit_globs)
 {
@@ -758,9 +1081,9 @@ static void handle_one_path(const char *folder_base,
   if ((len >= 4) && !strcmp(full_path + (len - 3), "...")) {
     full_path[len - 3] = '\0';
     if (is_wild(last_comp)) {
-      handle_wild(full_path, base_len, last_comp, list, append_deep, methods, omit_globs);
+      handle_wild(full_path, base_len, last_comp, list, deep, methods, omit_globs);
     } else {
-      handle_single(full_path, base_len, list, append_deep, methods, omit_globs);
+      handle_single(full_path, base_len, list, deep, methods, omit_globs);
     }
   } else {
     if (is_wild(last_comp)) {
@@ -781,14 +1104,28 @@ void glob_and_expand_paths(const char *folder_base,
 {
   struct string_list list;
   int i;
+#ifdef USE_PTHREADS
+  struct traversal t;
+#endif
 
   /* Clear it. */
   list.next = list.prev = &list;
 
+#ifdef USE_PTHREADS
+  init_traversal(&t, &list, methods, omit_globs);
+  current_traversal = &t;
   for (i=0; i<n_in; i++) {
     char *path = paths_in[i];
-    handle_one_path(folder_base, path, &list, methods, omit_globs);
+    handle_one_path(folder_base, path, &list, queue_deep, methods, omit_globs);
   }
+  current_traversal = NULL;
+  run_traversal(&t);
+#else
+  for (i=0; i<n_in; i++) {
+    char *path = paths_in[i];
+    handle_one_path(folder_base, path, &list, append_deep, methods, omit_globs);
+  }
+#endif
 
   string_list_to_array(&list, n_out, paths_out);
 }
@@ -865,33 +1202,40 @@ void build_mbox_lists(struct database *db, const char *folder_base, /*{{{*/
    * still valid and scan the remainder. */
 
   for (i=0; i<db->n_mboxen; i++) {
-    struct mbox *mb = &db->mboxen[i];
-    mb->new_msgs = NULL;
-    if (mb->path) {
-      if ((mb->current_mtime == mb->file_mtime) &&
-          (mb->current_size  == mb->file_size)) {
-        mb->n_old_msgs_valid = mb->n_msgs;
-      } else {
-        unsigned char *va;
-        int len;
-        create_ro_mapping(mb->path, &va, &len, MAP_DECOMPRESS_IF_APPLICABLE);
-        if (va) {
-          rescan_mbox(mb, (char *) va, len);
-          free_ro_mapping(va, len);
-        } else if (!len) {
-          mb->n_old_msgs_valid = mb->n_msgs = 0;
-        } else {
-          /* Treat as dead mbox */
-          deaden_mbox(mb);
-        }
-      }
-    }
+    check_mbox(&db->mboxen[i]);
   }
 
   /* At the end of this, we want the db->mboxen table to contain up to date info about
    * the mboxen, together with how much of the old info was still current. */
 }
 /*}}}*/
+void build_changed_mbox_lists(struct database *db, int n_paths, char **paths, const char *changed)/*{{{*/
+{
+  /* As build_mbox_lists(), but for the watcher : only the mboxen flagged in
+   * changed[] are looked at again, and the rest are taken to be as they were.
+   * New mboxen only turn up in a full pass. */
+  struct stat sb;
+  int i, j;
+
+  for (i=0; i<db->n_mboxen; i++) {
+    struct mbox *mb = &db->mboxen[i];
+    mb->new_msgs = NULL;
+    if (!mb->path) continue;
+    for (j=0; j<n_paths; j++) {
+      if (changed[j] && !strcmp(paths[j], mb->path)) break;
+    }
+    if (j == n_paths) {
+      mb->n_old_msgs_valid = mb->n_msgs;
+    } else if (lstat(mb->path, &sb) < 0) {
+      deaden_mbox(mb);
+    } else {
+      mb->current_mtime = sb.st_mtime;
+      mb->current_size = sb.st_size;
+      check_mbox(mb);
+    }
+  }
+}
+/*}}}*/
 
 static struct msg_src *setup_msg_src(char *filename, off_t start, size_t len)/*{{{*/
 {
@@ -1017,14 +1361,20 @@ int add_mbox_messages(struct database *db)/*{{{*/
           db->msgs[n].flagged = r8->hdrs.flags.flagged;
           tokenise_message(n, db, r8);
           free_rfc822(r8);
+          check_token_memory(db);
         } else {
           printf("Message in %s at [%d,%d) is misformatted\n", mb->path, (int)start, (int)(start + len));
         }
 
         ++db->n_msgs;
         any_new = 1;
+
+        /* Keep the mbox consistent with what's been indexed, in case a
+         * checkpoint is written now */
+        mb->n_msgs = j + 1;
+        mb->new_msgs = next;
+        maybe_checkpoint(db, db->n_msgs);
       }
-      mb->n_msgs = j;
       if (va) {
         free_ro_mapping(va, valen);
       }
@@ -52,14 +52,8 @@ struct nvp {/*{{{*/
 /*}}}*/
 static void append(struct nvp *nvp, struct nvp_entry *ne)/*{{{*/
 {
-  if (!ne->rhs) {
-    ne->rhs = Malloc(1);
-    ne->rhs[0] = 0;
-  }
-  if (!ne->lhs) {
-    ne->lhs = Malloc(1);
-    ne->lhs[0] = 0;
-  }
+  if (!ne->rhs) ne->rhs = arena_string("", 0);
+  if (!ne->lhs) ne->lhs = arena_string("", 0);
   ne->next = NULL;
   ne->prev = nvp->last;
   if (nvp->last) nvp->last->next = ne;
@@ -70,7 +64,7 @@ static void append(struct nvp *nvp, struct nvp_entry *ne)/*{{{*/
 static void append_name(struct nvp *nvp, char **name)/*{{{*/
 {
   struct nvp_entry *ne;
-  ne = new(struct nvp_entry);
+  ne = arena_alloc(sizeof(struct nvp_entry));
   ne->type = NVP_NAME;
   ne->lhs = *name;
   ne->rhs = NULL;
@@ -81,7 +75,7 @@ static void append_name(struct nvp *nvp, char **name)/*{{{*/
 static void append_majorminor(struct nvp *nvp, char **major, char **minor)/*{{{*/
 {
   struct nvp_entry *ne;
-  ne = new(struct nvp_entry);
+  ne = arena_alloc(sizeof(struct nvp_entry));
   ne->type = NVP_MAJORMINOR;
   ne->lhs = *major;
   ne->rhs = *minor;
@@ -93,7 +87,7 @@ static void append_majorminor(struct nvp *nvp, char **major, char **minor)/*{{{*
 static void append_namevalue(struct nvp *nvp, char **name, char **value)/*{{{*/
 {
   struct nvp_entry *ne;
-  ne = new(struct nvp_entry);
+  ne = arena_alloc(sizeof(struct nvp_entry));
   ne->type = NVP_NAMEVALUE;
   ne->lhs = *name;
   ne->rhs = *value;
@@ -108,10 +102,9 @@ static void combine_namevalue(struct nvp *nvp, char **name, char **value)/*{{{*/
     if (n->type == NVP_NAMEVALUE) {
       if (!strcmp(n->lhs, *name)) {
         char *new_rhs;
-        new_rhs = new_array(char, strlen(n->rhs) + strlen(*value) + 1);
+        new_rhs = arena_alloc(strlen(n->rhs) + strlen(*value) + 1);
         strcpy(new_rhs, n->rhs);
         strcat(new_rhs, *value);
-        free(n->rhs);
         n->rhs = new_rhs;
         return;
       }
@@ -132,20 +125,10 @@ static int hex_to_val(int ch)/*{{{*/
     return (-1);
 }
 /*}}}*/
-static void release_nvp(struct nvp *nvp)/*{{{*/
-{
-  struct nvp_entry *e, *ne;
-  for (e=nvp->first; e; e=ne) {
-    ne = e->next;
-    free(e->lhs);
-    free(e->rhs);
-    free(e);
-  }
-  free(nvp);
-}
-/*}}}*/
 struct nvp *make_nvp(struct msg_src *src, char *s, const char *pfx)/*{{{*/
 {
+  /* The result is allocated from the parse arena, so it lasts until the next
+   * arena_reset(). */
   int current_state;
   unsigned int tok;
   char *q, *tempsrc, *tempdst;
@@ -164,7 +147,7 @@ struct nvp *make_nvp(struct msg_src *src, char *s, const char *pfx)/*{{{*/
     return NULL;
   s += pfxlen;
 
-  result = new(struct nvp);
+  result = arena_alloc(sizeof(struct nvp));
   result->first = result->last = NULL;
 
   current_state = nvp_in;
@@ -193,33 +176,27 @@ struct nvp *make_nvp(struct msg_src *src, char *s, const char *pfx)/*{{{*/
       fprintf(stderr, "Header '%s%s' in %s could not be parsed\n",
           pfx, s, format_msg_src(src));
 #endif
-      release_nvp(result);
       result = NULL;
       goto out;
     }
 
     if (nvp_copier[current_state] != last_copier) {
       if (last_copier != COPY_NOWHERE) {
-        char *newstring = Malloc(q - copy_start + 1);
-	memcpy(newstring, copy_start, q - copy_start);
-	newstring[q - copy_start] = 0;
+        char *newstring = arena_string(copy_start, q - copy_start);
         switch (last_copier) {
           case COPY_TO_NAME:
-            free(name);
             name = newstring;
 #ifdef VERBOSE_TEST
             fprintf(stderr, "  COPY_TO_NAME \"%s\"\n", name);
 #endif
             break;
           case COPY_TO_MINOR:
-            free(minor);
             minor = newstring;
 #ifdef VERBOSE_TEST
             fprintf(stderr, "  COPY_TO_MINOR \"%s\"\n", minor);
 #endif
             break;
           case COPY_TO_VALUE:
-            free(value);
             value = newstring;
 #ifdef VERBOSE_TEST
             fprintf(stderr, "  COPY_TO_VALUE \"%s\"\n", value);
@@ -284,7 +261,6 @@ struct nvp *make_nvp(struct msg_src *src, char *s, const char *pfx)/*{{{*/
 			fprintf(stderr, "Header '%s%s' in %s could not be parsed\n",
 				pfx, s, format_msg_src(src));
 #endif
-			release_nvp(result);
 			result = NULL;
 			goto out;
 		    }
@@ -316,25 +292,9 @@ struct nvp *make_nvp(struct msg_src *src, char *s, const char *pfx)/*{{{*/
   } while (tok != nvp_EOS);
 
 out:
-  /* Not all productions consume these values */
-  free(name);
-  free(value);
-  free(minor);
   return result;
 }
 /*}}}*/
-void free_nvp(struct nvp *nvp)/*{{{*/
-{
-  struct nvp_entry *ne, *nne;
-  for (ne = nvp->first; ne; ne=nne) {
-    nne = ne->next;
-    free(ne->lhs);
-    free(ne->rhs);
-    free(ne);
-  }
-  free(nvp);
-}
-/*}}}*/
 const char *nvp_lookup(struct nvp *nvp, const char *name)/*{{{*/
 {
   struct nvp_entry *ne;
@@ -437,8 +397,8 @@ static void do_test(char *s)
   n = make_nvp(NULL, s, "");
   if (n) {
     nvp_dump(n, stderr);
-    free_nvp(n);
   }
+  arena_reset();
 }
 
 
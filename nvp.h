@@ -26,7 +26,6 @@
 struct nvp;
 struct msg_src;
 extern struct nvp *make_nvp(struct msg_src *, char *, const char *);
-extern void free_nvp(struct nvp *);
 extern void nvp_dump(struct nvp *nvp, FILE *out);
 extern const char *nvp_major(struct nvp *n);
 extern const char *nvp_minor(struct nvp *n);
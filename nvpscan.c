@@ -0,0 +1,243 @@
+#include "nvptypes.h"
+short nvp_char2tok[256] = {
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,   1,  -1,  -1,  -1,   2,  -1,  -1, 
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, 
+    1,   3,   4,   3,   3,   3,   3,   5,   3,   3,   6,   7,   3,   8,   7,   9, 
+   10,  11,  11,  11,  11,  11,  11,  11,  11,  11,   3,  12,   3,  13,   3,   3, 
+    3,  14,  14,  14,  14,  14,  14,  14,  14,  14,  14,  14,  14,  14,  14,  14, 
+   14,  14,  14,  14,  14,  14,  14,  14,  14,  14,  14,   3,  15,   3,   3,  16, 
+    3,  14,  14,  14,  14,  14,  14,  14,  14,  14,  14,  14,  14,  14,  14,  14, 
+   14,  14,  14,  14,  14,  14,  14,  14,  14,  14,  14,   3,   3,   3,   3,  -1, 
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, 
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, 
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, 
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, 
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, 
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, 
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1, 
+   -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1,  -1
+};
+enum nvp_copier nvp_copier[] = {
+  COPY_NOWHERE, /* State 0 */
+  COPY_TO_NAME, /* State 1 */
+  COPY_NOWHERE, /* State 2 */
+  COPY_TO_NAME, /* State 3 */
+  COPY_NOWHERE, /* State 4 */
+  COPY_NOWHERE, /* State 5 */
+  COPY_NOWHERE, /* State 6 */
+  COPY_NOWHERE, /* State 7 */
+  COPY_NOWHERE, /* State 8 */
+  COPY_TO_NAME, /* State 9 */
+  COPY_NOWHERE, /* State 10 */
+  COPY_NOWHERE, /* State 11 */
+  COPY_NOWHERE, /* State 12 */
+  COPY_NOWHERE, /* State 13 */
+  COPY_NOWHERE, /* State 14 */
+  COPY_TO_MINOR, /* State 15 */
+  COPY_NOWHERE, /* State 16 */
+  COPY_NOWHERE, /* State 17 */
+  COPY_TO_VALUE, /* State 18 */
+  COPY_NOWHERE, /* State 19 */
+  COPY_NOWHERE, /* State 20 */
+  COPY_NOWHERE, /* State 21 */
+  COPY_NOWHERE, /* State 22 */
+  COPY_NOWHERE, /* State 23 */
+  COPY_NOWHERE, /* State 24 */
+  COPY_TO_MINOR, /* State 25 */
+  COPY_NOWHERE, /* State 26 */
+  COPY_NOWHERE, /* State 27 */
+  COPY_TO_VALUE, /* State 28 */
+  COPY_NOWHERE, /* State 29 */
+  COPY_TO_VALUE, /* State 30 */
+  COPY_NOWHERE, /* State 31 */
+  COPY_NOWHERE, /* State 32 */
+  COPY_NOWHERE, /* State 33 */
+  COPY_NOWHERE, /* State 34 */
+  COPY_TO_VALUE, /* State 35 */
+  COPY_NOWHERE, /* State 36 */
+  COPY_TO_VALUE, /* State 37 */
+  COPY_TO_VALUE, /* State 38 */
+  COPY_NOWHERE, /* State 39 */
+  COPY_NOWHERE  /* State 40 */
+};
+
+enum nvp_action nvp_action[] = {
+  GOT_NOTHING, /* State 0 */
+  GOT_NAME, /* State 1 */
+  GOT_TERMINATOR, /* State 2 */
+  GOT_NAME_TRAILING_SPACE, /* State 3 */
+  GOT_NOTHING, /* State 4 */
+  GOT_NOTHING, /* State 5 */
+  GOT_NOTHING, /* State 6 */
+  GOT_TERMINATOR, /* State 7 */
+  GOT_NOTHING, /* State 8 */
+  GOT_NAME, /* State 9 */
+  GOT_NOTHING, /* State 10 */
+  GOT_NOTHING, /* State 11 */
+  GOT_NOTHING, /* State 12 */
+  GOT_NOTHING, /* State 13 */
+  GOT_NOTHING, /* State 14 */
+  GOT_MAJORMINOR, /* State 15 */
+  GOT_NOTHING, /* State 16 */
+  GOT_NAMEVALUE, /* State 17 */
+  GOT_NAMEVALUE, /* State 18 */
+  GOT_NOTHING, /* State 19 */
+  GOT_NOTHING, /* State 20 */
+  GOT_NOTHING, /* State 21 */
+  GOT_NOTHING, /* State 22 */
+  GOT_NOTHING, /* State 23 */
+  GOT_NOTHING, /* State 24 */
+  GOT_NOTHING, /* State 25 */
+  GOT_NOTHING, /* State 26 */
+  GOT_NAMEVALUE, /* State 27 */
+  GOT_NOTHING, /* State 28 */
+  GOT_NOTHING, /* State 29 */
+  GOT_NAMEVALUE_CONT, /* State 30 */
+  GOT_NOTHING, /* State 31 */
+  GOT_NOTHING, /* State 32 */
+  GOT_NOTHING, /* State 33 */
+  GOT_NAMEVALUE_CONT, /* State 34 */
+  GOT_NOTHING, /* State 35 */
+  GOT_NOTHING, /* State 36 */
+  GOT_NAMEVALUE_CCONT, /* State 37 */
+  GOT_NAMEVALUE_CSET, /* State 38 */
+  GOT_NAMEVALUE_CCONT, /* State 39 */
+  GOT_NAMEVALUE_CSET  /* State 40 */
+};
+
+short nvp_attr[] = {
+  0, /* State 0 */
+  0, /* State 1 */
+  0, /* State 2 */
+  0, /* State 3 */
+  0, /* State 4 */
+  0, /* State 5 */
+  0, /* State 6 */
+  0, /* State 7 */
+  0, /* State 8 */
+  0, /* State 9 */
+  0, /* State 10 */
+  0, /* State 11 */
+  0, /* State 12 */
+  0, /* State 13 */
+  0, /* State 14 */
+  0, /* State 15 */
+  0, /* State 16 */
+  0, /* State 17 */
+  0, /* State 18 */
+  0, /* State 19 */
+  0, /* State 20 */
+  0, /* State 21 */
+  0, /* State 22 */
+  0, /* State 23 */
+  0, /* State 24 */
+  0, /* State 25 */
+  0, /* State 26 */
+  0, /* State 27 */
+  0, /* State 28 */
+  0, /* State 29 */
+  0, /* State 30 */
+  0, /* State 31 */
+  0, /* State 32 */
+  0, /* State 33 */
+  0, /* State 34 */
+  0, /* State 35 */
+  0, /* State 36 */
+  0, /* State 37 */
+  0, /* State 38 */
+  0, /* State 39 */
+  0  /* State 40 */
+};
+
+short nvp_trans[] = {
+    -1,    0,    0,   -1,   -1,   -1,   -1,   -1,
+     1,   -1,    1,    1,   -1,   -1,    1,   -1,
+     1,    2,    3,    4,   -1,   -1,   -1,    5,
+    -1,    1,    6,    1,    1,    7,    8,    1,
+    -1,    1,   -1,   -1,   -1,   -1,   -1,   -1,
+    -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,
+    -1,   -1,   -1,    2,    3,    4,   -1,   -1,
+    -1,    5,   -1,    9,   -1,    9,    9,    7,
+     8,    9,   -1,    9,    2,    4,    4,   -1,
+    -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,
+     7,    8,   -1,   -1,   -1,   -1,   10,   10,
+    -1,   -1,   -1,   -1,   -1,   -1,   -1,   11,
+    12,   -1,   13,   14,   -1,   -1,   -1,   -1,
+    -1,   -1,   -1,   -1,   -1,   15,   15,   -1,
+    15,   15,   -1,   -1,   15,   15,   15,    2,
+    16,   16,   -1,   -1,   -1,   -1,   -1,    1,
+    -1,    1,    1,   -1,   -1,    1,   -1,    1,
+    17,    8,    8,   18,   19,   18,   18,   18,
+    18,   18,   18,   18,   -1,   18,   18,   -1,
+    18,    2,    3,    4,   -1,   -1,   -1,    5,
+    -1,    9,   -1,    9,    9,    7,    8,    9,
+    -1,    9,   -1,   10,   10,   -1,   -1,   -1,
+    -1,   -1,   -1,   -1,   -1,   -1,   -1,   13,
+    -1,   -1,   -1,   -1,   20,   20,   -1,   -1,
+    -1,   10,   -1,   -1,   -1,   21,   21,   -1,
+    22,   -1,   -1,   -1,   -1,   20,   20,   -1,
+    -1,   -1,   23,   -1,   -1,   -1,   21,   21,
+    -1,   22,   -1,   -1,   -1,   -1,   13,   13,
+    -1,   -1,   24,   -1,   25,   25,   -1,   25,
+    25,   -1,   -1,   25,   25,   25,   -1,   -1,
+    -1,   -1,   -1,   -1,   23,   -1,   -1,   -1,
+    -1,   -1,   -1,   -1,   -1,   -1,   -1,    2,
+    26,   26,   -1,   -1,   -1,   -1,   15,   15,
+    -1,   15,   15,    7,   -1,   15,   15,   15,
+     2,   16,   16,   -1,   -1,   -1,   -1,   -1,
+     1,   -1,    1,    1,   -1,   -1,    1,   -1,
+     1,    2,   26,   26,   -1,   -1,   -1,   -1,
+    -1,   -1,   -1,   -1,   -1,    7,   -1,   -1,
+    -1,   -1,    2,   27,   27,   18,   -1,   18,
+    18,   18,   18,   18,   18,   18,    7,   18,
+    18,   -1,   18,   -1,   28,   -1,   28,   -1,
+    28,   28,   28,   28,   28,   28,   28,   28,
+    28,   28,   29,   28,   -1,   20,   20,   -1,
+    -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,
+    -1,   22,   -1,   -1,   -1,   -1,   20,   20,
+    -1,   -1,   -1,   -1,   -1,   -1,   -1,   21,
+    21,   -1,   22,   -1,   -1,   -1,   -1,   22,
+    22,   30,   31,   30,   30,   30,   30,   30,
+    30,   30,   -1,   30,   30,   -1,   30,   -1,
+    23,   23,   -1,   -1,   -1,   -1,   -1,   -1,
+    -1,   -1,   -1,   -1,   32,   -1,   -1,   -1,
+    -1,   -1,   -1,   -1,   -1,   33,   -1,   -1,
+    -1,   -1,   -1,   -1,   -1,   -1,   -1,   -1,
+    -1,   -1,   -1,   -1,   -1,   -1,   24,   -1,
+    25,   25,   -1,   25,   25,   -1,   -1,   25,
+    25,   25,    2,   26,   26,   -1,   -1,   -1,
+    -1,   -1,   -1,   -1,   -1,   -1,    7,   -1,
+    -1,   -1,   -1,    2,   27,   27,   -1,   -1,
+    -1,   -1,   -1,   -1,   -1,   -1,   -1,    7,
+    -1,   -1,   -1,   -1,   -1,   28,   -1,   28,
+    27,   28,   28,   28,   28,   28,   28,   28,
+    28,   28,   28,   29,   28,   -1,   -1,   -1,
+    -1,   28,   -1,   -1,   -1,   -1,   -1,   -1,
+    -1,   -1,   -1,   -1,   28,   -1,    2,   34,
+    34,   30,   -1,   30,   30,   30,   30,   30,
+    30,   30,    7,   30,   30,   -1,   30,   -1,
+    35,   -1,   35,   -1,   35,   35,   35,   35,
+    35,   35,   35,   35,   35,   35,   36,   35,
+    -1,   32,   32,   37,   -1,   37,   37,   37,
+    37,   37,   37,   37,   -1,   37,   37,   -1,
+    37,   -1,   -1,   -1,   38,   -1,   38,   38,
+    38,   38,   38,   38,   38,   -1,   38,   38,
+    -1,   38,    2,   34,   34,   -1,   -1,   -1,
+    -1,   -1,   -1,   -1,   -1,   -1,    7,   -1,
+    -1,   -1,   -1,   -1,   35,   -1,   35,   34,
+    35,   35,   35,   35,   35,   35,   35,   35,
+    35,   35,   36,   35,   -1,   -1,   -1,   -1,
+    35,   -1,   -1,   -1,   -1,   -1,   -1,   -1,
+    -1,   -1,   -1,   35,   -1,    2,   39,   39,
+    37,   -1,   37,   37,   37,   37,   37,   37,
+    37,    7,   37,   37,   -1,   37,    2,   40,
+    40,   38,   -1,   38,   38,   38,   38,   38,
+    38,   38,    7,   38,   38,   -1,   38,    2,
+    39,   39,   -1,   -1,   -1,   -1,   -1,   -1,
+    -1,   -1,   -1,    7,   -1,   -1,   -1,   -1,
+     2,   40,   40,   -1,   -1,   -1,   -1,   -1,
+    -1,   -1,   -1,   -1,    7,   -1,   -1,   -1,
+    -1
+};
+
+int nvp_in = 0;
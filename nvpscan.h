@@ -0,0 +1,14 @@
+#ifndef nvp_HEADER_H
+#define nvp_HEADER_H
+#define nvp_EOS 0
+extern short nvp_char2tok[256];
+extern enum nvp_copier nvp_copier[];
+extern enum nvp_action nvp_action[];
+extern short nvp_attr[];
+extern short nvp_trans[];
+static inline int nvp_next_state(int current_state, int next_token) {
+  if (next_token < 0 || next_token >= 17) return -1;
+  return nvp_trans[17*current_state + next_token];
+}
+extern int nvp_in;
+#endif
@@ -93,16 +93,13 @@ void int_list_reader_copy(struct int_list_reader *ilr, struct matches *out) {
   while (int_list_reader_read(ilr, &index));
   size = ilr->pos - base;
 
+  out->msginfo = NULL;
+  out->n = 0;
+  out->max = 0;
+  enlarge_encoding(out, size);
+  if (size) memcpy(out->msginfo, base, size);
   out->n = size;
   out->highest = index;
-
-  /* Allow a bit of headroom for adding more entries later */
-  size += size / 2;
-  if (size < 16) size = 16;
-
-  out->max = size;
-  out->msginfo = new_array(unsigned char, size);
-  memcpy(out->msginfo, base, out->n);
 }
 
 const char *get_db_token(const struct read_db *db, unsigned int token_offset) {
@@ -234,6 +231,7 @@ struct read_db *open_db(char *filename)/*{{{*/
 }
 #define GET_MSG_TABLE(dest, start_index) GET_TABLE((dest), (start_index), result->n_msgs)
 #define GET_MBOX_TABLE(dest, start_index) GET_TABLE((dest), (start_index), result->n_mboxen)
+#define GET_DIR_TABLE(dest, start_index) GET_TABLE((dest), (start_index), result->n_dirs)
 
   /* Now build tables of where things are in the file */
   result->n_msgs = uidata[UI_N_MSGS];
@@ -259,8 +257,18 @@ corrupt:
   GET_MBOX_TABLE(result->mbox_size_table, UI_MBOX_SIZE);
   GET_MBOX_TABLE(result->mbox_checksum_table, UI_MBOX_CKSUM);
 
+  result->n_dirs = uidata[UI_DIR_N];
+  GET_DIR_TABLE(result->dir_paths_table, UI_DIR_PATHS);
+  GET_DIR_TABLE(result->dir_mtime_table, UI_DIR_MTIME);
+  GET_DIR_TABLE(result->dir_entries_table, UI_DIR_ENTRIES);
+
   result->hash_key = uidata[UI_HASH_KEY];
 
+  result->dict.n = uidata[UI_DICT_N];
+  GET_TABLE(result->dict.tok_offsets, UI_DICT_TOK, result->dict.n);
+  GET_TABLE(result->dict.first_ref, UI_DICT_FIRST, result->dict.n + 1);
+  GET_TABLE(result->dict.refs, UI_DICT_REFS, result->dict.first_ref[result->dict.n]);
+
   if (!(
     read_toktable_db(data, len, &result->to, UI_TO_BASE, uidata) &&
     read_toktable_db(data, len, &result->cc, UI_CC_BASE, uidata) &&
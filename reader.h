@@ -23,11 +23,13 @@
 #ifndef READER_H
 #define READER_H
 
-/* MX, then a high byte, then the version no. */
+/* MX, then a high byte, then the version no.  Version 5 adds the maildir
+ * directory stamps and the token dictionary, and its tokens are converted to
+ * UTF-8 and case folded, so searches would miss words in older databases. */
 #define HEADER_MAGIC0 'M'
 #define HEADER_MAGIC1 'X'
 #define HEADER_MAGIC2 0xA5
-#define HEADER_MAGIC3 0x04
+#define HEADER_MAGIC3 0x05
 
 /*{{{ Constants for file data positions */
 #define UI_ENDIAN          1
@@ -77,8 +79,28 @@
 #define UI_ATTACHMENT_NAME_BASE 31
 #define UI_MSGID_BASE     34
 
+/* Header positions for maildir directory information */
+/* Number of directories */
+#define UI_DIR_N          38
+#define UI_DIR_PATHS      39
+/* mtime of directories */
+#define UI_DIR_MTIME      40
+/* Number of messages in each directory */
+#define UI_DIR_ENTRIES    41
+
+/* Header positions for the dictionary, which holds each distinct token of the
+ * to, cc, from, subject, body and attachment name tables once. */
+/* Number of dictionary entries */
+#define UI_DICT_N         42
+/* Offsets of the token texts */
+#define UI_DICT_TOK       43
+/* For each entry, the index of its first reference (n+1 values) */
+#define UI_DICT_FIRST     44
+/* References, each (index in field table << DICT_FIELD_BITS) | field */
+#define UI_DICT_REFS      45
+
 /* Larger than the last table offset. */
-#define UI_HEADER_LEN     40
+#define UI_HEADER_LEN     48
 #define UC_HEADER_LEN     ((UI_HEADER_LEN) << 2)
 
 #define UI_N_OFFSET        0
@@ -110,6 +132,19 @@
 
 /*}}}*/
 
+/*{{{ Fields referred to by dictionary entries */
+#define DICT_TO              0
+#define DICT_CC              1
+#define DICT_FROM            2
+#define DICT_SUBJECT         3
+#define DICT_BODY            4
+#define DICT_ATTACHMENT_NAME 5
+#define N_DICT_FIELDS        6
+
+#define DICT_FIELD_BITS      3
+#define DICT_FIELD_MASK      ((1 << DICT_FIELD_BITS) - 1)
+/*}}}*/
+
 /*{{{ Literals used for encoding messages types in database file */
 #define DB_MSG_DEAD 0
 /* maildir/MH : one file per message */
@@ -137,6 +172,13 @@ struct toktable2_db {/*{{{*/
   unsigned int *enc1_offsets; /* offset to table of encoding offsets */
 };
 /*}}}*/
+struct dictionary_db {/*{{{*/
+  unsigned int n; /* number of distinct tokens */
+  unsigned int *tok_offsets; /* offsets of the token texts */
+  unsigned int *first_ref; /* entry i's references are first_ref[i] .. first_ref[i+1]-1 */
+  unsigned int *refs; /* field and index of the token in that field's table */
+};
+/*}}}*/
 struct read_db {/*{{{*/
   /* Raw file parameters, needed later for munmap */
   char *data;
@@ -158,6 +200,11 @@ struct read_db {/*{{{*/
   unsigned int *mbox_size_table;
   unsigned int *mbox_checksum_table;
 
+  int n_dirs;
+  unsigned int *dir_paths_table;
+  unsigned int *dir_mtime_table;
+  unsigned int *dir_entries_table;
+
   unsigned int hash_key;
 
   struct toktable_db to;
@@ -167,6 +214,7 @@ struct read_db {/*{{{*/
   struct toktable_db body;
   struct toktable_db attachment_name;
   struct toktable2_db msg_ids;
+  struct dictionary_db dict;
 
 };
 /*}}}*/
@@ -41,6 +41,10 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/mman.h>
+#include <errno.h>
+#ifdef USE_PTHREADS
+#  include <pthread.h>
+#endif
 #ifdef USE_GZIP_MBOX
 #  include <zlib.h>
 #endif
@@ -85,13 +89,23 @@ struct content_type_header {/*{{{*/
   const char *major; /* e.g. text */
   const char *minor; /* e.g. plain */
   const char *boundary; /* for multipart */
-  /* charset? */
+  const char *charset; /* for text, NULL if not given */
 };
 /*}}}*/
-struct line {/*{{{*/
-  struct line *next;
-  struct line *prev;
-  char *text;
+struct header_line {/*{{{*/
+  /* A header field where it sits in the message : from the start of its name
+   * to the newline that ends its last continuation line. */
+  char *start;
+  char *end;
+};
+/*}}}*/
+#define LOCAL_HEADER_LINES 32
+struct header {/*{{{*/
+  struct header_line *lines;
+  int n;
+  int max;
+  /* Enough for most messages without going to the heap. */
+  struct header_line local[LOCAL_HEADER_LINES];
 };
 /*}}}*/
 
@@ -110,113 +124,88 @@ static void init_headers(struct headers *hdrs)/*{{{*/
   hdrs->flags.flagged = 0;
 };
 /*}}}*/
-static void splice_header_lines(struct line *header)/*{{{*/
+static int match_string(const char *ref, const char *candidate)/*{{{*/
 {
-  /* Deal with newline then tab in header */
-  struct line *x, *next;
-  for (x=header->next; x!=header; x=next) {
-#if 0
-    printf("next header, x->text=%08lx\n", x->text);
-    printf("header=<%s>\n", x->text);
-#endif
-    next = x->next;
-    if (isspace(x->text[0] & 0xff)) {
-      /* Glue to previous line */
-      char *p, *newbuf, *oldbuf;
-      struct line *y;
-      for (p=x->text; *p; p++) {
-        if (!isspace(*(unsigned char *)p)) break;
-      }
-      p--; /* point to final space */
-      y = x->prev;
-#if 0
-      printf("y=%08lx p=%08lx\n", y->text, p);
-#endif
-      newbuf = new_array(char, strlen(y->text) + strlen(p) + 1);
-      strcpy(newbuf, y->text);
-      strcat(newbuf, p);
-      oldbuf = y->text;
-      y->text = newbuf;
-      free(oldbuf);
-      y->next = x->next;
-      x->next->prev = y;
-      free(x->text);
-      free(x);
-    }
-  }
-  return;
+  int len = strlen(ref);
+  return !strncasecmp(ref, candidate, len);
 }
 /*}}}*/
-static int audit_header(struct line *header)/*{{{*/
+enum header_kind {/*{{{*/
+  HDR_OTHER,
+  HDR_TO,
+  HDR_CC,
+  HDR_FROM,
+  HDR_SUBJECT,
+  HDR_DATE,
+  HDR_MESSAGE_ID,
+  HDR_IN_REPLY_TO,
+  HDR_REFERENCES,
+  HDR_STATUS,
+  HDR_X_STATUS,
+  HDR_CONTENT_TYPE,
+  HDR_CONTENT_TRANSFER_ENCODING,
+  HDR_CONTENT_DISPOSITION
+};
+/*}}}*/
+struct header_name {/*{{{*/
+  const char *name;
+  int len;
+  enum header_kind kind;
+};
+/*}}}*/
+static struct header_name header_names[] = {/*{{{*/
+  {"to", 2, HDR_TO},
+  {"cc", 2, HDR_CC},
+  {"from", 4, HDR_FROM},
+  {"subject", 7, HDR_SUBJECT},
+  {"date", 4, HDR_DATE},
+  {"message-id", 10, HDR_MESSAGE_ID},
+  {"in-reply-to", 11, HDR_IN_REPLY_TO},
+  {"references", 10, HDR_REFERENCES},
+  {"status", 6, HDR_STATUS},
+  {"x-status", 8, HDR_X_STATUS},
+  {"content-type", 12, HDR_CONTENT_TYPE},
+  {"content-transfer-encoding", 25, HDR_CONTENT_TRANSFER_ENCODING},
+  {"content-disposition", 19, HDR_CONTENT_DISPOSITION},
+  {NULL, 0, HDR_OTHER}
+};
+/*}}}*/
+/* The first and last characters of the names above are enough to tell them
+ * apart. */
+#define HEADER_HASH_SIZE 32
+#define HEADER_HASH(name, len) \
+  ((tolower(*(unsigned char *)(name)) + \
+    2 * tolower(*(unsigned char *)((name) + (len) - 1))) & (HEADER_HASH_SIZE - 1))
+static struct header_name *header_hash[HEADER_HASH_SIZE];
+static int header_hash_init = 0;
+
+static enum header_kind classify_header(const char *start, const char *end)/*{{{*/
 {
-  /* Check for obvious broken-ness
-   * 1st line has no leading spaces, single word then colon
-   * following lines have leading spaces or single word followed by colon
-   * */
-  struct line *x;
-  int first=1;
-  int count=1;
-  for (x=header->next; x!=header; x=x->next) {
-    int has_leading_space=0;
-    int is_blank;
-    int has_word_colon=0;
-
-    if (1 || first) {
-      /* Ignore any UUCP or mbox style From line at the start */
-      if (!strncmp("From ", x->text, 5)) {
-        continue;
-      }
-      /* Ignore escaped From line at the start */
-      if (!strncmp(">From ", x->text, 6)) {
-        continue;
-      }
-    }
+  /* Work out which of the headers we're interested in this one is, with a
+   * single pass over its name. */
+  const char *p;
+  struct header_name *hn;
+  int len;
 
-    is_blank = !(x->text[0]);
-    if (!is_blank) {
-      char *p;
-      int saw_char = 0;
-      has_leading_space = isspace(x->text[0] & 0xff);
-      has_word_colon = 0; /* default */
-      p = x->text;
-      while(*p) {
-        if(*p == ':') {
-          has_word_colon = saw_char;
-          break;
-        } else if (isspace(*(unsigned char *) p)) {
-          has_word_colon = 0;
-          break;
-        } else {
-          saw_char = 1;
-        }
-        p++;
-      }
+  if (!header_hash_init) {
+    for (hn = header_names; hn->name; hn++) {
+      assert(!header_hash[HEADER_HASH(hn->name, hn->len)]);
+      header_hash[HEADER_HASH(hn->name, hn->len)] = hn;
     }
+    header_hash_init = 1;
+  }
 
-    if (( first && (is_blank || has_leading_space || !has_word_colon)) ||
-        (!first && (is_blank || !(has_leading_space || has_word_colon)))) {
-#if 0
-      fprintf(stderr, "Header line %d <%s> fails because:", count, x->text);
-      if (first && is_blank) { fprintf(stderr, " [first && is_blank]"); }
-      if (first && has_leading_space) { fprintf(stderr, " [first && has_leading_space]"); }
-      if (first && !has_word_colon) { fprintf(stderr, " [first && !has_word_colon]"); }
-      if (!first && is_blank) { fprintf(stderr, " [!first && is_blank]"); }
-      if (!first && !(has_leading_space||has_word_colon)) { fprintf(stderr, " [!first && !has_leading_space||has_word_colon]"); }
-      fprintf(stderr, "\n");
-#endif
-      /* Header fails the audit */
-      return 0;
-    }
-    first = 0;
-    count++;
+  for (p = start; (p < end) && (*p != ':'); p++) {
+    if (isspace(*(unsigned char *) p)) return HDR_OTHER;
   }
-  /* If we get here the header must have been OK */
-  return 1;
-}/*}}}*/
-static int match_string(const char *ref, const char *candidate)/*{{{*/
-{
-  int len = strlen(ref);
-  return !strncasecmp(ref, candidate, len);
+  len = p - start;
+  if ((p == end) || (len == 0)) return HDR_OTHER;
+
+  hn = header_hash[HEADER_HASH(start, len)];
+  if (hn && (hn->len == len) && !strncasecmp(hn->name, start, len)) {
+    return hn->kind;
+  }
+  return HDR_OTHER;
 }
 /*}}}*/
 
@@ -293,19 +282,98 @@ static int hex_to_val(char x) {/*{{{*/
   }
 }
 /*}}}*/
-static void decode_header_value(char *text){/*{{{*/
-  /* rfc2047 decode, written by Mikael Ylikoski */
+static char *decode_base64(char *p, const char *q, const char *end)/*{{{*/
+{
+  /* Decode the base64 in [q,end) into p, returning the end of the output.
+   * Characters that aren't in the alphabet are skipped, and decoding stops
+   * after the group containing any '=' padding.  p may be the same as q. */
+  int reg, nc, eq; /* register, #characters in reg, #equals */
+  int dc; /* decoded character */
+  eq = reg = nc = 0;
+  while (q < end) {
+    unsigned char cq;
+    if ((nc == 0) && (q + 4 <= end)) {
+      /* Nearly all the input is whole groups of 4 plain characters, which can
+       * be done in one go. */
+      const unsigned char *u = (const unsigned char *) q;
+      int d0 = base64_table[u[0]];
+      int d1 = base64_table[u[1]];
+      int d2 = base64_table[u[2]];
+      int d3 = base64_table[u[3]];
+      if (((d0 | d1 | d2 | d3) >= 0) &&
+          !(equal_table[u[0]] | equal_table[u[1]] | equal_table[u[2]] | equal_table[u[3]])) {
+        int val = (d0 << 18) | (d1 << 12) | (d2 << 6) | d3;
+        p[0] = (val >> 16) & 0xff;
+        p[1] = (val >> 8) & 0xff;
+        p[2] = val & 0xff;
+        p += 3;
+        q += 4;
+        continue;
+      }
+    }
 
-  char *s, *a, *b, *e, *p, *q;
+    cq = *(const unsigned char *) q++;
+    dc = base64_table[cq];
+    eq += equal_table[cq];
+
+    if (dc >= 0) {
+      reg <<= 6;
+      reg += dc;
+      nc++;
+      if (nc == 4) {
+        *p++ = ((reg >> 16) & 0xff);
+        if (eq < 2) *p++ = ((reg >> 8) & 0xff);
+        if (eq < 1) *p++ = reg & 0xff;
+        nc = reg = 0;
+        if (eq) break;
+      }
+    }
+  }
+  return p;
+}
+/*}}}*/
+static char *header_buffer = NULL;
+static int header_buffer_size = 0;
+static char *convert_buffer = NULL;
+static int convert_buffer_size = 0;
 
-  for (p = q = s = text; (s = strstr(s, "=?")); s = e + 2) {
-    if (p == q)
-      p = q = s;
-    else
-      while (q != s)
-        *p++ = *q++;
-    s += 2;
-    a = strchr(s, '?');
+static int append_header_text(int used, const char *text, int len)/*{{{*/
+{
+  /* Append len characters of text to the used characters in header_buffer,
+   * leaving room for a null terminator.  Returns the new length. */
+  if (used + len + 1 > header_buffer_size) {
+    header_buffer_size = used + len + 1 + 256;
+    header_buffer = grow_array(char, header_buffer_size, header_buffer);
+  }
+  memcpy(header_buffer + used, text, len);
+  return used + len;
+}
+/*}}}*/
+static int append_converted(int used, const char *charset, char *text, int len)/*{{{*/
+{
+  char *utf8 = text_to_utf8(charset, text, len, &len, &convert_buffer, &convert_buffer_size);
+  return append_header_text(used, utf8, len);
+}
+/*}}}*/
+static char *decode_header_value(char *text){/*{{{*/
+  /* rfc2047 decode, written by Mikael Ylikoski.  The result is in UTF-8 :
+   * each encoded-word is converted from its own character set, and any raw
+   * 8-bit text is taken as UTF-8 if it is valid and as windows-1252
+   * otherwise.  text is overwritten, and the value returned is either text
+   * itself or header_buffer, which is reused by the next call. */
+
+  char *s, *a, *b, *e, *p, *q, *r;
+  char *charset, *star;
+  int used;
+
+  if (!strstr(text, "=?")) {
+    /* Fast path for the common case */
+    return text_to_utf8(NULL, text, strlen(text), NULL, &header_buffer, &header_buffer_size);
+  }
+
+  used = 0;
+  for (q = s = text; (s = strstr(s, "=?")); s = e + 2) {
+    a = strchr(s + 2, '?');
     if (!a) break;
     a++;
     b = strchr(a, '?');
@@ -316,71 +384,95 @@ static void decode_header_value(char *text){/*{{{*/
     /* have found an encoded-word */
     if (b - a != 2)
       continue; /* unknown encoding */
+    /* Decode it in place */
     if (*a == 'q' || *a == 'Q') {
       int val;
-      q = b;
-      while (q < e) {
-        if (*q == '_') {
+      p = r = b;
+      while (r < e) {
+        if (*r == '_') {
           *p++ = 0x20;
-          q++;
-        } else if (*q == '=') {
-          q++;
-          val = hex_to_val(*q++) << 4;
-          val += hex_to_val(*q++);
+          r++;
+        } else if (*r == '=') {
+          r++;
+          val = hex_to_val(*r++) << 4;
+          val += hex_to_val(*r++);
           *p++ = val;
         } else
-          *p++ = *q++;
+          *p++ = *r++;
       }
     } else if (*a == 'b' || *a == 'B') {
-      int reg, nc, eq; /* register, #characters in reg, #equals */
-      int dc; /* decoded character */
-      eq = reg = nc = 0;
-      for (q = b; q < e; q++) {
-        unsigned char cq = *(unsigned char *)q;
-        dc = base64_table[cq];
-        eq += equal_table[cq];
-
-        if (dc >= 0) {
-          reg <<= 6;
-          reg += dc;
-          nc++;
-          if (nc == 4) {
-            *p++ = ((reg >> 16) & 0xff);
-            if (eq < 2) *p++ = ((reg >> 8) & 0xff);
-            if (eq < 1) *p++ = reg & 0xff;
-            nc = reg = 0;
-            if (eq) break;
-          }
-        }
-      }
+      p = decode_base64(b, b, e);
     } else {
       continue; /* unknown encoding */
     }
+    used = append_converted(used, NULL, q, s - q);
+    /* Drop any rfc2231 language suffix from the character set name */
+    charset = arena_string(s + 2, (a - 1) - (s + 2));
+    star = strchr(charset, '*');
+    if (star) *star = '\0';
+    used = append_converted(used, charset, b, p - b);
     q = e + 2;
   }
-  if (p == q) return;
-  while (*q != '\0')
-    *p++ = *q++;
-  *p = '\0';
+  used = append_converted(used, NULL, q, strlen(q));
+  header_buffer[used] = '\0';
+  return header_buffer;
+}
+/*}}}*/
+static char *unfold_header_line(char *result, const char *start, const char *end)/*{{{*/
+{
+  /* Write a null-terminated copy of the header text in [start,end) to result,
+   * which must have room for end-start+1 characters, with each continuation
+   * line joined onto the previous one by the last of its leading whitespace
+   * characters. */
+  char *q;
+  const char *p, *f;
+
+  q = result;
+  for (p = start; p < end; p++) {
+    if (*p == '\n') {
+      /* Continuation lines are never blank, so this stays within the line. */
+      for (f = p + 1; isspace(*(unsigned char *) f); f++) ;
+      p = f - 2;
+    } else {
+      *q++ = *p;
+    }
+  }
+  *q = '\0';
+  return result;
 }
 /*}}}*/
-static char *copy_header_value(char *text){/*{{{*/
-  char *p;
-  for (p = text; *p && (*p != ':'); p++) ;
-  if (!*p) return NULL;
+static char *copy_header_value(struct header_line *hl, int scratch){/*{{{*/
+  /* If scratch is set, the copy is only needed while the message is being
+   * parsed, so it comes from the arena. */
+  char *p, *raw, *value;
+  for (p = hl->start; (p < hl->end) && (*p != ':'); p++) ;
+  if (p == hl->end) return NULL;
   p++;
-  p = new_string(p);
-  decode_header_value(p);
-  return p;
+  raw = arena_alloc(hl->end - p + 1);
+  unfold_header_line(raw, p, hl->end);
+  value = decode_header_value(raw);
+  if (scratch) {
+    return (value == raw) ? raw : arena_string(value, strlen(value));
+  }
+  return new_string(value);
 }
 /*}}}*/
-static void copy_or_concat_header_value(char **previous, char *text){/*{{{*/
-  char *p = copy_header_value(text);
+static struct nvp *make_header_nvp(struct msg_src *src, struct header_line *hl, const char *pfx)/*{{{*/
+{
+  char *text;
+  if (!match_string(pfx, hl->start)) return NULL;
+  text = arena_alloc(hl->end - hl->start + 1);
+  unfold_header_line(text, hl->start, hl->end);
+  return make_nvp(src, text, pfx);
+}
+/*}}}*/
+static void copy_or_concat_header_value(char **previous, struct header_line *hl){/*{{{*/
+  /* A value that's only going to be appended can go in the arena */
+  char *p = copy_header_value(hl, *previous != NULL);
   if (*previous)
   {
     *previous = extend_string(*previous, ", ");
     *previous = extend_string(*previous, p);
-    free(p);
   }
   else
     *previous = p;
@@ -423,6 +515,7 @@ static void parse_content_type(struct nvp *ct_nvp, struct content_type_header *r
   result->major = NULL;
   result->minor = NULL;
   result->boundary = NULL;
+  result->charset = NULL;
 
   result->major = nvp_major(ct_nvp);
   if (result->major) {
@@ -433,6 +526,7 @@ static void parse_content_type(struct nvp *ct_nvp, struct content_type_header *r
   }
 
   result->boundary = nvp_lookupcase(ct_nvp, "boundary");
+  result->charset = nvp_lookupcase(ct_nvp, "charset");
 }
 
 /*}}}*/
@@ -451,8 +545,10 @@ static char *looking_at_ws_then_newline(char *start)/*{{{*/
 }
 /*}}}*/
 
-static char *unencode_data(struct msg_src *src, char *input, int input_len, const char *enc, int *output_len)/*{{{*/
+static char *unencode_data(struct msg_src *src, char *input, int input_len, const char *enc, char *into, int *output_len)/*{{{*/
 {
+  /* Decode into the buffer 'into', which must have room for input_len+1
+   * bytes, or into a new one if it's NULL. */
   enum encoding_type encoding;
   char *result, *end_result;
   char *end_input;
@@ -462,7 +558,7 @@ static char *unencode_data(struct msg_src *src, char *input, int input_len, cons
 
   /* All mime encodings result in expanded data, so this is guaranteed to
    * safely oversize the output array */
-  result = new_array(char, input_len + 1);
+  result = into ? into : new_array(char, input_len + 1);
 
   /* Now decode */
   switch (encoding) {
@@ -499,8 +595,13 @@ static char *unencode_data(struct msg_src *src, char *input, int input_len, cons
             *p++ = val;
 
           } else {
-            /* Normal character */
-            *p++ = *q++;
+            /* Copy the run of normal characters up to the next '=' in one
+             * go. */
+            char *next_eq = memchr(q, '=', end_input - q);
+            int run = (next_eq ? next_eq : end_input) - q;
+            memcpy(p, q, run);
+            p += run;
+            q += run;
           }
         }
         end_result = p;
@@ -508,34 +609,7 @@ static char *unencode_data(struct msg_src *src, char *input, int input_len, cons
       break;
 /*}}}*/
     case ENC_BASE64:/*{{{*/
-      {
-        char *p, *q;
-        int reg, nc, eq; /* register, #characters in reg, #equals */
-        int dc; /* decoded character */
-        eq = reg = nc = 0;
-        for (q=input, p=result; q<end_input; q++) {
-          unsigned char cq =  * (unsigned char *)q;
-          /* Might want a 256 entry array instead of this sub-optimal mess
-           * eventually. */
-          dc = base64_table[cq];
-          eq += equal_table[cq];
-
-          if (dc >= 0) {
-            reg <<= 6;
-            reg += dc;
-            nc++;
-            if (nc == 4) {
-              *p++ = ((reg >> 16) & 0xff);
-              if (eq < 2) *p++ = ((reg >> 8) & 0xff);
-              if (eq < 1) *p++ = reg & 0xff;
-              nc = reg = 0;
-              if (eq) goto done_base_64;
-            }
-          }
-        }
-      done_base_64:
-        end_result = p;
-      }
+      end_result = decode_base64(result, input, end_input);
       break;
         /*}}}*/
     case ENC_UUENCODE:/*{{{*/
@@ -616,11 +690,46 @@ char *format_msg_src(struct msg_src *src)/*{{{*/
   return result;
 }
 /*}}}*/
-static int split_and_splice_header(struct msg_src *src, char *data, size_t data_len, struct line *header, char **body_start)/*{{{*/
+static void free_header(struct header *hdr)/*{{{*/
+{
+  if (hdr->lines != hdr->local) free(hdr->lines);
+}
+/*}}}*/
+static void add_header_line(struct header *hdr, char *start, char *end)/*{{{*/
+{
+  if (hdr->n == hdr->max) {
+    hdr->max += hdr->max;
+    if (hdr->lines == hdr->local) {
+      hdr->lines = new_array(struct header_line, hdr->max);
+      memcpy(hdr->lines, hdr->local, sizeof(hdr->local));
+    } else {
+      hdr->lines = grow_array(struct header_line, hdr->max, hdr->lines);
+    }
+  }
+  hdr->lines[hdr->n].start = start;
+  hdr->lines[hdr->n].end = end;
+  ++hdr->n;
+}
+/*}}}*/
+static int split_header(struct msg_src *src, char *data, size_t data_len, struct header *hdr, char **body_start)/*{{{*/
 {
-  char *sol, *eol;
+  /* Find the header fields, leaving the text where it is in the message.
+   * Continuation lines are just included in the field they continue; the few
+   * fields that get used are unfolded when they're looked at.
+   *
+   * The header is also checked for obvious broken-ness on the way :
+   * 1st line has no leading spaces, single word then colon
+   * following lines have leading spaces or single word followed by colon
+   * */
+  char *sol, *eol, *p;
   int blank_line;
-  header->next = header->prev = header;
+  int first = 1;
+  int audit_ok = 1;
+
+  hdr->lines = hdr->local;
+  hdr->n = 0;
+  hdr->max = LOCAL_HEADER_LINES;
+
   sol = data;
   do {
     if ((data_len == 0) || (!*sol)) break;
@@ -634,60 +743,155 @@ static int split_and_splice_header(struct msg_src *src, char *data, size_t data_
     if (data_len == 0) {
       fprintf(stderr, "Found end of message while still in header processing %s\n",
           format_msg_src(src));
-      return -1; /* & leak memory */
+      free_header(hdr);
+      return -1;
     } else if (*eol == '\n') {
       if (!blank_line) {
-        int line_length = eol - sol;
-        char *line_text = new_array(char, 1 + line_length);
-        struct line *new_header;
-
-        strncpy(line_text, sol, line_length);
-        line_text[line_length] = '\0';
-        new_header = new(struct line);
-        new_header->text = line_text;
-        enqueue(header, new_header);
+        int has_leading_space = isspace(*(unsigned char *) sol);
+        int has_word_colon = 0;
+        int saw_char = 0;
+
+        /* Ignore any UUCP or mbox style From line, or escaped From line, for
+         * the purposes of the audit */
+        if (strncmp("From ", sol, 5) && strncmp(">From ", sol, 6)) {
+          for (p = sol; p < eol; p++) {
+            if (*p == ':') {
+              has_word_colon = saw_char;
+              break;
+            } else if (isspace(*(unsigned char *) p)) {
+              break;
+            } else {
+              saw_char = 1;
+            }
+          }
+          if (( first && (has_leading_space || !has_word_colon)) ||
+              (!first && !(has_leading_space || has_word_colon))) {
+            audit_ok = 0;
+          }
+          first = 0;
+        }
+
+        if (has_leading_space && (hdr->n > 0)) {
+          /* Continuation of the previous field */
+          hdr->lines[hdr->n - 1].end = eol;
+        } else {
+          add_header_line(hdr, sol, eol);
+        }
       }
       sol = eol + 1; /* Start of next line */
       data_len--;
     } else { /* must be null char */
       fprintf(stderr, "Got null character whilst processing header of %s\n",
           format_msg_src(src));
-      return -1; /* & leak memory */
+      free_header(hdr);
+      return -1;
     }
   } while (!blank_line);
 
   *body_start = sol;
 
-  if (audit_header(header)) {
-    splice_header_lines(header);
+  if (audit_ok) {
     return 0;
   } else {
 #if 0
     /* Caller generates message */
     fprintf(stderr, "Message had bad rfc822 headers, ignoring\n");
 #endif
+    free_header(hdr);
     return -1;
   }
 }
 /*}}}*/
 
+struct part_sink {/*{{{*/
+  /* Where the parts of a message go : onto an attachment list when building a
+   * struct rfc822, or straight to a visitor. */
+  struct attachment *atts;
+  struct rfc822_visitor *visitor;
+  int depth;
+};
+/*}}}*/
+
+/* Decoded text parts are handed to a visitor in this buffer, which is reused
+ * from one part to the next. */
+static char *part_buffer = NULL;
+static int part_buffer_size = 0;
+
 /* Forward prototypes */
 static void do_multipart(struct msg_src *src, char *input, int input_len,
-    const char *boundary, struct attachment *atts,
+    const char *boundary, struct part_sink *sink,
+    enum data_to_rfc822_error *error);
+static int parse_rfc822(struct msg_src *src, char *data, int length,
+    struct headers *hdrs, struct part_sink *sink,
     enum data_to_rfc822_error *error);
+static void free_headers(struct headers *hdrs);
+static struct rfc822 *build_rfc822(struct msg_src *src, char *data, int length,
+    enum data_to_rfc822_error *error);
+
+static char *utf8_buffer = NULL;
+static int utf8_buffer_size = 0;
+
+static void visit_part(struct msg_src *src,/*{{{*/
+    char *body_start, int body_len, const char *content_transfer_encoding,
+    enum content_type ct, const char *charset, const char *filename,
+    struct part_sink *sink,
+    enum data_to_rfc822_error *error)
+{
+  struct rfc822_visitor *v = sink->visitor;
+  char *decoded_body;
+  int decoded_body_len;
+
+  switch (ct) {
+    case CT_MESSAGE_RFC822:
+      {
+        struct headers hdrs;
+        struct part_sink inner;
+        /* The decoded message is the input for its own parts, so it can't go
+         * in part_buffer. */
+        decoded_body = unencode_data(src, body_start, body_len, content_transfer_encoding, NULL, &decoded_body_len);
+        inner.atts = NULL;
+        inner.visitor = v;
+        inner.depth = sink->depth + 1;
+        parse_rfc822(src, decoded_body, decoded_body_len, &hdrs, &inner, error);
+        free_headers(&hdrs);
+        free(decoded_body);
+        v->part(v->arg, ct, NULL, filename);
+      }
+      break;
+    case CT_TEXT_PLAIN:
+    case CT_TEXT_HTML:
+      if (body_len + 1 > part_buffer_size) {
+        part_buffer_size = body_len + 1;
+        part_buffer = grow_array(char, part_buffer_size, part_buffer);
+      }
+      unencode_data(src, body_start, body_len, content_transfer_encoding, part_buffer, &decoded_body_len);
+      decoded_body = text_to_utf8(charset, part_buffer, decoded_body_len, NULL, &utf8_buffer, &utf8_buffer_size);
+      v->part(v->arg, ct, decoded_body, filename);
+      break;
+    default:
+      /* Only the name of anything else gets indexed */
+      v->part(v->arg, ct, NULL, filename);
+      break;
+  }
+}
+/*}}}*/
 
 /*{{{ do_body() */
 static void do_body(struct msg_src *src,
     char *body_start, int body_len,
     struct nvp *ct_nvp, struct nvp *cte_nvp,
     struct nvp *cd_nvp,
-    struct attachment *atts,
+    struct part_sink *sink,
     enum data_to_rfc822_error *error)
 {
   char *decoded_body;
   int decoded_body_len;
   const char *content_transfer_encoding;
+  const char *filename;
+  const char *charset;
+  enum content_type part_ct;
   content_transfer_encoding = NULL;
+  charset = NULL;
   if (cte_nvp) {
     content_transfer_encoding = nvp_first(cte_nvp);
     if (!content_transfer_encoding) {
@@ -697,93 +901,98 @@ static void do_body(struct msg_src *src,
     }
   }
 
-  decoded_body = unencode_data(src, body_start, body_len, content_transfer_encoding, &decoded_body_len);
-
   if (ct_nvp) {
     struct content_type_header ct;
     parse_content_type(ct_nvp, &ct);
     if (ct.major && !strcasecmp(ct.major, "multipart")) {
-      do_multipart(src, decoded_body, decoded_body_len, ct.boundary, atts, error);
+      decoded_body = unencode_data(src, body_start, body_len, content_transfer_encoding, NULL, &decoded_body_len);
+      do_multipart(src, decoded_body, decoded_body_len, ct.boundary, sink, error);
       /* Don't need decoded body any longer - copies have been taken if
        * required when handling multipart attachments. */
       free(decoded_body);
-      if (error && (*error == DTR8_MISSING_END)) return;
-    } else {
-      /* unipart */
-      struct attachment *new_att;
+      return;
+    }
+
+    /* unipart */
+    {
       const char *disposition;
-      new_att = new(struct attachment);
       disposition = cd_nvp ? nvp_first(cd_nvp) : NULL;
+      filename = NULL;
       if (disposition && !strcasecmp(disposition, "attachment")) {
-        const char *lookup;
-        lookup = nvp_lookupcase(cd_nvp, "filename");
-        if (lookup) {
-          new_att->filename = new_string(lookup);
-        } else {
+        filename = nvp_lookupcase(cd_nvp, "filename");
+        if (!filename) {
           /* Some messages have name=... in content-type: instead of
            * filename=... in content-disposition. */
-          lookup = nvp_lookup(ct_nvp, "name");
-          if (lookup) {
-            new_att->filename = new_string(lookup);
-          } else {
-            new_att->filename = NULL;
-          }
+          filename = nvp_lookup(ct_nvp, "name");
         }
-      } else {
-        new_att->filename = NULL;
       }
       if (ct.major && !strcasecmp(ct.major, "text")) {
+        charset = ct.charset;
         if (ct.minor && !strcasecmp(ct.minor, "plain")) {
-          new_att->ct = CT_TEXT_PLAIN;
+          part_ct = CT_TEXT_PLAIN;
         } else if (ct.minor && !strcasecmp(ct.minor, "html")) {
-          new_att->ct = CT_TEXT_HTML;
+          part_ct = CT_TEXT_HTML;
         } else {
-          new_att->ct = CT_TEXT_OTHER;
+          part_ct = CT_TEXT_OTHER;
         }
       } else if (ct.major && !strcasecmp(ct.major, "message") &&
                  ct.minor && !strcasecmp(ct.minor, "rfc822")) {
-        new_att->ct = CT_MESSAGE_RFC822;
+        part_ct = CT_MESSAGE_RFC822;
       } else {
-        new_att->ct = CT_OTHER;
+        part_ct = CT_OTHER;
       }
-
-      if (new_att->ct == CT_MESSAGE_RFC822) {
-        new_att->data.rfc822 = data_to_rfc822(src, decoded_body, decoded_body_len, error);
-        free(decoded_body); /* data no longer needed */
-      } else {
-        new_att->data.normal.len = decoded_body_len;
-        new_att->data.normal.bytes = decoded_body;
-      }
-      enqueue(atts, new_att);
     }
   } else {
-    /* Treat as text/plain {{{*/
+    /* Treat as text/plain */
+    filename = NULL;
+    part_ct = CT_TEXT_PLAIN;
+  }
+
+  if (sink->visitor) {
+    visit_part(src, body_start, body_len, content_transfer_encoding, part_ct, charset, filename, sink, error);
+  } else {
     struct attachment *new_att;
     new_att = new(struct attachment);
-    new_att->filename = NULL;
-    new_att->ct = CT_TEXT_PLAIN;
-    new_att->data.normal.len = decoded_body_len;
-    /* Add null termination on the end */
-    new_att->data.normal.bytes = new_array(char, decoded_body_len + 1);
-    memcpy(new_att->data.normal.bytes, decoded_body, decoded_body_len + 1);
-    free(decoded_body);
-    enqueue(atts, new_att);/*}}}*/
+    new_att->ct = part_ct;
+    new_att->filename = filename ? new_string(filename) : NULL;
+    if (part_ct == CT_MESSAGE_RFC822) {
+      decoded_body = unencode_data(src, body_start, body_len, content_transfer_encoding, NULL, &decoded_body_len);
+      new_att->data.rfc822 = build_rfc822(src, decoded_body, decoded_body_len, error);
+      free(decoded_body); /* data no longer needed */
+    } else if ((part_ct == CT_TEXT_PLAIN) || (part_ct == CT_TEXT_HTML)) {
+      char *bytes, *utf8, *buf = NULL;
+      int len, buf_size = 0;
+      /* unencode_data() adds null termination on the end */
+      bytes = unencode_data(src, body_start, body_len, content_transfer_encoding, NULL, &len);
+      utf8 = text_to_utf8(charset, bytes, len, &len, &buf, &buf_size);
+      if (utf8 != bytes) free(bytes);
+      new_att->data.normal.bytes = utf8;
+      new_att->data.normal.len = len;
+    } else {
+      /* Only the name of anything else gets indexed (see
+       * tokenise_message()), so don't spend time and memory decoding it. */
+      new_att->data.normal.len = 0;
+      new_att->data.normal.bytes = NULL;
+    }
+    enqueue(sink->atts, new_att);
   }
 }
 /*}}}*/
 /*{{{ do_attachment() */
 static void do_attachment(struct msg_src *src,
     char *start, char *after_end,
-    struct attachment *atts)
+    struct part_sink *sink)
 {
   /* decode attachment and add to attachment list */
-  struct line header, *x, *nx;
+  struct header header;
+  struct header_line *x;
   char *body_start;
   int body_len;
+  int i;
 
   struct nvp *ct_nvp, *cte_nvp, *cd_nvp, *nvp;
 
-  if (split_and_splice_header(src, start, after_end-start, &header, &body_start) < 0) {
+  if (split_header(src, start, after_end-start, &header, &body_start) < 0) {
     fprintf(stderr, "Giving up on attachment with bad header in %s\n",
         format_msg_src(src));
     return;
@@ -791,29 +1000,41 @@ static void do_attachment(struct msg_src *src,
 
   /* Extract key headers */
   ct_nvp = cte_nvp = cd_nvp = NULL;
-  for (x=header.next; x!=&header; x=x->next) {
-    if ((nvp = make_nvp(src, x->text, "content-type:"))) {
-      ct_nvp = nvp;
-    } else if ((nvp = make_nvp(src, x->text, "content-transfer-encoding:"))) {
-      cte_nvp = nvp;
-    } else if ((nvp = make_nvp(src, x->text, "content-disposition:"))) {
-      cd_nvp = nvp;
+  for (i=0; i<header.n; i++) {
+    x = &header.lines[i];
+    switch (classify_header(x->start, x->end)) {
+      case HDR_CONTENT_TYPE:
+        if ((nvp = make_header_nvp(src, x, "content-type:"))) {
+          ct_nvp = nvp;
+        }
+        break;
+      case HDR_CONTENT_TRANSFER_ENCODING:
+        if ((nvp = make_header_nvp(src, x, "content-transfer-encoding:"))) {
+          cte_nvp = nvp;
+        }
+        break;
+      case HDR_CONTENT_DISPOSITION:
+        if ((nvp = make_header_nvp(src, x, "content-disposition:"))) {
+          cd_nvp = nvp;
+        }
+        break;
+      default:
+        break;
     }
   }
+  free_header(&header);
 
 #if 0
   if (ct_nvp) {
     fprintf(stderr, "======\n");
     fprintf(stderr, "Dump of content-type hdr\n");
     nvp_dump(ct_nvp, stderr);
-    free(ct_nvp);
   }
 
   if (cte_nvp) {
     fprintf(stderr, "======\n");
     fprintf(stderr, "Dump of content-transfer-encoding hdr\n");
     nvp_dump(cte_nvp, stderr);
-    free(cte_nvp);
   }
 #endif
 
@@ -826,29 +1047,50 @@ static void do_attachment(struct msg_src *src,
   } else {
     body_len = after_end - body_start;
     /* Ignore errors in nested body parts. */
-    do_body(src, body_start, body_len, ct_nvp, cte_nvp, cd_nvp, atts, NULL);
+    do_body(src, body_start, body_len, ct_nvp, cte_nvp, cd_nvp, sink, NULL);
   }
 
-  /* Free header memory */
-  for (x=header.next; x!=&header; x=nx) {
-    nx = x->next;
-    free(x->text);
-    free(x);
+}
+/*}}}*/
+static char *find_boundary(char *from, char *be, const char *boundary, int boundary_len)/*{{{*/
+{
+  /* Return the first "--boundary" at or after 'from' that might be a
+   * boundary line.  Only 'from' itself and the start of each following line
+   * need comparing, since the caller would reject a match in the middle of a
+   * line and carry on from the next line anyway.  The last line, which has no
+   * newline after it, is still searched at every position so that a stray
+   * match there is reported exactly as before. */
+  char *limit = be - (boundary_len + 2);
+  char *bx = from;
+  while (bx < limit) {
+    char *eol;
+    if (bx[0] == '-' && bx[1] == '-' &&
+        !memcmp(bx+2, boundary, boundary_len)) {
+      return bx;
+    }
+    eol = memchr(bx, '\n', be - bx);
+    if (!eol) {
+      for (bx++; bx < limit; bx++) {
+        if (bx[0] == '-' && bx[1] == '-' &&
+            !memcmp(bx+2, boundary, boundary_len)) {
+          return bx;
+        }
+      }
+      return NULL;
+    }
+    bx = eol + 1;
   }
-
-  if (ct_nvp) free_nvp(ct_nvp);
-  if (cte_nvp) free_nvp(cte_nvp);
-  if (cd_nvp) free_nvp(cd_nvp);
+  return NULL;
 }
 /*}}}*/
 /*{{{ do_multipart() */
 static void do_multipart(struct msg_src *src,
     char *input, int input_len,
     const char *boundary,
-    struct attachment *atts,
+    struct part_sink *sink,
     enum data_to_rfc822_error *error)
 {
-  char *b0, *b1, *be, *bx;
+  char *b0, *b1, *be;
   char *line_after_b0, *start_b1_search_from;
   int boundary_len;
   int looking_at_end_boundary;
@@ -871,14 +1113,7 @@ static void do_multipart(struct msg_src *src,
     start_b1_search_from = line_after_b0;
     do {
       /* reject boundaries that aren't a whole line */
-      b1 = NULL;
-      for (bx = start_b1_search_from; bx < be - (boundary_len + 2); bx++) {
-        if (bx[0] == '-' && bx[1] == '-' &&
-            !strncmp(bx+2, boundary, boundary_len)) {
-          b1 = bx;
-          break;
-        }
-      }
+      b1 = find_boundary(start_b1_search_from, be, boundary, boundary_len);
       if (!b1) {
         if (error)
           *error = DTR8_MISSING_END;
@@ -910,7 +1145,7 @@ static void do_multipart(struct msg_src *src,
 
     if (b0) {
       /* don't treat preamble as an attachment */
-      do_attachment(src, line_after_b0, b1, atts);
+      do_attachment(src, line_after_b0, b1, sink);
     }
 
     b0 = b1;
@@ -1000,86 +1235,158 @@ static void scan_status_flags(const char *s, struct headers *hdrs)/*{{{*/
 }
 /*}}}*/
 
-/*{{{ data_to_rfc822() */
-struct rfc822 *data_to_rfc822(struct msg_src *src,
+/*{{{ parse_rfc822() */
+static int parse_rfc822(struct msg_src *src,
     char *data, int length,
+    struct headers *hdrs,
+    struct part_sink *sink,
     enum data_to_rfc822_error *error)
 {
-  struct rfc822 *result;
+  /* Returns -1 if the headers couldn't be parsed, else 0. */
+  struct rfc822_visitor *v = sink->visitor;
   char *body_start;
-  struct line header;
-  struct line *x, *nx;
-  struct nvp *ct_nvp, *cte_nvp, *cd_nvp, *nvp;
+  struct header header;
+  struct header_line *x;
+  struct nvp *ct_nvp, *cte_nvp, *cd_nvp;
   int body_len;
+  int i;
+  int result = 0;
 
   ct_nvp = cte_nvp = cd_nvp = NULL;
   if (error) *error = DTR8_OK; /* default */
-  result = new(struct rfc822);
-  init_headers(&result->hdrs);
-  result->atts.next = result->atts.prev = &result->atts;
+  init_headers(hdrs);
 
-  if (split_and_splice_header(src, data, length, &header, &body_start) < 0) {
+  if (split_header(src, data, length, &header, &body_start) < 0) {
     if (verbose) {
       fprintf(stderr, "Giving up on message %s with bad header\n",
           format_msg_src(src));
     }
     if (error) *error = DTR8_BAD_HEADERS;
-    free(result);
-    result = NULL;
+    result = -1;
     goto out;
   }
 
   /* Extract key headers {{{*/
-  for (x=header.next; x!=&header; x=x->next) {
-    if      (match_string("to:", x->text))
-      copy_or_concat_header_value(&result->hdrs.to, x->text);
-    else if (match_string("cc:", x->text))
-      copy_or_concat_header_value(&result->hdrs.cc, x->text);
-    else if (!result->hdrs.from && match_string("from:", x->text))
-      result->hdrs.from = copy_header_value(x->text);
-    else if (!result->hdrs.subject && match_string("subject:", x->text))
-      result->hdrs.subject = copy_header_value(x->text);
-    else if (!ct_nvp && (nvp = make_nvp(src, x->text, "content-type:")))
-      ct_nvp = nvp;
-    else if (!cte_nvp && (nvp = make_nvp(src, x->text, "content-transfer-encoding:")))
-      cte_nvp = nvp;
-    else if (!cd_nvp && (nvp = make_nvp(src, x->text, "content-disposition:")))
-      cd_nvp = nvp;
-    else if (!result->hdrs.date && match_string("date:", x->text)) {
-      char *date_string = copy_header_value(x->text);
-      result->hdrs.date = parse_rfc822_date(date_string);
-      free(date_string);
-    } else if (!result->hdrs.message_id && match_string("message-id:", x->text))
-      result->hdrs.message_id = copy_header_value(x->text);
-    else if (!result->hdrs.in_reply_to && match_string("in-reply-to:", x->text))
-      result->hdrs.in_reply_to = copy_header_value(x->text);
-    else if (!result->hdrs.references && match_string("references:", x->text))
-      result->hdrs.references = copy_header_value(x->text);
-    else if (match_string("status:", x->text))
-      scan_status_flags(x->text + (sizeof("status:") - 1), &result->hdrs);
-    else if (match_string("x-status:", x->text))
-      scan_status_flags(x->text + (sizeof("x-status:") - 1), &result->hdrs);
+  for (i=0; i<header.n; i++) {
+    x = &header.lines[i];
+    switch (classify_header(x->start, x->end)) {
+      case HDR_TO:
+        copy_or_concat_header_value(&hdrs->to, x);
+        break;
+      case HDR_CC:
+        copy_or_concat_header_value(&hdrs->cc, x);
+        break;
+      case HDR_FROM:
+        if (!hdrs->from) hdrs->from = copy_header_value(x, 0);
+        break;
+      case HDR_SUBJECT:
+        if (!hdrs->subject) hdrs->subject = copy_header_value(x, 0);
+        break;
+      case HDR_CONTENT_TYPE:
+        if (!ct_nvp) ct_nvp = make_header_nvp(src, x, "content-type:");
+        break;
+      case HDR_CONTENT_TRANSFER_ENCODING:
+        if (!cte_nvp) cte_nvp = make_header_nvp(src, x, "content-transfer-encoding:");
+        break;
+      case HDR_CONTENT_DISPOSITION:
+        if (!cd_nvp) cd_nvp = make_header_nvp(src, x, "content-disposition:");
+        break;
+      case HDR_DATE:
+        if (!hdrs->date) {
+          char *date_string = copy_header_value(x, 1);
+          hdrs->date = parse_rfc822_date(date_string);
+        }
+        break;
+      case HDR_MESSAGE_ID:
+        if (!hdrs->message_id) hdrs->message_id = copy_header_value(x, 0);
+        break;
+      case HDR_IN_REPLY_TO:
+        if (!hdrs->in_reply_to) hdrs->in_reply_to = copy_header_value(x, 0);
+        break;
+      case HDR_REFERENCES:
+        if (!hdrs->references) hdrs->references = copy_header_value(x, 0);
+        break;
+      case HDR_STATUS:
+      case HDR_X_STATUS:
+        {
+          char *flags = copy_header_value(x, 1);
+          scan_status_flags(flags, hdrs);
+        }
+        break;
+      default:
+        /* Not a header we use */
+        break;
+    }
   }
+  free_header(&header);
 /*}}}*/
 
+  if (v && v->start_message) v->start_message(v->arg, hdrs, sink->depth);
+
   /* Process body */
   body_len = length - (body_start - data);
-  do_body(src, body_start, body_len, ct_nvp, cte_nvp, cd_nvp, &result->atts, error);
+  do_body(src, body_start, body_len, ct_nvp, cte_nvp, cd_nvp, sink, error);
+
+  if (v && v->end_message) v->end_message(v->arg, hdrs, sink->depth);
 
 out:
-  /* Free header memory */
-  for (x=header.next; x!=&header; x=nx) {
-    nx = x->next;
-    free(x->text);
-    free(x);
-  }
+  return result;
 
-  if (ct_nvp) free_nvp(ct_nvp);
-  if (cte_nvp) free_nvp(cte_nvp);
-  if (cd_nvp) free_nvp(cd_nvp);
+}
+/*}}}*/
+/*{{{ build_rfc822() */
+static struct rfc822 *build_rfc822(struct msg_src *src,
+    char *data, int length,
+    enum data_to_rfc822_error *error)
+{
+  /* Also used for message/rfc822 parts, so it mustn't reset the arena : the
+   * enclosing message's headers are still in use. */
+  struct rfc822 *result;
+  struct part_sink sink;
 
+  result = new(struct rfc822);
+  result->atts.next = result->atts.prev = &result->atts;
+  sink.atts = &result->atts;
+  sink.visitor = NULL;
+  sink.depth = 0;
+  if (parse_rfc822(src, data, length, &result->hdrs, &sink, error) < 0) {
+    free(result);
+    result = NULL;
+  }
+  return result;
+}
+/*}}}*/
+/*{{{ data_to_rfc822() */
+struct rfc822 *data_to_rfc822(struct msg_src *src,
+    char *data, int length,
+    enum data_to_rfc822_error *error)
+{
+  struct rfc822 *result;
+  result = build_rfc822(src, data, length, error);
+  arena_reset();
+  return result;
+}
+/*}}}*/
+/*{{{ visit_rfc822() */
+int visit_rfc822(struct msg_src *src,
+    char *data, int length,
+    struct rfc822_visitor *v,
+    enum data_to_rfc822_error *error)
+{
+  /* Like data_to_rfc822(), except that the message's headers and parts are
+   * passed to the visitor's callbacks as they're parsed, instead of being
+   * kept.  Returns -1 if the message couldn't be parsed. */
+  struct headers hdrs;
+  struct part_sink sink;
+  int result;
+
+  sink.atts = NULL;
+  sink.visitor = v;
+  sink.depth = 0;
+  result = parse_rfc822(src, data, length, &hdrs, &sink, error);
+  free_headers(&hdrs);
+  arena_reset();
   return result;
-
 }
 /*}}}*/
 
@@ -1451,6 +1758,78 @@ void free_ro_mapping(unsigned char *data, int len)/*{{{*/
 }
 /*}}}*/
 
+/* Small messages are read into a buffer that is kept between calls, rather
+ * than being given a mapping of their own.  This saves the mmap/munmap (and
+ * the associated page table work) for each of the many small files in
+ * maildir and MH folders. */
+#define MSG_BUFFER_LIMIT (256 * 1024)
+
+static unsigned char *msg_buffer = NULL;
+static int msg_buffer_size = 0;
+
+static void read_message_file(const char *filename, unsigned char **data, int *len)/*{{{*/
+{
+  struct stat sb;
+  int fd;
+  int got, n;
+
+#if USE_GZIP_MBOX || USE_BZIP_MBOX || USE_XZ_MBOX
+  if (is_compressed(filename)) {
+    create_ro_mapping(filename, data, len, MAP_DECOMPRESS_IF_APPLICABLE);
+    return;
+  }
+#endif
+
+  *data = NULL;
+  *len = 0;
+
+  /* O_NONBLOCK so that a stray FIFO can't hang us; it has no effect on
+   * regular files. */
+  fd = open(filename, O_RDONLY | O_NONBLOCK);
+  if (fd < 0) {
+    report_error("open", filename);
+    return;
+  }
+  if (fstat(fd, &sb) < 0) {
+    report_error("fstat", filename);
+    close(fd);
+    return;
+  }
+  if (!S_ISREG(sb.st_mode) || (sb.st_size == 0)) {
+    close(fd);
+    return;
+  }
+  if (sb.st_size > MSG_BUFFER_LIMIT) {
+    close(fd);
+    create_ro_mapping(filename, data, len, MAP_DECOMPRESS_IF_APPLICABLE);
+    return;
+  }
+
+  if (sb.st_size > msg_buffer_size) {
+    msg_buffer_size = sb.st_size;
+    msg_buffer = grow_array(unsigned char, msg_buffer_size, msg_buffer);
+  }
+  got = 0;
+  while (got < sb.st_size) {
+    n = read(fd, msg_buffer + got, sb.st_size - got);
+    if (n < 0) {
+      report_error("read", filename);
+      close(fd);
+      return;
+    }
+    if (n == 0) break; /* file shrank under us */
+    got += n;
+  }
+  if (close(fd) < 0)
+    report_error("close", filename);
+
+  if (got > 0) {
+    *data = msg_buffer;
+    *len = got;
+    data_alloc_type = ALLOC_NONE;
+  }
+}
+/*}}}*/
 static struct msg_src *setup_msg_src(char *filename)/*{{{*/
 {
   static struct msg_src result;
@@ -1459,13 +1838,316 @@ static struct msg_src *setup_msg_src(char *filename)/*{{{*/
   return &result;
 }
 /*}}}*/
+
+/* Reading message files ahead of the parser.  On a cold cache, and more so on
+ * network storage, the open, stat and read for each small file is mostly
+ * waiting.  With threads, a few readers work through the list of files ahead
+ * of the parser, each reading a file whole into one of PREFETCH_DEPTH slots;
+ * file k always goes in slot k % PREFETCH_DEPTH, which is only reused once
+ * the parser has finished with the file before it.  Anything that
+ * read_message_file() wouldn't read into a buffer (compressed or large files)
+ * is left for the parser to read itself.  Errors are reported when the
+ * parser gets to the file, so they come out in the same order as before.
+ *
+ * Without threads, the kernel is just asked to read the files ahead. */
+
+#define PREFETCH_DEPTH 32
+#define PREFETCH_THREADS 4
+
+#ifdef USE_PTHREADS
+enum prefetch_slot_state {
+  SLOT_FREE,
+  SLOT_READING,
+  SLOT_READY
+};
+
+struct prefetch_slot {/*{{{*/
+  enum prefetch_slot_state state;
+  int index; /* of the file being read into it */
+  unsigned char *buffer;
+  int size;
+  int len; /* bytes read, or -1 if the parser is to read the file */
+  const char *failed_call; /* "open" etc. if an error is to be reported */
+  int saved_errno;
+};
+/*}}}*/
+#endif
+
+struct prefetch {/*{{{*/
+  char **paths; /* NULL for entries that aren't files to read */
+  int n;
+#ifdef USE_PTHREADS
+  struct prefetch_slot slots[PREFETCH_DEPTH];
+  /* lock protects everything below it */
+  pthread_mutex_t lock;
+  pthread_cond_t slot_ready;
+  pthread_cond_t slot_freed;
+  int parser_waiting;
+  int readers_waiting;
+  int n_freed; /* slots freed since the waiting readers were last woken */
+  int next_to_read;
+  int stopping;
+  pthread_t threads[PREFETCH_THREADS];
+  int started[PREFETCH_THREADS];
+#else
+  int next_advised;
+#endif
+};
+/*}}}*/
+
+#ifdef USE_PTHREADS
+static void load_slot(struct prefetch_slot *s, const char *filename)/*{{{*/
+{
+  /* The same as read_message_file(), except for where the data goes. */
+  struct stat sb;
+  int fd;
+  int got, n;
+
+  s->len = 0;
+  s->failed_call = NULL;
+
+#if USE_GZIP_MBOX || USE_BZIP_MBOX || USE_XZ_MBOX
+  if (is_compressed(filename)) {
+    s->len = -1;
+    return;
+  }
+#endif
+
+  fd = open(filename, O_RDONLY | O_NONBLOCK);
+  if (fd < 0) {
+    s->failed_call = "open";
+    s->saved_errno = errno;
+    return;
+  }
+  if (fstat(fd, &sb) < 0) {
+    s->failed_call = "fstat";
+    s->saved_errno = errno;
+    close(fd);
+    return;
+  }
+  if (!S_ISREG(sb.st_mode) || (sb.st_size == 0)) {
+    close(fd);
+    return;
+  }
+  if (sb.st_size > MSG_BUFFER_LIMIT) {
+#ifdef POSIX_FADV_WILLNEED
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+    close(fd);
+    s->len = -1;
+    return;
+  }
+
+  if (sb.st_size > s->size) {
+    s->size = sb.st_size;
+    s->buffer = grow_array(unsigned char, s->size, s->buffer);
+  }
+  got = 0;
+  while (got < sb.st_size) {
+    n = read(fd, s->buffer + got, sb.st_size - got);
+    if (n < 0) {
+      s->failed_call = "read";
+      s->saved_errno = errno;
+      close(fd);
+      return;
+    }
+    if (n == 0) break; /* file shrank under us */
+    got += n;
+  }
+  if (close(fd) < 0) {
+    s->failed_call = "close";
+    s->saved_errno = errno;
+  }
+  s->len = got;
+}
+/*}}}*/
+static void *prefetch_worker(void *arg)/*{{{*/
+{
+  struct prefetch *p = (struct prefetch *) arg;
+  struct prefetch_slot *s;
+  int k;
+
+  pthread_mutex_lock(&p->lock);
+  for (;;) {
+    while ((p->next_to_read < p->n) && !p->paths[p->next_to_read]) {
+      p->next_to_read++;
+    }
+    if (p->stopping || (p->next_to_read >= p->n)) break;
+    s = &p->slots[p->next_to_read % PREFETCH_DEPTH];
+    if (s->state != SLOT_FREE) {
+      /* Too far ahead of the parser */
+      p->readers_waiting++;
+      pthread_cond_wait(&p->slot_freed, &p->lock);
+      p->readers_waiting--;
+      continue;
+    }
+    k = p->next_to_read++;
+    s->state = SLOT_READING;
+    s->index = k;
+    pthread_mutex_unlock(&p->lock);
+
+    load_slot(s, p->paths[k]);
+
+    pthread_mutex_lock(&p->lock);
+    s->state = SLOT_READY;
+    if (p->parser_waiting) pthread_cond_signal(&p->slot_ready);
+  }
+  pthread_mutex_unlock(&p->lock);
+  return NULL;
+}
+/*}}}*/
+#endif
+struct prefetch *start_prefetch(char **paths, int n)/*{{{*/
+{
+  /* Start reading the files in paths[0..n-1] (skipping NULL entries) ahead of
+   * visit_prefetched_file() being called for each in turn. */
+  struct prefetch *p;
+  int i;
+
+  p = new(struct prefetch);
+  p->paths = paths;
+  p->n = n;
+#ifdef USE_PTHREADS
+  for (i=0; i<PREFETCH_DEPTH; i++) {
+    p->slots[i].state = SLOT_FREE;
+    p->slots[i].buffer = NULL;
+    p->slots[i].size = 0;
+  }
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->slot_ready, NULL);
+  pthread_cond_init(&p->slot_freed, NULL);
+  p->parser_waiting = 0;
+  p->readers_waiting = 0;
+  p->n_freed = 0;
+  p->next_to_read = 0;
+  p->stopping = 0;
+  for (i=0; i<PREFETCH_THREADS; i++) {
+    p->started[i] = (pthread_create(&p->threads[i], NULL, prefetch_worker, p) == 0);
+  }
+#else
+  (void) i;
+  p->next_advised = 0;
+#endif
+  return p;
+}
+/*}}}*/
+static void take_prefetched_file(struct prefetch *p, int k, unsigned char **data, int *len)/*{{{*/
+{
+#ifdef USE_PTHREADS
+  struct prefetch_slot *s = &p->slots[k % PREFETCH_DEPTH];
+  int started = 0;
+  int i;
+
+  for (i=0; i<PREFETCH_THREADS; i++) started |= p->started[i];
+  if (started) {
+    pthread_mutex_lock(&p->lock);
+    while ((s->state != SLOT_READY) || (s->index != k)) {
+      /* Caught up with the readers, so they mustn't wait for more slots */
+      if (p->readers_waiting) {
+        pthread_cond_broadcast(&p->slot_freed);
+        p->n_freed = 0;
+      }
+      p->parser_waiting = 1;
+      pthread_cond_wait(&p->slot_ready, &p->lock);
+      p->parser_waiting = 0;
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    if (s->failed_call) {
+      errno = s->saved_errno;
+      report_error(s->failed_call, p->paths[k]);
+    }
+    if (s->len >= 0) {
+      *data = (s->len > 0) ? s->buffer : NULL;
+      *len = s->len;
+      data_alloc_type = ALLOC_NONE;
+      return;
+    }
+  }
+#else
+  /* Keep PREFETCH_DEPTH files of readahead in flight */
+  while ((p->next_advised < p->n) && (p->next_advised <= k + PREFETCH_DEPTH)) {
+#ifdef POSIX_FADV_WILLNEED
+    const char *path = p->paths[p->next_advised];
+    int fd;
+    if (path && ((fd = open(path, O_RDONLY | O_NONBLOCK)) >= 0)) {
+      posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+      close(fd);
+    }
+#endif
+    p->next_advised++;
+  }
+#endif
+  read_message_file(p->paths[k], data, len);
+}
+/*}}}*/
+static void release_prefetched_file(struct prefetch *p, int k)/*{{{*/
+{
+#ifdef USE_PTHREADS
+  struct prefetch_slot *s = &p->slots[k % PREFETCH_DEPTH];
+  pthread_mutex_lock(&p->lock);
+  if ((s->state == SLOT_READY) && (s->index == k)) {
+    s->state = SLOT_FREE;
+    /* Wake the readers for a batch of slots at a time rather than for each
+     * one, which saves a lot of switching between threads */
+    if (p->readers_waiting && (++p->n_freed >= PREFETCH_DEPTH / 2)) {
+      pthread_cond_broadcast(&p->slot_freed);
+      p->n_freed = 0;
+    }
+  }
+  pthread_mutex_unlock(&p->lock);
+#else
+  (void) p;
+  (void) k;
+#endif
+}
+/*}}}*/
+int visit_prefetched_file(struct prefetch *p, int k, struct rfc822_visitor *v)/*{{{*/
+{
+  /* Read the file paths[k] and pass the message in it to the visitor's
+   * callbacks, as visit_rfc822() does.  Returns -1 if it couldn't be
+   * parsed. */
+  int len;
+  unsigned char *data;
+  int result = -1;
+
+  take_prefetched_file(p, k, &data, &len);
+  if (data) {
+    result = visit_rfc822(setup_msg_src(p->paths[k]), (char *) data, len, v, NULL);
+    free_ro_mapping(data, len);
+  }
+  release_prefetched_file(p, k);
+  return result;
+}
+/*}}}*/
+void end_prefetch(struct prefetch *p)/*{{{*/
+{
+#ifdef USE_PTHREADS
+  int i;
+  pthread_mutex_lock(&p->lock);
+  p->stopping = 1;
+  pthread_cond_broadcast(&p->slot_freed);
+  pthread_mutex_unlock(&p->lock);
+  for (i=0; i<PREFETCH_THREADS; i++) {
+    if (p->started[i]) pthread_join(p->threads[i], NULL);
+  }
+  for (i=0; i<PREFETCH_DEPTH; i++) {
+    if (p->slots[i].buffer) free(p->slots[i].buffer);
+  }
+  pthread_mutex_destroy(&p->lock);
+  pthread_cond_destroy(&p->slot_ready);
+  pthread_cond_destroy(&p->slot_freed);
+#endif
+  free(p);
+}
+/*}}}*/
 struct rfc822 *make_rfc822(char *filename)/*{{{*/
 {
   int len;
   unsigned char *data;
   struct rfc822 *result;
 
-  create_ro_mapping(filename, &data, &len, MAP_DECOMPRESS_IF_APPLICABLE);
+  read_message_file(filename, &data, &len);
 
   /* Don't process empty files */
   result = NULL;
@@ -1484,19 +2166,24 @@ struct rfc822 *make_rfc822(char *filename)/*{{{*/
   return result;
 }
 /*}}}*/
+static void free_headers(struct headers *hdrs)/*{{{*/
+{
+  if (hdrs->to) free(hdrs->to);
+  if (hdrs->cc) free(hdrs->cc);
+  if (hdrs->from) free(hdrs->from);
+  if (hdrs->subject) free(hdrs->subject);
+  if (hdrs->message_id) free(hdrs->message_id);
+  if (hdrs->in_reply_to) free(hdrs->in_reply_to);
+  if (hdrs->references) free(hdrs->references);
+}
+/*}}}*/
 void free_rfc822(struct rfc822 *msg)/*{{{*/
 {
   struct attachment *a, *na;
 
   if (!msg) return;
 
-  if (msg->hdrs.to) free(msg->hdrs.to);
-  if (msg->hdrs.cc) free(msg->hdrs.cc);
-  if (msg->hdrs.from) free(msg->hdrs.from);
-  if (msg->hdrs.subject) free(msg->hdrs.subject);
-  if (msg->hdrs.message_id) free(msg->hdrs.message_id);
-  if (msg->hdrs.in_reply_to) free(msg->hdrs.in_reply_to);
-  if (msg->hdrs.references) free(msg->hdrs.references);
+  free_headers(&msg->hdrs);
 
   for (a = msg->atts.next; a != &msg->atts; a = na) {
     na = a->next;
@@ -1551,7 +2238,7 @@ static void show_rfc822(struct rfc822 *msg, int indent)/*{{{*/
     if (a->ct != CT_MESSAGE_RFC822) {
       printf("%d bytes\n", a->data.normal.len);
     }
-    if ((a->ct == CT_TEXT_PLAIN) || (a->ct == CT_TEXT_HTML) || (a->ct == CT_TEXT_OTHER)) {
+    if ((a->ct == CT_TEXT_PLAIN) || (a->ct == CT_TEXT_HTML)) {
       printf("----------\n");
       printf("%s\n", a->data.normal.bytes);
     }
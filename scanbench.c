@@ -0,0 +1,155 @@
+/*
+  mairix - message index builder and finder for maildir folders.
+
+ **********************************************************************
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ **********************************************************************
+ */
+
+/* Benchmark for the scanners that dfasyn generates from fromcheck.nfa,
+ * nvp.nfa and datescan.nfa.  Each one is built twice (see the scanbench
+ * target in the Makefile) : once with uncompressed transition tables and once
+ * direct-coded (dfasyn -u and -d), both with the next_state function inlined.
+ * The same strings are run through both versions, which must end up in the
+ * same states, and the time taken by each is printed.  The Makefile rules for
+ * the real scanners use whichever came out faster. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "from.h"
+#include "nvptypes.h"
+#include "dates.h"
+
+#include "bench_fromcheck_t.h"
+#include "bench_fromcheck_d.h"
+#include "bench_nvp_t.h"
+#include "bench_nvp_d.h"
+#include "bench_datescan_t.h"
+#include "bench_datescan_d.h"
+
+#define ROUNDS 200000
+
+/* Text following "From " on mbox separator lines, and lines that only look
+ * a bit like them. */
+static const char *from_lines[] = {/*{{{*/
+  "john@example.com Mon Jan  1 00:00:00 2001\n",
+  "MAILER-DAEMON Fri Jul  8 12:08:34 2011\n",
+  "someone@some.where.org  Wed Mar 15 09:30:01 2006 +0100\n",
+  "bounce-123-456@lists.example.net Sat Dec 31 23:59:59 2005 GMT\n",
+  "here on, the discussion moved to the other list.\n",
+  "the desk of the managing director\n",
+  NULL
+};
+/*}}}*/
+/* Content-* header values, as passed to make_nvp() */
+static const char *nvp_lines[] = {/*{{{*/
+  "text/plain; charset=\"us-ascii\"; format=flowed",
+  "multipart/mixed; boundary=\"----=_Part_123_4567890.1136073600000\"",
+  "attachment; filename=\"quarterly report.pdf\"",
+  "application/octet-stream; name=\"data.bin\"",
+  "base64",
+  "inline; filename*0=\"aaaa bbbb cccc \"; filename*1=\"dddd.txt\"",
+  NULL
+};
+/*}}}*/
+/* Date expressions, as used in d: searches */
+static const char *date_lines[] = {/*{{{*/
+  "20060101",
+  "2w",
+  "3m",
+  "jan2006",
+  "15mar2005",
+  "061231",
+  "1y",
+  NULL
+};
+/*}}}*/
+
+#define DEFINE_SCANNER(name, next_state, char2tok, eos)/*{{{*/ \
+static int name(int state, const char *s)                      \
+{                                                              \
+  const unsigned char *p;                                      \
+  for (p = (const unsigned char *) s; *p; p++) {               \
+    state = next_state(state, char2tok[*p]);                   \
+    if (state < 0) return state;                               \
+  }                                                            \
+  return (eos >= 0) ? next_state(state, eos) : state;          \
+}
+/*}}}*/
+
+DEFINE_SCANNER(scan_fromcheck_t, fromcheck_t_next_state, fromcheck_t_char2tok, -1)
+DEFINE_SCANNER(scan_fromcheck_d, fromcheck_d_next_state, fromcheck_d_char2tok, -1)
+DEFINE_SCANNER(scan_nvp_t, nvp_t_next_state, nvp_t_char2tok, nvp_t_EOS)
+DEFINE_SCANNER(scan_nvp_d, nvp_d_next_state, nvp_d_char2tok, nvp_d_EOS)
+DEFINE_SCANNER(scan_datescan_t, datescan_t_next_state, datescan_t_char2tok, -1)
+DEFINE_SCANNER(scan_datescan_d, datescan_d_next_state, datescan_d_char2tok, -1)
+
+static double run(int (*scan)(int, const char *), int start, const char **lines, long *sum)/*{{{*/
+{
+  clock_t t0;
+  const char **l;
+  int i;
+  long total = 0;
+
+  t0 = clock();
+  for (i=0; i<ROUNDS; i++) {
+    for (l=lines; *l; l++) {
+      total += scan(start, *l);
+    }
+  }
+  *sum = total;
+  return (double)(clock() - t0) / CLOCKS_PER_SEC;
+}
+/*}}}*/
+static int compare(const char *name,/*{{{*/
+    int (*scan_t)(int, const char *), int (*scan_d)(int, const char *),
+    int start, const char **lines)
+{
+  const char **l;
+  double tt, td;
+  long sum_t, sum_d;
+
+  for (l=lines; *l; l++) {
+    if (scan_t(start, *l) != scan_d(start, *l)) {
+      fprintf(stderr, "%s: direct-coded scanner disagrees with the tables on \"%s\"\n", name, *l);
+      return 1;
+    }
+  }
+
+  tt = run(scan_t, start, lines, &sum_t);
+  td = run(scan_d, start, lines, &sum_d);
+  if (sum_t != sum_d) {
+    fprintf(stderr, "%s: checksums differ\n", name);
+    return 1;
+  }
+  printf("%-10s tables %6.3fs   direct-coded %6.3fs   (%.2fx)\n",
+      name, tt, td, td > 0.0 ? tt / td : 0.0);
+  return 0;
+}
+/*}}}*/
+int main(int argc, char **argv)/*{{{*/
+{
+  int failed = 0;
+
+  failed |= compare("fromcheck", scan_fromcheck_t, scan_fromcheck_d, 0, from_lines);
+  failed |= compare("nvp", scan_nvp_t, scan_nvp_d, nvp_t_in, nvp_lines);
+  failed |= compare("datescan", scan_datescan_t, scan_datescan_d, 0, date_lines);
+
+  return failed;
+}
+/*}}}*/
@@ -70,6 +70,35 @@ static void mark_hits_in_table2(struct read_db *db, struct toktable2_db *tt, int
   }
 }
 /*}}}*/
+static struct toktable_db *dictionary_field_table(struct read_db *db, int field)/*{{{*/
+{
+  switch (field) {
+    case DICT_TO: return &db->to;
+    case DICT_CC: return &db->cc;
+    case DICT_FROM: return &db->from;
+    case DICT_SUBJECT: return &db->subject;
+    case DICT_BODY: return &db->body;
+    case DICT_ATTACHMENT_NAME: return &db->attachment_name;
+    default: return NULL;
+  }
+}
+/*}}}*/
+static void mark_hits_in_dictionary(struct read_db *db, unsigned int fields, int entry, char *hits)/*{{{*/
+{
+  /* mark files containing the token in any of the fields */
+  unsigned int j;
+  for (j=db->dict.first_ref[entry]; j<db->dict.first_ref[entry+1]; j++) {
+    unsigned int ref = db->dict.refs[j];
+    int field = ref & DICT_FIELD_MASK;
+    unsigned int index = ref >> DICT_FIELD_BITS;
+    struct toktable_db *tt;
+    if (!(fields & (1U << field))) continue;
+    tt = dictionary_field_table(db, field);
+    if (!tt || (index >= tt->n)) continue; /* corrupt */
+    mark_hits_in_table(db, tt, index, hits);
+  }
+}
+/*}}}*/
 
 /* See "Fast text searching with errors, Sun Wu and Udi Manber, TR 91-11,
    University of Arizona.  I have been informed that this algorithm is NOT
@@ -243,10 +272,28 @@ static int substring_match_general(unsigned long *a, unsigned long hit, int left
 }
 /*}}}*/
 
+static inline int substring_match(unsigned long *a, unsigned long hit, int left_anchor, const char *token, int max_errors, unsigned long *r, unsigned long *nr)/*{{{*/
+{
+  switch (max_errors) {
+    /* Optimise common cases for few errors to allow optimizer to keep bitmaps
+     * in registers */
+    case 0:
+      return substring_match_0(a, hit, left_anchor, token);
+    case 1:
+      return substring_match_1(a, hit, left_anchor, token);
+    case 2:
+      return substring_match_2(a, hit, left_anchor, token);
+    case 3:
+      return substring_match_3(a, hit, left_anchor, token);
+    default:
+      return substring_match_general(a, hit, left_anchor, token, max_errors, r, nr);
+  }
+}
+/*}}}*/
 static void match_substring_in_table(struct read_db *db, struct toktable_db *tt, char *substring, int max_errors, int left_anchor, char *hits)/*{{{*/
 {
 
-  int i, got_hit;
+  int i;
   unsigned long a[256];
   unsigned long *r=NULL, *nr=NULL;
   unsigned long hit;
@@ -254,7 +301,6 @@ static void match_substring_in_table(struct read_db *db, struct toktable_db *tt,
 
   build_match_vector(substring, a, &hit);
 
-  got_hit = 0;
   if (max_errors > 3) {
     r = new_array(unsigned long, 1 + max_errors);
     nr = new_array(unsigned long, 1 + max_errors);
@@ -262,26 +308,7 @@ static void match_substring_in_table(struct read_db *db, struct toktable_db *tt,
   for (i=0; i<tt->n; i++) {
     token = get_db_token(db, tt->tok_offsets[i]);
     if (!token) continue;
-    switch (max_errors) {
-      /* Optimise common cases for few errors to allow optimizer to keep bitmaps
-       * in registers */
-      case 0:
-        got_hit = substring_match_0(a, hit, left_anchor, token);
-        break;
-      case 1:
-        got_hit = substring_match_1(a, hit, left_anchor, token);
-        break;
-      case 2:
-        got_hit = substring_match_2(a, hit, left_anchor, token);
-        break;
-      case 3:
-        got_hit = substring_match_3(a, hit, left_anchor, token);
-        break;
-      default:
-        got_hit = substring_match_general(a, hit, left_anchor, token, max_errors, r, nr);
-        break;
-    }
-    if (got_hit) {
+    if (substring_match(a, hit, left_anchor, token, max_errors, r, nr)) {
       mark_hits_in_table(db, tt, i, hits);
     }
   }
@@ -289,6 +316,33 @@ static void match_substring_in_table(struct read_db *db, struct toktable_db *tt,
   if (nr) free(nr);
 }
 /*}}}*/
+static void match_substring_in_dictionary(struct read_db *db, unsigned int fields, char *substring, int max_errors, int left_anchor, char *hits)/*{{{*/
+{
+  /* As match_substring_in_table, but for several fields at once : each
+   * distinct token is matched once, rather than once per table it is in. */
+  int i;
+  unsigned long a[256];
+  unsigned long *r=NULL, *nr=NULL;
+  unsigned long hit;
+  const char *token;
+
+  build_match_vector(substring, a, &hit);
+
+  if (max_errors > 3) {
+    r = new_array(unsigned long, 1 + max_errors);
+    nr = new_array(unsigned long, 1 + max_errors);
+  }
+  for (i=0; i<db->dict.n; i++) {
+    token = get_db_token(db, db->dict.tok_offsets[i]);
+    if (!token) continue;
+    if (substring_match(a, hit, left_anchor, token, max_errors, r, nr)) {
+      mark_hits_in_dictionary(db, fields, i, hits);
+    }
+  }
+  if (r)  free(r);
+  if (nr) free(nr);
+}
+/*}}}*/
 static void match_substring_in_paths(struct read_db *db, char *substring, int max_errors, int left_anchor, char *hits)/*{{{*/
 {
 
@@ -321,25 +375,7 @@ static void match_substring_in_paths(struct read_db *db, char *substring, int ma
 
     assert(token);
 
-    switch (max_errors) {
-      /* Optimise common cases for few errors to allow optimizer to keep bitmaps
-       * in registers */
-      case 0:
-        hits[i] = substring_match_0(a, hit, left_anchor, token);
-        break;
-      case 1:
-        hits[i] = substring_match_1(a, hit, left_anchor, token);
-        break;
-      case 2:
-        hits[i] = substring_match_2(a, hit, left_anchor, token);
-        break;
-      case 3:
-        hits[i] = substring_match_3(a, hit, left_anchor, token);
-        break;
-      default:
-        hits[i] = substring_match_general(a, hit, left_anchor, token, max_errors, r, nr);
-        break;
-    }
+    hits[i] = substring_match(a, hit, left_anchor, token, max_errors, r, nr);
 next_message:
     (void) 0;
   }
@@ -363,6 +399,21 @@ static void match_string_in_table(struct read_db *db, struct toktable_db *tt, ch
   }
 }
 /*}}}*/
+static void match_string_in_dictionary(struct read_db *db, unsigned int fields, char *key, char *hits)/*{{{*/
+{
+  int i;
+  const char *token;
+
+  for (i=0; i<db->dict.n; i++) {
+    token = get_db_token(db, db->dict.tok_offsets[i]);
+    if (token && !strcmp(key, token)) {
+      /* Dictionary entries are distinct, so this is the only one */
+      mark_hits_in_dictionary(db, fields, i, hits);
+      break;
+    }
+  }
+}
+/*}}}*/
 static void match_string_in_table2(struct read_db *db, struct toktable2_db *tt, char *key, char *hits)/*{{{*/
 {
   /* TODO : replace with binary search? */
@@ -778,15 +829,19 @@ static void get_flags_from_file(struct read_db *db, int idx, int *is_seen, int *
   *is_flagged = (db->msg_type_and_flags[idx] & FLAG_FLAGGED) ? 1 : 0;
 }
 
-static void string_tolower(char *str)
+static char *canonicalise_word(char *word)
 {
-  char *p;
-  for (p=str; *p; p++) {
-    unsigned char c = *(unsigned char *)p;
-    if ((c >= 'A') && (c <= 'Z')) {
-      *p = c + ('a' - 'A');
-    }
-  }
+  /* Return a new copy of word in the same form as the tokens in the
+   * database : UTF-8 (taking it as windows-1252 if it isn't valid UTF-8) and
+   * case folded. */
+  char *buf = NULL;
+  int buf_size = 0;
+  char *result;
+
+  result = text_to_utf8(NULL, word, strlen(word), NULL, &buf, &buf_size);
+  if (result == word) result = new_string(word);
+  fold_case(result);
+  return result;
 }
 
 typedef struct {
@@ -810,6 +865,7 @@ static int do_search(struct read_db *db, char **args, char *output_path, int sho
   int do_att_name;
   int do_flags;
   int do_path, do_msgid;
+  unsigned int fields;
   char *key;
   char *hit0, *hit1, *hit2, *hit3;
   int i;
@@ -903,6 +959,16 @@ static int do_search(struct read_db *db, char **args, char *output_path, int sho
       start_words = key;
     }
 
+    /* Fields to search through the dictionary, when there are several */
+    fields = 0;
+    if (do_to) fields |= 1U << DICT_TO;
+    if (do_cc) fields |= 1U << DICT_CC;
+    if (do_from) fields |= 1U << DICT_FROM;
+    if (do_subject) fields |= 1U << DICT_SUBJECT;
+    if (do_body) fields |= 1U << DICT_BODY;
+    if (do_att_name) fields |= 1U << DICT_ATTACHMENT_NAME;
+    if (!(fields & (fields - 1))) fields = 0;
+
     if (do_date || do_size || do_flags) {
       memset(hit0, 0, db->n_msgs);
       if (do_date) {
@@ -918,8 +984,7 @@ static int do_search(struct read_db *db, char **args, char *output_path, int sho
         hit1[i] &= hit0[i];
       }
     } else if (do_msgid) {
-      char *lower_word = new_string(start_words);
-      string_tolower(lower_word);
+      char *lower_word = canonicalise_word(start_words);
       memset(hit0, 0, db->n_msgs);
       match_string_in_table2(db, &db->msg_ids, lower_word, hit0);
       free(lower_word);
@@ -1000,11 +1065,13 @@ static int do_search(struct read_db *db, char **args, char *output_path, int sho
 
       /* Canonicalise search string to lowercase, since the database has all
        * tokens handled that way.  But not for path search! */
-      lower_word = new_string(word);
-      string_tolower(lower_word);
+      lower_word = canonicalise_word(word);
 
       memset(hit0, 0, db->n_msgs);
-      if (equal) {
+      if (equal && fields) {
+        match_substring_in_dictionary(db, fields, lower_word, max_errors, left_anchor, hit0);
+        if (do_path) match_substring_in_paths(db, word, max_errors, left_anchor, hit0);
+      } else if (equal) {
         if (do_to) match_substring_in_table(db, &db->to, lower_word, max_errors, left_anchor, hit0);
         if (do_cc) match_substring_in_table(db, &db->cc, lower_word, max_errors, left_anchor, hit0);
         if (do_from) match_substring_in_table(db, &db->from, lower_word, max_errors, left_anchor, hit0);
@@ -1012,6 +1079,10 @@ static int do_search(struct read_db *db, char **args, char *output_path, int sho
         if (do_body) match_substring_in_table(db, &db->body, lower_word, max_errors, left_anchor, hit0);
         if (do_att_name) match_substring_in_table(db, &db->attachment_name, lower_word, max_errors, left_anchor, hit0);
         if (do_path) match_substring_in_paths(db, word, max_errors, left_anchor, hit0);
+      } else if (fields) {
+        match_string_in_dictionary(db, fields, lower_word, hit0);
+        /* FIXME */
+        if (do_path) match_substring_in_paths(db, word, 0, left_anchor, hit0);
       } else {
         if (do_to) match_string_in_table(db, &db->to, lower_word, hit0);
         if (do_cc) match_string_in_table(db, &db->cc, lower_word, hit0);
@@ -1080,17 +1151,23 @@ static int do_search(struct read_db *db, char **args, char *output_path, int sho
   results = new_array(searchResult, db->n_msgs);
   if (sort_by_date) {
     searchResult *cur = results;
+    int in_order = 1;
 
     for (i=0; i<db->n_msgs; i++) {
       results[i].m_seq_num = -1;
       if (hit3[i] && rd_msg_type(db, i) != DB_MSG_DEAD) {
         cur->m_db_id = i;
         cur->m_date = (int) db->date_table[i];
+        if ((cur > results) && (cur->m_date < cur[-1].m_date)) in_order = 0;
         ++cur;
       }
     }
     n_hits = cur - results;
-    qsort(results, n_hits, sizeof(*results), db_date_cmp);
+    /* A database purged with index_order set has its messages in date order
+     * already */
+    if (!in_order) {
+      qsort(results, n_hits, sizeof(*results), db_date_cmp);
+    }
     for (i=0; i<n_hits; i++)
       results[results[i].m_db_id].m_seq_num = i;
   } else {
@@ -0,0 +1,546 @@
+/*
+  mairix - message index builder and finder for maildir folders.
+
+ **********************************************************************
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ **********************************************************************
+ */
+
+/* Indexing within a memory budget.  Once the token tables built up while
+ * indexing take more than max_token_memory, the word tables (to, cc, from,
+ * subject, body and attachment name) are written out as a 'run' : a temporary
+ * file holding their tokens sorted on the text, each with its list of
+ * messages.  The tables then start again empty.  When the database is
+ * written, the runs are merged to give the final tables a token at a time, so
+ * the tables for the whole database never have to be in memory at once.
+ *
+ * The messages are numbered in the order they're tokenised, so the messages
+ * in one run all come after those in the runs before it.  Merging the lists
+ * for a token is then just a matter of joining them up in run order.
+ *
+ * The message ID table is always kept in memory, since the threading needs
+ * all of it. */
+
+#include "mairix.h"
+#include "reader.h"
+#include "memmac.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <assert.h>
+
+/* Marks the end of a run, in place of a field number */
+#define END_OF_RUN 0xff
+
+/* Once this many runs of the same size have built up at the end of the list,
+ * they're merged into one, so that only a few runs are open at any time. */
+#define RUNS_PER_LEVEL 16
+
+size_t max_token_memory = 0;
+const char *spill_path = NULL;
+
+struct spill {/*{{{*/
+  int n_runs;
+  int max_runs;
+  FILE **runs;
+  int *levels; /* how many merges went into each run */
+
+  /* Renumbering of the messages from culling the dead ones, or NULL */
+  int *new_idx;
+  int n_old;
+};
+/*}}}*/
+struct spilled_token {/*{{{*/
+  const char *text;
+  int len;
+  int field;
+  struct matches *match0;
+};
+/*}}}*/
+struct run_reader {/*{{{*/
+  FILE *file;
+  int field; /* of the current token */
+  char *text;
+  int len;
+  int text_size;
+  unsigned char *enc;
+  int enc_n;
+  int enc_size;
+  unsigned int highest;
+};
+/*}}}*/
+struct spill_merge {/*{{{*/
+  int n_readers;
+  struct run_reader *readers;
+  /* Min-heap of the readers that haven't reached the end of their run */
+  struct run_reader **heap;
+  int n_heap;
+
+  /* Renumbering of the messages to apply, or NULL */
+  int *new_idx;
+  int n_old;
+  /* The renumbered messages for the current token, to be sorted */
+  int *sorted;
+  int n_sorted;
+  int max_sorted;
+
+  /* The current merged token */
+  char *text;
+  int text_size;
+  struct matches match0;
+};
+/*}}}*/
+
+static void put_number(FILE *f, unsigned int x)/*{{{*/
+{
+  while (x >= 0x80) {
+    putc((x & 0x7f) | 0x80, f);
+    x >>= 7;
+  }
+  putc(x, f);
+}
+/*}}}*/
+static unsigned int get_number(FILE *f)/*{{{*/
+{
+  unsigned int x = 0;
+  int shift = 0;
+  int c;
+  do {
+    c = getc(f);
+    if (c == EOF) {
+      fprintf(stderr, "Unexpected end of spilled token run\n");
+      unlock_and_exit(2);
+    }
+    x |= (unsigned int)(c & 0x7f) << shift;
+    shift += 7;
+  } while (c & 0x80);
+  return x;
+}
+/*}}}*/
+static int compare_keys(const char *text1, int len1, int field1, const char *text2, int len2, int field2)/*{{{*/
+{
+  int result = memcmp(text1, text2, (len1 < len2) ? len1 : len2);
+  if (result) return result;
+  if (len1 != len2) return len1 - len2;
+  return field1 - field2;
+}
+/*}}}*/
+static int compare_spilled_tokens(const void *a, const void *b)/*{{{*/
+{
+  const struct spilled_token *aa = (const struct spilled_token *) a;
+  const struct spilled_token *bb = (const struct spilled_token *) b;
+  return compare_keys(aa->text, aa->len, aa->field, bb->text, bb->len, bb->field);
+}
+/*}}}*/
+static FILE *open_run_file(void)/*{{{*/
+{
+  /* Runs are kept beside the database, where there is presumably room for
+   * something of its size, rather than in /tmp.  The file is unlinked
+   * straight away so that it goes however mairix exits. */
+  char *name;
+  int fd, i;
+  FILE *result;
+
+  name = new_array(char, strlen(spill_path) + 32);
+  for (i=0; ; i++) {
+    sprintf(name, "%s.run%d", spill_path, i);
+    fd = open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd >= 0) break;
+    if (errno != EEXIST) {
+      report_error("open", name);
+      unlock_and_exit(2);
+    }
+  }
+  unlink(name);
+  free(name);
+
+  result = fdopen(fd, "w+");
+  if (!result) {
+    perror("fdopen");
+    unlock_and_exit(2);
+  }
+  return result;
+}
+/*}}}*/
+static void write_run_token(FILE *out, int field, const char *text, int len, const struct matches *match0)/*{{{*/
+{
+  putc(field, out);
+  put_number(out, len);
+  fwrite(text, 1, len, out);
+  put_number(out, match0->n);
+  put_number(out, match0->highest);
+  fwrite(match0->msginfo, 1, match0->n, out);
+}
+/*}}}*/
+static void end_run(FILE *out)/*{{{*/
+{
+  putc(END_OF_RUN, out);
+  if (fflush(out) || ferror(out)) {
+    perror("Could not write spilled token run");
+    unlock_and_exit(2);
+  }
+}
+/*}}}*/
+static struct spill_merge *start_merge(FILE **runs, int n_runs, int *new_idx, int n_old);
+static void merge_last_runs(struct spill *s, int n)/*{{{*/
+{
+  /* Replace the last n runs by one.  Their messages are left numbered as
+   * they are; any renumbering is done in the final merge. */
+  struct spill_merge *m;
+  const struct matches *match0;
+  const char *text;
+  int field, len, i, first;
+  FILE *out;
+
+  first = s->n_runs - n;
+  out = open_run_file();
+  m = start_merge(s->runs + first, n, NULL, 0);
+  while (next_merged_token(m, &field, &text, &len, &match0)) {
+    write_run_token(out, field, text, len, match0);
+  }
+  end_spill_merge(m);
+  end_run(out);
+
+  for (i=first; i<s->n_runs; i++) {
+    fclose(s->runs[i]);
+  }
+  s->runs[first] = out;
+  s->levels[first]++;
+  s->n_runs = first + 1;
+}
+/*}}}*/
+void spill_toktables(struct database *db)/*{{{*/
+{
+  struct toktable **tables[N_DICT_FIELDS];
+  struct spilled_token *toks;
+  struct spill *s;
+  FILE *out;
+  int f, i, n;
+
+  tables[DICT_TO] = &db->to;
+  tables[DICT_CC] = &db->cc;
+  tables[DICT_FROM] = &db->from;
+  tables[DICT_SUBJECT] = &db->subject;
+  tables[DICT_BODY] = &db->body;
+  tables[DICT_ATTACHMENT_NAME] = &db->attachment_name;
+
+  if (!db->spill) {
+    s = db->spill = new(struct spill);
+    s->n_runs = 0;
+    s->max_runs = 0;
+    s->runs = NULL;
+    s->levels = NULL;
+    s->new_idx = NULL;
+    s->n_old = 0;
+  }
+  s = db->spill;
+
+  n = 0;
+  for (f=0; f<N_DICT_FIELDS; f++) {
+    n += (*tables[f])->n;
+  }
+  toks = new_array(struct spilled_token, n + 1);
+  for (f=0, n=0; f<N_DICT_FIELDS; f++) {
+    struct toktable *tab = *tables[f];
+    for (i=0; i<tab->size; i++) {
+      if (tab->tokens[i]) {
+        toks[n].text = tab->tokens[i]->text;
+        toks[n].len = tab->slots[i].len;
+        toks[n].field = f;
+        toks[n].match0 = &tab->tokens[i]->match0;
+        n++;
+      }
+    }
+  }
+  if (n > 0) {
+    qsort(toks, n, sizeof(struct spilled_token), compare_spilled_tokens);
+
+    out = open_run_file();
+    for (i=0; i<n; i++) {
+      write_run_token(out, toks[i].field, toks[i].text, toks[i].len, toks[i].match0);
+    }
+    end_run(out);
+
+    if (s->n_runs == s->max_runs) {
+      s->max_runs += 16;
+      s->runs = grow_array(FILE *, s->max_runs, s->runs);
+      s->levels = grow_array(int, s->max_runs, s->levels);
+    }
+    s->runs[s->n_runs] = out;
+    s->levels[s->n_runs] = 0;
+    s->n_runs++;
+
+    /* The runs' levels never go up along the list, so a full set of runs at
+     * one level is always at the end */
+    while ((s->n_runs >= RUNS_PER_LEVEL) &&
+           (s->levels[s->n_runs - RUNS_PER_LEVEL] == s->levels[s->n_runs - 1])) {
+      merge_last_runs(s, RUNS_PER_LEVEL);
+    }
+
+    if (verbose) {
+      fprintf(stderr, "Spilled %d tokens to disk (%d runs)\n", n, s->n_runs);
+    }
+  }
+  free(toks);
+
+  for (f=0; f<N_DICT_FIELDS; f++) {
+    free_toktable(*tables[f]);
+    *tables[f] = new_toktable();
+  }
+  reset_token_filter();
+  token_memory = 0;
+}
+/*}}}*/
+void check_token_memory(struct database *db)/*{{{*/
+{
+  if (max_token_memory && (token_memory > max_token_memory)) {
+    spill_toktables(db);
+  }
+}
+/*}}}*/
+void recode_spilled_tables(struct spill *s, int *new_idx, int n_old)/*{{{*/
+{
+  /* Note how the messages in the runs are to be renumbered when they are
+   * merged.  If they have been renumbered already, the two steps combine. */
+  int i;
+  if (s->new_idx) {
+    for (i=0; i<s->n_old; i++) {
+      if (s->new_idx[i] >= 0) {
+        s->new_idx[i] = new_idx[s->new_idx[i]];
+      }
+    }
+  } else {
+    s->new_idx = new_array(int, n_old);
+    memcpy(s->new_idx, new_idx, n_old * sizeof(int));
+    s->n_old = n_old;
+  }
+}
+/*}}}*/
+void free_spill(struct spill *s)/*{{{*/
+{
+  int i;
+  for (i=0; i<s->n_runs; i++) {
+    fclose(s->runs[i]);
+  }
+  if (s->runs) free(s->runs);
+  if (s->levels) free(s->levels);
+  if (s->new_idx) free(s->new_idx);
+  free(s);
+}
+/*}}}*/
+
+static int read_run_token(struct run_reader *r)/*{{{*/
+{
+  /* Return 0 at the end of the run */
+  int c;
+
+  c = getc(r->file);
+  if ((c == EOF) || (c == END_OF_RUN)) return 0;
+  r->field = c;
+
+  r->len = get_number(r->file);
+  if (r->len + 1 > r->text_size) {
+    r->text_size = r->len + 64;
+    r->text = grow_array(char, r->text_size, r->text);
+  }
+  if (fread(r->text, 1, r->len, r->file) != r->len) goto truncated;
+  r->text[r->len] = '\0';
+
+  r->enc_n = get_number(r->file);
+  r->highest = get_number(r->file);
+  if (r->enc_n > r->enc_size) {
+    r->enc_size = r->enc_n + 64;
+    r->enc = grow_array(unsigned char, r->enc_size, r->enc);
+  }
+  if (fread(r->enc, 1, r->enc_n, r->file) != r->enc_n) goto truncated;
+  return 1;
+
+truncated:
+  fprintf(stderr, "Unexpected end of spilled token run\n");
+  unlock_and_exit(2);
+  return 0;
+}
+/*}}}*/
+static inline int reader_before(struct run_reader *a, struct run_reader *b)/*{{{*/
+{
+  int result = compare_keys(a->text, a->len, a->field, b->text, b->len, b->field);
+  /* The same token in two runs : the earlier run's messages come first */
+  return (result < 0) || ((result == 0) && (a < b));
+}
+/*}}}*/
+static void sift_down(struct spill_merge *m, int i)/*{{{*/
+{
+  struct run_reader *r = m->heap[i];
+  for (;;) {
+    int child = 2 * i + 1;
+    if (child >= m->n_heap) break;
+    if ((child + 1 < m->n_heap) && reader_before(m->heap[child + 1], m->heap[child])) {
+      child++;
+    }
+    if (!reader_before(m->heap[child], r)) break;
+    m->heap[i] = m->heap[child];
+    i = child;
+  }
+  m->heap[i] = r;
+}
+/*}}}*/
+static struct spill_merge *start_merge(FILE **runs, int n_runs, int *new_idx, int n_old)/*{{{*/
+{
+  struct spill_merge *m;
+  int i;
+
+  m = new(struct spill_merge);
+  m->n_readers = n_runs;
+  m->readers = new_array(struct run_reader, n_runs + 1);
+  m->heap = new_array(struct run_reader *, n_runs + 1);
+  m->n_heap = 0;
+  m->new_idx = new_idx;
+  m->n_old = n_old;
+  m->sorted = NULL;
+  m->n_sorted = 0;
+  m->max_sorted = 0;
+  m->text = NULL;
+  m->text_size = 0;
+  m->match0.msginfo = NULL;
+  m->match0.n = 0;
+  m->match0.max = 0;
+  m->match0.highest = 0;
+
+  for (i=0; i<n_runs; i++) {
+    struct run_reader *r = &m->readers[i];
+    r->file = runs[i];
+    r->text = NULL;
+    r->text_size = 0;
+    r->enc = NULL;
+    r->enc_size = 0;
+    rewind(r->file);
+    if (read_run_token(r)) {
+      m->heap[m->n_heap++] = r;
+    }
+  }
+  for (i=m->n_heap/2 - 1; i>=0; i--) {
+    sift_down(m, i);
+  }
+  return m;
+}
+/*}}}*/
+struct spill_merge *start_spill_merge(struct spill *s)/*{{{*/
+{
+  return start_merge(s->runs, s->n_runs, s->new_idx, s->n_old);
+}
+/*}}}*/
+static void append_postings(struct spill_merge *m, struct run_reader *r)/*{{{*/
+{
+  struct matches src;
+  struct int_list_reader ilr;
+  int idx, rest;
+
+  src.msginfo = r->enc;
+  src.n = src.max = r->enc_n;
+  src.highest = r->highest;
+  matches_int_list_reader_init(&ilr, &src);
+
+  if (!m->new_idx) {
+    /* Only the first entry in the list changes, from an index to an
+     * increment from the last entry of the list so far */
+    if (!int_list_reader_read(&ilr, &idx)) return;
+    insert_index_on_encoding(&m->match0, idx);
+    rest = ilr.end - ilr.pos;
+    enlarge_encoding(&m->match0, rest);
+    memcpy(m->match0.msginfo + m->match0.n, ilr.pos, rest);
+    m->match0.n += rest;
+    m->match0.highest = r->highest;
+  } else {
+    /* Purging with message_order set may have put the messages in a new
+     * order, so collect the list up to sort it */
+    while (int_list_reader_read(&ilr, &idx)) {
+      assert(idx < m->n_old);
+      idx = m->new_idx[idx];
+      if (idx >= 0) {
+        if (m->n_sorted == m->max_sorted) {
+          m->max_sorted = m->max_sorted ? (m->max_sorted << 1) : 256;
+          m->sorted = grow_array(int, m->max_sorted, m->sorted);
+        }
+        m->sorted[m->n_sorted++] = idx;
+      }
+    }
+  }
+}
+/*}}}*/
+int next_merged_token(struct spill_merge *m, int *field, const char **text, int *len, const struct matches **match0)/*{{{*/
+{
+  /* Get the next token of the merged tables, in order of text and then
+   * field.  Return 0 once there are no more. */
+  struct run_reader *r;
+
+  while (m->n_heap > 0) {
+    r = m->heap[0];
+    *field = r->field;
+    *len = r->len;
+    if (r->len + 1 > m->text_size) {
+      m->text_size = r->len + 64;
+      m->text = grow_array(char, m->text_size, m->text);
+    }
+    memcpy(m->text, r->text, r->len + 1);
+    m->match0.n = 0;
+    m->match0.highest = 0;
+    m->n_sorted = 0;
+
+    do {
+      append_postings(m, r);
+      if (!read_run_token(r)) {
+        m->heap[0] = m->heap[--m->n_heap];
+      }
+      if (m->n_heap > 0) sift_down(m, 0);
+      r = m->heap[0];
+    } while ((m->n_heap > 0) &&
+             !compare_keys(r->text, r->len, r->field, m->text, *len, *field));
+
+    if (m->n_sorted) {
+      int i;
+      qsort(m->sorted, m->n_sorted, sizeof(int), compare_ints);
+      for (i=0; i<m->n_sorted; i++) {
+        insert_index_on_encoding(&m->match0, m->sorted[i]);
+      }
+    }
+
+    /* A token only in messages that have been culled is dropped */
+    if (m->match0.n > 0) {
+      *text = m->text;
+      *match0 = &m->match0;
+      return 1;
+    }
+  }
+  return 0;
+}
+/*}}}*/
+void end_spill_merge(struct spill_merge *m)/*{{{*/
+{
+  int i;
+  for (i=0; i<m->n_readers; i++) {
+    if (m->readers[i].text) free(m->readers[i].text);
+    if (m->readers[i].enc) free(m->readers[i].enc);
+  }
+  free(m->readers);
+  free(m->heap);
+  if (m->text) free(m->text);
+  free_encoding(&m->match0);
+  if (m->sorted) free(m->sorted);
+  free(m);
+}
+/*}}}*/
@@ -238,6 +238,7 @@ mh=${CONF_MH#:}
 mbox=${CONF_MBOX#:}
 mfolder=${SEARCH_RESULT_DIR_ABS}
 mformat=${SEARCH_RESULT_FORMAT}
+${CONF_OPTIONS}
 EOF
 }
 
@@ -377,6 +378,24 @@ published_conf_set_mformat () {
     generate_mairix_rc
 }
 
+#--------------------------------------------------------------------------
+# sets a further option in the mairix configuration, and regenerates the
+# mairix rc file.
+#--
+# $1 - the name of the option, either "checkpoint_interval" or
+#      "index_order"
+# $2 - the value of the option
+#
+published_conf_set () {
+    [[ $# -eq 2 ]] || error "The published conf_set requires exactly two arguments, but received $# arguments."
+    local NAME="$1"
+    local VALUE="$2"
+    [[ "checkpoint_interval" = "$NAME" || "index_order" = "$NAME" ]] || error "The option \"$NAME\" may not be set by conf_set"
+    CONF_OPTIONS="$(echo "$CONF_OPTIONS" | grep -v "^$NAME=")
+$NAME=$VALUE"
+    generate_mairix_rc
+}
+
 ###########################################################################
 #
 # Adding, removing and searching messages
@@ -518,6 +537,54 @@ published_add_messages() {
     done
 }
 
+#--------------------------------------------------------------------------
+# adds an mbox to the database and configuration file like add_messages,
+# but interrupts mairix while it is indexing the mbox. mairix is then run
+# again, to index the messages left over.
+#--
+# $1 - The format of the messages. Only "mbox" is supported.
+# $2 - The mbox to add, relative to $MBOX_DIR_ABS. It has to hold well
+#      over 1000 messages, so mairix can be caught while indexing it.
+#
+published_add_messages_interrupted() {
+    [[ $# -eq 2 ]] || error "add_messages_interrupted requires exactly two arguments, but received $# arguments."
+    [[ "mbox" = "$1" ]] || error "add_messages_interrupted is only implemented for mbox"
+    local SOURCE_FILE_RELU="$2"
+    local SOURCE_FILE_RELB="${MBOX_DIR_RELD}/${SOURCE_FILE_RELU}"
+    local TARGET_FILE_ABS="$MBOX_DIR_ABS/$SOURCE_FILE_RELU"
+    set_file_variable_RELD INTERRUPTED_RUN "interrupted_run.log"
+
+    conf_add_mbox "${SOURCE_FILE_RELB}"
+    assert_file_exists_is_file "$SOURCE_FILE_RELB"
+    mkdir -p "$(dirname "$TARGET_FILE_ABS" )"
+    cp "$SOURCE_FILE_RELB" "$TARGET_FILE_ABS"
+
+    # When run verbosely, mairix prints each message it indexes. We
+    # interrupt it once it got to the 1000th message of the mbox. It then
+    # saves the messages indexed so far, and exits with status 7.
+    "$MAIRIX_EXE_FILE_RELB" \
+	--force-hash-key-new-database "$HASH_KEY" \
+	--rcfile "$MAIRIX_RC_FILE_ABS" \
+	"${INDEX_OPTIONS[@]}" -v >"$INTERRUPTED_RUN_FILE_ABS" 2>&1 &
+    local PID=$!
+    while kill -0 $PID 2>/dev/null && ! grep -q '\[1000\] at' "$INTERRUPTED_RUN_FILE_ABS"
+    do
+	sleep 0.01
+    done
+    kill -INT $PID 2>/dev/null || true
+    local STATUS=0
+    wait $PID || STATUS=$?
+    [[ "$STATUS" = "7" ]] || error "mairix exited with status $STATUS, instead of being interrupted while indexing. Its output can be found in \"$INTERRUPTED_RUN_FILE_ABS\""
+    grep -q "indexed so far have been saved" "$INTERRUPTED_RUN_FILE_ABS" || error "mairix did not save the messages indexed before being interrupted. Its output can be found in \"$INTERRUPTED_RUN_FILE_ABS\""
+    log "mairix interrupted after indexing $(grep -c '\] at \[' "$INTERRUPTED_RUN_FILE_ABS") messages"
+
+    update_database
+
+    if [ manymessages != "$SOURCE_FILE_RELU" ]; then
+	"${SCRIPT_DIR_ABS}/split_mbox.sh" "$TARGET_FILE_ABS"
+    fi
+}
+
 #--------------------------------------------------------------------------
 # removes messages from the database and configuration file.
 # No purging is done
@@ -967,7 +1034,7 @@ run_mairix() {
 #
 update_database () {
     [[ $# -eq 0 ]] || error "update_database does not accept arguments, but received $# arguments."
-    run_mairix "$MARKER_NO_DUMP" 2>"$DATA_DIR_ABS/update_database.stderr"
+    run_mairix "$MARKER_NO_DUMP" "${INDEX_OPTIONS[@]}" 2>"$DATA_DIR_ABS/update_database.stderr"
     if [ -s "$DATA_DIR_ABS/update_database.stderr" ]; then
       echo "mairix unexpectedly emited error output:"
       echo "<<<<<"
@@ -1011,7 +1078,106 @@ published_assert_dump() {
     published_dump_database "$CURRENT_STATE_DUMP_FILE_ABS"
 
     # Continue only, if the towdumps match
-    diff -q "$GOOD_DUMP_FILE_RELB" "$CURRENT_STATE_DUMP_FILE_ABS" &>/dev/null || error "The current state of the database does not match the asserted dump \"$GOOD_DUMP_FILE_RELB\". A dump of the current database con be found in \"$CURRENT_STATE_DUMP_FILE_ABS\""
+    assert_dumps_match "$GOOD_DUMP_FILE_RELB" "the asserted dump \"$GOOD_DUMP_FILE_RELB\""
+}
+
+#--------------------------------------------------------------------------
+# asserts that the dump of the current database (as written by
+# published_assert_dump) matches the given dump. If ignore_word_order has
+# been given, the order of words in the tables is not compared.
+#--
+# $1 - the dump to compare against (either absolute, or relative to the
+#      base directory)
+# $2 - a description of $1 for the error message
+#
+assert_dumps_match() {
+    [[ $# -eq 2 ]] || error "assert_dumps_match requires exactly two arguments, but received $# arguments."
+    local GOOD_DUMP_FILE_UNSP="$1"
+
+    if [ "$IGNORE_WORD_ORDER" = "0" ]
+    then
+	diff -q "$GOOD_DUMP_FILE_UNSP" "$CURRENT_STATE_DUMP_FILE_ABS" &>/dev/null || error "The current state of the database does not match $2. A dump of the current database con be found in \"$CURRENT_STATE_DUMP_FILE_ABS\""
+    else
+	normalize_dump_word_order "$GOOD_DUMP_FILE_UNSP" >"$CURRENT_STATE_DUMP_FILE_ABS.good-normalized"
+	normalize_dump_word_order "$CURRENT_STATE_DUMP_FILE_ABS" >"$CURRENT_STATE_DUMP_FILE_ABS.normalized"
+	diff -q "$CURRENT_STATE_DUMP_FILE_ABS.good-normalized" "$CURRENT_STATE_DUMP_FILE_ABS.normalized" &>/dev/null || error "The current state of the database does not match $2, even ignoring the order of words. A dump of the current database con be found in \"$CURRENT_STATE_DUMP_FILE_ABS\""
+    fi
+}
+
+#--------------------------------------------------------------------------
+# asserts that the current database matches a database built from scratch
+# over the configured folders by a single run of mairix, without the
+# options given to set_index_options, and that the given searches find the
+# same messages in both databases. The fresh database is purged as it gets
+# built, so its messages are put in the configured index_order as well.
+#--
+# $1, $2, ... - the searches to run on both databases, with and without
+#               -t. Each search consists of a single expression.
+#
+published_assert_same_as_fresh_index() {
+    set_file_variable_RELD FRESH_MAIRIX_RC "mairixrc.fresh"
+    set_file_variable_RELD FRESH_DATABASE  "fresh-database"
+    set_file_variable_RELD FRESH_DUMP      "fresh-database.dump"
+    set_file_variable_RELD FRESH_SEARCHES  "fresh-searches"
+    set_file_variable_RELD SEARCHES        "searches"
+
+    sed -e "s#^database=.*#database=$FRESH_DATABASE_FILE_ABS#" "$MAIRIX_RC_FILE_ABS" >"$FRESH_MAIRIX_RC_FILE_ABS"
+    rm -f "$FRESH_DATABASE_FILE_ABS"
+    local CURRENT_MAIRIX_RC_FILE_ABS="$MAIRIX_RC_FILE_ABS"
+    MAIRIX_RC_FILE_ABS="$FRESH_MAIRIX_RC_FILE_ABS"
+    run_mairix "$MARKER_NO_DUMP" --purge
+    published_dump_database "$FRESH_DUMP_FILE_ABS"
+    run_searches "$@" >"$FRESH_SEARCHES_FILE_ABS"
+    MAIRIX_RC_FILE_ABS="$CURRENT_MAIRIX_RC_FILE_ABS"
+
+    published_dump_database "$CURRENT_STATE_DUMP_FILE_ABS"
+
+    # The thread ids just tell the threads apart. They depend on the order
+    # in which the messages were found, so both dumps get them numbered
+    # afresh, in the order the threads first show up.
+    renumber_dump_thread_ids "$FRESH_DUMP_FILE_ABS"
+    renumber_dump_thread_ids "$CURRENT_STATE_DUMP_FILE_ABS"
+    assert_dumps_match "$FRESH_DUMP_FILE_ABS" "a database built from scratch"
+
+    run_searches "$@" >"$SEARCHES_FILE_ABS"
+    diff -q "$FRESH_SEARCHES_FILE_ABS" "$SEARCHES_FILE_ABS" &>/dev/null || error "The searches on the current database did not match the same messages as on a database built from scratch. Compare \"$SEARCHES_FILE_ABS\" to \"$FRESH_SEARCHES_FILE_ABS\""
+}
+
+#--------------------------------------------------------------------------
+# renumbers the thread ids in a dump, in the order the threads first show
+# up in the list of messages.
+#--
+# $1 - the dump to renumber the thread ids in. It gets overwritten.
+#
+renumber_dump_thread_ids() {
+    [[ $# -eq 1 ]] || error "renumber_dump_thread_ids requires exactly one argument, but received $# arguments."
+    awk '
+	match($0, /, tid=[0-9]+/) {
+	    TID = substr($0, RSTART + 6, RLENGTH - 6)
+	    if (!(TID in NEW_TID)) NEW_TID[TID] = N_TIDS++
+	    $0 = substr($0, 1, RSTART + 5) NEW_TID[TID] substr($0, RSTART + RLENGTH)
+	}
+	{ print }
+    ' "$1" >"$1.renumbered"
+    mv "$1.renumbered" "$1"
+}
+
+#--------------------------------------------------------------------------
+# runs searches on the database, both with and without -t, and outputs the
+# sorted paths of the matched messages for each of them.
+#--
+# $1, $2, ... - the searches to run. Each search consists of a single
+#               expression.
+#
+run_searches() {
+    local EXPR
+    for EXPR in "$@"
+    do
+	echo "== $EXPR"
+	run_mairix "$MARKER_NO_DUMP" -r "$EXPR" | LC_ALL=C sort
+	echo "== -t $EXPR"
+	run_mairix "$MARKER_NO_DUMP" -r -t "$EXPR" | LC_ALL=C sort
+    done
 }
 
 #--------------------------------------------------------------------------
@@ -1032,7 +1198,63 @@ published_purge_database() {
 	error "\"$MARKER_NO_DUMP\" is reserved and may not be used as name for a dump."
     fi
 
-    run_mairix "$1" --purge
+    run_mairix "$1" "${INDEX_OPTIONS[@]}" --purge
+}
+
+#--------------------------------------------------------------------------
+# sets options passed to mairix whenever it updates or purges the database
+# (but not when searching or dumping it).
+#--
+# $1, $2, ... - the options, replacing any set before. Only options that
+#               affect how the database is built are allowed.
+#
+published_set_index_options() {
+    local PARAM
+    for PARAM in "$@"
+    do
+	case "$PARAM" in
+	    "--max-memory" | [0-9]* )
+		;;
+	    * )
+		error "\"$PARAM\" is not an option that may be set for indexing"
+		;;
+	esac
+    done
+    INDEX_OPTIONS=( "$@" )
+}
+
+#--------------------------------------------------------------------------
+# makes all later comparisons of the database against dumps ignore the
+# order in which the words of each table are listed. That order is just the
+# order of mairix's hash tables, and differs for databases holding the same
+# words that were built up in a different way (e.g.: with --max-memory).
+#--
+# <no parameters>
+#
+published_ignore_word_order() {
+    [[ $# -eq 0 ]] || error "ignore_word_order does not accept arguments, but received $# arguments."
+    IGNORE_WORD_ORDER=1
+}
+
+#--------------------------------------------------------------------------
+# brings a dump into a form where the words of each table are listed in
+# sorted order, without their position in the table. The lines outside
+# the tables keep their order.
+#--
+# $1 - the dump to normalize
+#
+normalize_dump_word_order() {
+    [[ $# -eq 1 ]] || error "normalize_dump_word_order requires exactly one argument, but received $# arguments."
+    awk '
+	function flush() {
+	    if (WORD != "") printf "%08d\t1\t%s\n", SECTION, WORD
+	    WORD = ""
+	}
+	/^Word [0-9]* : / { flush(); sub(/^Word [0-9]* : /, "Word : "); WORD = $0; next }
+	WORD != "" && /^( *[0-9]| +$)/ { WORD = WORD "\t" $0; next }
+	{ flush(); SECTION = NR; printf "%08d\t0\t%s\n", SECTION, $0 }
+	END { flush() }
+    ' "$1" | LC_ALL=C sort
 }
 
 
@@ -1168,6 +1390,13 @@ set_dir_variable_RELD SEARCH_RESULT_SPLIT "search_result_split" # used only if
 CONF_MAILDIR=   # the maildir entries for the mairix configuration file
 CONF_MH=        # the mh      entries for the mairix configuration file
 CONF_MBOX=      # the mbox    entries for the mairix configuration file
+CONF_OPTIONS=   # further options for the mairix configuration file (see
+                # conf_set)
+
+INDEX_OPTIONS=( ) # options passed to mairix when updating or purging the
+                  # database (see set_index_options)
+IGNORE_WORD_ORDER=0 # if non-zero, dumps are compared regardless of the
+                  # order of words in the tables (see ignore_word_order)
 
 SEARCH_RESULT_FORMAT="maildir"
 generate_mairix_rc
@@ -1227,15 +1456,20 @@ do
 
 	case "$COMMAND" in
 	    "add_messages" | \
+		"add_messages_interrupted" | \
 		"assert_dump" | \
 		"assert_no_more_matches" | \
 		"assert_match" | \
+		"assert_same_as_fresh_index" | \
+		"conf_set" | \
 		"conf_set_mformat" | \
 		"dump_database" | \
+		"ignore_word_order" | \
 		"log_remaining_matched_unasserted_messages" | \
 		"purge_database" | \
 		"remove_messages" | \
-		"search_messages" )
+		"search_messages" | \
+		"set_index_options" )
 		published_$COMMAND $OPTIONS
 		;;
 	    * )
@@ -26,13 +26,101 @@
 #include <ctype.h>
 #include "mairix.h"
 
-static unsigned char ascii_tolower(unsigned char c)/*{{{*/
+
+/* Roughly how much memory the word tables have taken up since they were last
+ * spilled to disk (see spill.c) */
+size_t token_memory = 0;
+
+/* Most words turn up in only one or two messages, so most lists of matching
+ * messages are a few bytes long.  Rather than each list being malloc'd and
+ * grown by realloc, short lists live in slots of a few fixed sizes, cut from
+ * large blocks.  A slot that is given up goes on a free list for its size, to
+ * be reused by the next list that needs one.  A list that outgrows the
+ * largest slot is moved to malloc'd memory and grown by half each time. */
+#define ENCODING_BLOCK_SIZE 65536
+static const int slot_sizes[] = {8, 12, 16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512};
+#define N_SLOT_SIZES ((int)(sizeof(slot_sizes) / sizeof(slot_sizes[0])))
+#define MAX_SLOT_SIZE 512
+
+static unsigned char *free_slots[N_SLOT_SIZES];
+static unsigned char *block_pos = NULL;
+static int block_left = 0;
+
+static int slot_class(int size)/*{{{*/
 {
-  if ((c >= 'A') && (c <= 'Z')) return c + ('a' - 'A');
+  int c;
+  for (c=0; slot_sizes[c] < size; c++) ;
   return c;
 }
 /*}}}*/
+static unsigned char *alloc_slot(int c)/*{{{*/
+{
+  unsigned char *result;
+  int size = slot_sizes[c];
 
+  if (free_slots[c]) {
+    /* The link to the next free slot is kept in the slot itself */
+    result = free_slots[c];
+    memcpy(&free_slots[c], result, sizeof(unsigned char *));
+    return result;
+  }
+
+  if (block_left < size) {
+    /* Whatever is left of the old block is too small for this, and is
+     * wasted */
+    block_pos = new_array(unsigned char, ENCODING_BLOCK_SIZE);
+    block_left = ENCODING_BLOCK_SIZE;
+  }
+  result = block_pos;
+  block_pos += size;
+  block_left -= size;
+  return result;
+}
+/*}}}*/
+static void release_encoding(unsigned char *msginfo, int max)/*{{{*/
+{
+  if (!msginfo) return;
+  if (max <= MAX_SLOT_SIZE) {
+    int c = slot_class(max);
+    memcpy(msginfo, &free_slots[c], sizeof(unsigned char *));
+    free_slots[c] = msginfo;
+  } else {
+    free(msginfo);
+  }
+}
+/*}}}*/
+void enlarge_encoding(struct matches *m, int extra)/*{{{*/
+{
+  /* Make room for at least extra more bytes on the end of the list */
+  int need = m->n + extra;
+  unsigned char *new_info;
+
+  if (need <= m->max) return;
+
+  if (need <= MAX_SLOT_SIZE) {
+    int c = slot_class(need);
+    new_info = alloc_slot(c);
+    if (m->n) memcpy(new_info, m->msginfo, m->n);
+    release_encoding(m->msginfo, m->max);
+    m->msginfo = new_info;
+    m->max = slot_sizes[c];
+  } else {
+    int new_max = (m->max > MAX_SLOT_SIZE) ? m->max : MAX_SLOT_SIZE;
+    while (new_max < need) {
+      new_max += (new_max >> 1);
+    }
+    if (m->max > MAX_SLOT_SIZE) {
+      m->msginfo = grow_array(unsigned char, new_max, m->msginfo);
+    } else {
+      new_info = new_array(unsigned char, new_max);
+      if (m->n) memcpy(new_info, m->msginfo, m->n);
+      release_encoding(m->msginfo, m->max);
+      m->msginfo = new_info;
+    }
+    m->max = new_max;
+  }
+}
+/*}}}*/
 static void init_matches(struct matches *m) {/*{{{*/
   m->msginfo = NULL;
   m->n = 0;
@@ -40,6 +128,12 @@ static void init_matches(struct matches *m) {/*{{{*/
   m->highest = 0;
 }
 /*}}}*/
+void free_encoding(struct matches *m)/*{{{*/
+{
+  release_encoding(m->msginfo, m->max);
+  init_matches(m);
+}
+/*}}}*/
 struct token *new_token(void)/*{{{*/
 {
   struct token *result = new(struct token);
@@ -59,16 +153,15 @@ struct token2 *new_token2(void)/*{{{*/
 /*}}}*/
 void free_token(struct token *x)/*{{{*/
 {
-  if (x->text) free(x->text);
-  if (x->match0.msginfo) free(x->match0.msginfo);
+  /* The text belongs to the table, and goes when the table does */
+  free_encoding(&x->match0);
   free(x);
 }
 /*}}}*/
 void free_token2(struct token2 *x)/*{{{*/
 {
-  if (x->text) free(x->text);
-  if (x->match0.msginfo) free(x->match0.msginfo);
-  if (x->match1.msginfo) free(x->match1.msginfo);
+  free_encoding(&x->match0);
+  free_encoding(&x->match1);
   free(x);
 }
 /*}}}*/
@@ -76,6 +169,8 @@ struct toktable *new_toktable(void)/*{{{*/
 {
   struct toktable *result = new(struct toktable);
   result->tokens = NULL;
+  result->slots = NULL;
+  result->text = NULL;
   result->n = 0;
   result->hwm = 0;
   result->size = 0;
@@ -86,12 +181,57 @@ struct toktable2 *new_toktable2(void)/*{{{*/
 {
   struct toktable2 *result = new(struct toktable2);
   result->tokens = NULL;
+  result->slots = NULL;
+  result->text = NULL;
   result->n = 0;
   result->hwm = 0;
   result->size = 0;
   return result;
 }
 /*}}}*/
+
+/* The text of the tokens in a table is packed end to end in big blocks,
+ * rather than each having its own malloc'd string. */
+#define TEXT_BLOCK_SIZE 65536
+
+struct text_block {/*{{{*/
+  struct text_block *next;
+  int used;
+  int size;
+  /* The text follows on from here */
+};
+/*}}}*/
+char *store_token_text(struct text_block **blocks, const char *text, int len)/*{{{*/
+{
+  /* Return a null-terminated copy of the len characters at text, from the
+   * table's text blocks. */
+  struct text_block *b = *blocks;
+  char *result;
+
+  if (!b || (b->used + len + 1 > b->size)) {
+    int size = (len + 1 > TEXT_BLOCK_SIZE) ? len + 1 : TEXT_BLOCK_SIZE;
+    b = (struct text_block *) Malloc(sizeof(struct text_block) + size);
+    b->used = 0;
+    b->size = size;
+    b->next = *blocks;
+    *blocks = b;
+  }
+  result = (char *) (b + 1) + b->used;
+  memcpy(result, text, len);
+  result[len] = '\0';
+  b->used += len + 1;
+  return result;
+}
+/*}}}*/
+static void free_text_blocks(struct text_block *b)/*{{{*/
+{
+  struct text_block *next;
+  for (; b; b = next) {
+    next = b->next;
+    free(b);
+  }
+}
+/*}}}*/
 void free_toktable(struct toktable *x)/*{{{*/
 {
   if (x->tokens) {
@@ -102,7 +242,9 @@ void free_toktable(struct toktable *x)/*{{{*/
       }
     }
     free(x->tokens);
+    free(x->slots);
   }
+  free_text_blocks(x->text);
   free(x);
 }
 /*}}}*/
@@ -116,7 +258,9 @@ void free_toktable2(struct toktable2 *x)/*{{{*/
       }
     }
     free(x->tokens);
+    free(x->slots);
   }
+  free_text_blocks(x->text);
   free(x);
 }
 /*}}}*/
@@ -124,38 +268,45 @@ void free_toktable2(struct toktable2 *x)/*{{{*/
 static void enlarge_toktable(struct toktable *table)/*{{{*/
 {
   if (table->size == 0) {
-    int i;
     /* initial allocation */
     table->size = 1024;
     table->mask = table->size - 1;
     table->tokens = new_array(struct token *, table->size);
-    for (i=0; i<table->size; i++) {
-      table->tokens[i] = NULL;
-    }
+    table->slots = new_array(struct token_slot, table->size);
+    memset(table->tokens, 0, table->size * sizeof(struct token *));
+    memset(table->slots, 0, table->size * sizeof(struct token_slot));
   } else {
     struct token **old_tokens;
+    struct token_slot *old_slots;
     int old_size = table->size;
     int i;
     /* reallocate */
     old_tokens = table->tokens;
+    old_slots = table->slots;
     table->size <<= 1;
     table->mask = table->size - 1;
     table->tokens = new_array(struct token *, table->size);
-    for (i=0; i<table->size; i++) {
-      table->tokens[i] = NULL;
-    }
+    table->slots = new_array(struct token_slot, table->size);
+    memset(table->tokens, 0, table->size * sizeof(struct token *));
+    memset(table->slots, 0, table->size * sizeof(struct token_slot));
     for (i=0; i<old_size; i++) {
       unsigned long new_index;
-      if (old_tokens[i]) {
-        new_index = old_tokens[i]->hashval & table->mask;
-        while (table->tokens[new_index]) {
+      if (old_slots[i].len) {
+        new_index = old_slots[i].hashval & table->mask;
+        while (table->slots[new_index].len) {
           new_index++;
           new_index &= table->mask;
         }
         table->tokens[new_index] = old_tokens[i];
+        table->slots[new_index] = old_slots[i];
       }
     }
     free(old_tokens);
+    free(old_slots);
+    /* Only growth beyond the initial size counts towards the memory limit :
+     * a spill starts the tables again at that size, so counting it would
+     * leave a small limit already used up by the empty tables. */
+    token_memory += (table->size - old_size) * (sizeof(struct token *) + sizeof(struct token_slot));
   }
   table->hwm = (table->size >> 2) + (table->size >> 3); /* allow 3/8 of nodes to be used */
 }
@@ -163,42 +314,50 @@ static void enlarge_toktable(struct toktable *table)/*{{{*/
 static void enlarge_toktable2(struct toktable2 *table)/*{{{*/
 {
   if (table->size == 0) {
-    int i;
     /* initial allocation */
     table->size = 1024;
     table->mask = table->size - 1;
     table->tokens = new_array(struct token2 *, table->size);
-    for (i=0; i<table->size; i++) {
-      table->tokens[i] = NULL;
-    }
+    table->slots = new_array(struct token_slot, table->size);
+    memset(table->tokens, 0, table->size * sizeof(struct token2 *));
+    memset(table->slots, 0, table->size * sizeof(struct token_slot));
   } else {
     struct token2 **old_tokens;
+    struct token_slot *old_slots;
     int old_size = table->size;
     int i;
     /* reallocate */
     old_tokens = table->tokens;
+    old_slots = table->slots;
     table->size <<= 1;
     table->mask = table->size - 1;
     table->tokens = new_array(struct token2 *, table->size);
-    for (i=0; i<table->size; i++) {
-      table->tokens[i] = NULL;
-    }
+    table->slots = new_array(struct token_slot, table->size);
+    memset(table->tokens, 0, table->size * sizeof(struct token2 *));
+    memset(table->slots, 0, table->size * sizeof(struct token_slot));
     for (i=0; i<old_size; i++) {
       unsigned long new_index;
-      if (old_tokens[i]) {
-        new_index = old_tokens[i]->hashval & table->mask;
-        while (table->tokens[new_index]) {
+      if (old_slots[i].len) {
+        new_index = old_slots[i].hashval & table->mask;
+        while (table->slots[new_index].len) {
           new_index++;
           new_index &= table->mask;
         }
         table->tokens[new_index] = old_tokens[i];
+        table->slots[new_index] = old_slots[i];
       }
     }
     free(old_tokens);
+    free(old_slots);
   }
   table->hwm = (table->size >> 2) + (table->size >> 3); /* allow 3/8 of nodes to be used */
 }
 /*}}}*/
+static inline int value_length(int val)/*{{{*/
+{
+  return (val <= 127) ? 1 : (val <= 16383) ? 2 : 4;
+}
+/*}}}*/
 static int insert_value(unsigned char *x, int val)/*{{{*/
 {
   assert(val >= 0);
@@ -220,127 +379,170 @@ static int insert_value(unsigned char *x, int val)/*{{{*/
   }
 }
 /*}}}*/
-void check_and_enlarge_encoding(struct matches *m)/*{{{*/
-{
-  if (m->n + 4 >= m->max) {
-    if (m->max == 0) {
-      m->max = 16;
-    } else {
-      m->max += (m->max >> 1);
-    }
-    m->msginfo = grow_array(unsigned char, m->max, m->msginfo);
-  }
-}
-/*}}}*/
 void insert_index_on_encoding(struct matches *m, int idx)/*{{{*/
 {
+  int val;
   if (m->n == 0) {
     /* Always encode value */
-    m->n += insert_value(m->msginfo + m->n, idx);
+    val = idx;
   } else {
     assert(idx >= m->highest);
-    if (idx > m->highest) {
-      int increment = idx - m->highest;
-      m->n += insert_value(m->msginfo + m->n, increment);
-    } else {
+    if (idx == m->highest) {
       /* token has already been seen in this file */
+      return;
     }
+    val = idx - m->highest;
   }
+  if (m->n + 4 > m->max) {
+    enlarge_encoding(m, value_length(val));
+  }
+  m->n += insert_value(m->msginfo + m->n, val);
   m->highest = idx;
 }
 /*}}}*/
-void add_token_in_file(int file_index, unsigned int hash_key, char *tok_text, struct toktable *table)/*{{{*/
+/* Where the case folded text of a token is made, to be looked up in the
+ * tables.  Memory is only allocated for a token the first time it's seen. */
+static char *folded_text = NULL;
+static int folded_text_size = 0;
+
+static unsigned int fold_token(const char *tok_text, int len, unsigned int hash_key)/*{{{*/
 {
-  unsigned long hash;
-  int index;
+  if (len + 1 > folded_text_size) {
+    folded_text_size = len + 64;
+    folded_text = grow_array(char, folded_text_size, folded_text);
+  }
+  return fold_and_hash(tok_text, len, folded_text, hash_key);
+}
+/*}}}*/
+static inline int slot_matches(const struct token_slot *slot, unsigned int hash, int len)/*{{{*/
+{
+  /* Whether the token in the slot could be the one wanted, without having to
+   * look at the token itself. */
+  return (slot->hashval == hash) && (slot->len == len);
+}
+/*}}}*/
+/* Most words turn up more than once in a message, and adding one to its
+ * table a second time changes nothing.  This is a small cache of the tokens
+ * added for the current message, so that the repeats can be dropped without
+ * probing the (large) table at all.  It only ever saves work : an entry that
+ * gets overwritten just means the table is probed as before. */
+#define FILTER_SIZE 2048
+
+static struct seen_token {/*{{{*/
+  unsigned int generation; /* only valid if equal to filter_generation */
+  unsigned int hashval;
+  int len;
+  int file_index;
+  const struct toktable *table;
+  const char *text; /* the token's text in the table */
+} seen_tokens[FILTER_SIZE];
+/*}}}*/
+static unsigned int filter_generation = 1;
+
+void reset_token_filter(void)/*{{{*/
+{
+  /* Forget the tokens seen so far.  This must be done for each message, in
+   * case the tokens the cache refers to are freed in between. */
+  if (++filter_generation == 0) {
+    memset(seen_tokens, 0, sizeof(seen_tokens));
+    filter_generation = 1;
+  }
+}
+/*}}}*/
+void add_token_in_file(int file_index, unsigned int hash_key, const char *tok_text, int len, struct toktable *table)/*{{{*/
+{
+  unsigned int hash;
+  int index, old_max;
   struct token *tok;
-  char *lc_tok_text;
-  char *p;
+  struct seen_token *seen;
 
-  lc_tok_text = new_string((char*)tok_text);
-  for (p = lc_tok_text; *p; p++) {
-    *p = ascii_tolower(*(unsigned char *) p);
+  /* Empty tokens can't go in the table : a zero length marks an empty slot */
+  if (len == 0) return;
+  hash = fold_token(tok_text, len, hash_key);
+
+  seen = &seen_tokens[hash & (FILTER_SIZE - 1)];
+  if ((seen->generation == filter_generation) && (seen->file_index == file_index) &&
+      (seen->table == table) && (seen->hashval == hash) && (seen->len == len) &&
+      !memcmp(seen->text, folded_text, len)) {
+    /* Already added for this message */
+    return;
   }
-  /* 2nd arg is string length */
-  hash = hashfn((unsigned char *) lc_tok_text, p - lc_tok_text, hash_key);
 
   if (table->n >= table->hwm) {
     enlarge_toktable(table);
   }
 
   index = hash & table->mask;
-  while (table->tokens[index]) {
-    /* strcmp ok as text has been tolower'd earlier */
-    if (!strcmp(lc_tok_text, table->tokens[index]->text))
+  while (table->slots[index].len) {
+    if (slot_matches(&table->slots[index], hash, len) &&
+        !memcmp(table->tokens[index]->text, folded_text, len))
       break;
     index++;
     index &= table->mask;
   }
 
-  if (!table->tokens[index]) {
+  if (!table->slots[index].len) {
     /* Allocate new */
     struct token *new_tok = new_token();
-    /* New token takes ownership of lc_tok_text, no need to free that later. */
-    new_tok->text = (char *) lc_tok_text;
-    new_tok->hashval = hash; /* save full width for later */
+    new_tok->text = store_token_text(&table->text, folded_text, len);
     table->tokens[index] = new_tok;
+    table->slots[index].hashval = hash; /* save full width for later */
+    table->slots[index].len = len;
     ++table->n;
-  } else {
-    free(lc_tok_text);
+    token_memory += sizeof(struct token) + len + 1;
   }
 
   tok = table->tokens[index];
 
-  check_and_enlarge_encoding(&tok->match0);
+  old_max = tok->match0.max;
   insert_index_on_encoding(&tok->match0, file_index);
+  token_memory += tok->match0.max - old_max;
+
+  seen->generation = filter_generation;
+  seen->hashval = hash;
+  seen->len = len;
+  seen->file_index = file_index;
+  seen->table = table;
+  seen->text = tok->text;
 }
 /*}}}*/
-void add_token2_in_file(int file_index, unsigned int hash_key, char *tok_text, struct toktable2 *table, int add_to_chain1)/*{{{*/
+void add_token2_in_file(int file_index, unsigned int hash_key, const char *tok_text, int len, struct toktable2 *table, int add_to_chain1)/*{{{*/
 {
-  unsigned long hash;
+  unsigned int hash;
   int index;
   struct token2 *tok;
-  char *lc_tok_text;
-  char *p;
 
-  lc_tok_text = new_string(tok_text);
-  for (p = lc_tok_text; *p; p++) {
-    *p = ascii_tolower(*(unsigned char *) p);
-  }
-  /* 2nd arg is string length */
-  hash = hashfn((unsigned char *) lc_tok_text, p - lc_tok_text, hash_key);
+  /* Empty tokens can't go in the table : a zero length marks an empty slot */
+  if (len == 0) return;
+  hash = fold_token(tok_text, len, hash_key);
 
   if (table->n >= table->hwm) {
     enlarge_toktable2(table);
   }
 
   index = hash & table->mask;
-  while (table->tokens[index]) {
-    /* strcmp ok as text has been tolower'd earlier */
-    if (!strcmp(lc_tok_text, table->tokens[index]->text))
+  while (table->slots[index].len) {
+    if (slot_matches(&table->slots[index], hash, len) &&
+        !memcmp(table->tokens[index]->text, folded_text, len))
       break;
     index++;
     index &= table->mask;
   }
 
-  if (!table->tokens[index]) {
+  if (!table->slots[index].len) {
     /* Allocate new */
     struct token2 *new_tok = new_token2();
-    /* New token takes ownership of lc_tok_text, no need to free that later. */
-    new_tok->text = lc_tok_text;
-    new_tok->hashval = hash; /* save full width for later */
+    new_tok->text = store_token_text(&table->text, folded_text, len);
     table->tokens[index] = new_tok;
+    table->slots[index].hashval = hash; /* save full width for later */
+    table->slots[index].len = len;
     ++table->n;
-  } else {
-    free(lc_tok_text);
   }
 
   tok = table->tokens[index];
 
-  check_and_enlarge_encoding(&tok->match0);
   insert_index_on_encoding(&tok->match0, file_index);
   if (add_to_chain1) {
-    check_and_enlarge_encoding(&tok->match1);
     insert_index_on_encoding(&tok->match1, file_index);
   }
 }
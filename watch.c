@@ -0,0 +1,392 @@
+/*
+  mairix - message index builder and finder for maildir folders.
+
+ **********************************************************************
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of version 2 of the GNU General Public License as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ **********************************************************************
+ */
+
+/* Keep the database up to date by watching the folders for changes with
+ * inotify, rather than having to run a full indexing pass from cron.
+ *
+ * The maildir new/ and cur/ directories and the MH folders are watched
+ * individually, so that after a change only the directories that generated
+ * events need to be read again; everything else is taken straight from the
+ * database.  mbox files are watched too, and only those that generated events
+ * are checked again, in the usual way.  New folders only show up in a full pass,
+ * which is done every RESCAN_SECS, and whenever a watched folder is removed or
+ * renamed or the kernel's event queue overflows.  IMAP folders aren't
+ * watched. */
+
+#include "mairix.h"
+
+#ifdef USE_INOTIFY
+
+#include <sys/inotify.h>
+#include <poll.h>
+#include <errno.h>
+#include <unistd.h>
+
+/* Wait until the folders have been quiet for this long before updating, so
+ * that a burst of deliveries or flag changes is handled in one go ... */
+#define SETTLE_MSECS 1000
+/* ... but don't wait for more than this after the first event. */
+#define MAX_BATCH_SECS 10
+/* Interval between full passes. */
+#define RESCAN_SECS 3600
+/* Interval between attempts to lock the database if something else has it. */
+#define LOCK_RETRY_SECS 5
+
+#define DIR_EVENTS (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+                    IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF)
+#define MBOX_EVENTS (IN_MODIFY | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF)
+
+struct watch_list {/*{{{*/
+  int fd;
+  /* Message directories come first (n_dirs of them), then mbox files. */
+  char **paths;
+  enum folder_type *fts;
+  char *changed;
+  int n;
+  int n_dirs;
+  int max;
+  /* Map from watch descriptor to index into paths, or -1. */
+  int *index_of_wd;
+  int max_wd;
+};
+/*}}}*/
+struct db_ident {/*{{{*/
+  /* Enough to tell whether another mairix has rewritten the database since
+   * we last wrote it. */
+  int valid;
+  dev_t dev;
+  ino_t ino;
+  time_t mtime;
+  off_t size;
+};
+/*}}}*/
+
+static void clear_watches(struct watch_list *wl)/*{{{*/
+{
+  int i;
+  if (wl->fd >= 0) close(wl->fd);
+  wl->fd = -1;
+  for (i=0; i<wl->n; i++) {
+    free(wl->paths[i]);
+  }
+  wl->n = wl->n_dirs = 0;
+  for (i=0; i<wl->max_wd; i++) {
+    wl->index_of_wd[i] = -1;
+  }
+}
+/*}}}*/
+static void add_watch(struct watch_list *wl, const char *path, enum folder_type ft)/*{{{*/
+{
+  int wd;
+
+  if (wl->n == wl->max) {
+    wl->max += 256;
+    wl->paths = grow_array(char *, wl->max, wl->paths);
+    wl->fts = grow_array(enum folder_type, wl->max, wl->fts);
+    wl->changed = grow_array(char, wl->max, wl->changed);
+  }
+  wl->paths[wl->n] = new_string(path);
+  wl->fts[wl->n] = ft;
+  wl->changed[wl->n] = 1;
+
+  wd = inotify_add_watch(wl->fd, path, (ft == FT_MBOX) ? MBOX_EVENTS : DIR_EVENTS);
+  if (wd >= 0) {
+    if (wd >= wl->max_wd) {
+      int old_max = wl->max_wd;
+      wl->max_wd = wd + 256;
+      wl->index_of_wd = grow_array(int, wl->max_wd, wl->index_of_wd);
+      while (old_max < wl->max_wd) {
+        wl->index_of_wd[old_max++] = -1;
+      }
+    }
+    /* The same directory may be reachable under two names (symlinks); the
+     * kernel hands back the same descriptor, so just track the first. */
+    if (wl->index_of_wd[wd] < 0) {
+      wl->index_of_wd[wd] = wl->n;
+    }
+  } else if (errno != ENOENT) {
+    /* A maildir doesn't have to have a new/ as well as a cur/, so ignore
+     * missing paths. */
+    fprintf(stderr, "Cannot watch %s: %s\n", path, strerror(errno));
+  }
+  ++wl->n;
+}
+/*}}}*/
+static void add_folder_watches(struct watch_list *wl, struct watch_settings *ws, char *folders, enum folder_type ft)/*{{{*/
+{
+  char **paths, *subdir;
+  int n_paths, i;
+
+  expand_message_folders(ws->folder_base, folders, ft, ws->omit_globs, &n_paths, &paths);
+  for (i=0; i<n_paths; i++) {
+    if (ft == FT_MAILDIR) {
+      subdir = new_array(char, strlen(paths[i]) + 5);
+      sprintf(subdir, "%s/new", paths[i]);
+      add_watch(wl, subdir, ft);
+      sprintf(subdir, "%s/cur", paths[i]);
+      add_watch(wl, subdir, ft);
+      free(subdir);
+    } else {
+      add_watch(wl, paths[i], ft);
+    }
+  }
+  free_string_array(n_paths, &paths);
+}
+/*}}}*/
+static void setup_watches(struct watch_list *wl, struct watch_settings *ws)/*{{{*/
+{
+  /* Set up the watches on the message directories before they get read, so
+   * that nothing arriving while they're being read is missed.  Finding the
+   * MH folders reads them too, but those listings aren't kept outside
+   * build_message_list(), so each folder is read again once it's watched. */
+  clear_watches(wl);
+  wl->fd = inotify_init();
+  if (wl->fd < 0) {
+    perror("inotify_init");
+    unlock_and_exit(2);
+  }
+  if (ws->maildir_folders) {
+    add_folder_watches(wl, ws, ws->maildir_folders, FT_MAILDIR);
+  }
+  if (ws->mh_folders) {
+    add_folder_watches(wl, ws, ws->mh_folders, FT_MH);
+  }
+  wl->n_dirs = wl->n;
+}
+/*}}}*/
+static void add_mbox_watches(struct watch_list *wl, struct database *db)/*{{{*/
+{
+  int i;
+  for (i=0; i<db->n_mboxen; i++) {
+    if (db->mboxen[i].path) {
+      add_watch(wl, db->mboxen[i].path, FT_MBOX);
+    }
+  }
+}
+/*}}}*/
+static int read_events(struct watch_list *wl, int *need_full)/*{{{*/
+{
+  /* Drain the pending events, flagging the directories they relate to.
+   * Returns the number of events read. */
+  char buffer[16384];
+  struct inotify_event *ev;
+  int n_events = 0;
+  ssize_t len, pos;
+  int idx;
+
+  len = read(wl->fd, buffer, sizeof(buffer));
+  if (len < 0) {
+    if ((errno != EINTR) && (errno != EAGAIN)) {
+      perror("read");
+      *need_full = 1;
+    }
+    return 0;
+  }
+  for (pos = 0; pos < len; pos += sizeof(struct inotify_event) + ev->len) {
+    ev = (struct inotify_event *) (buffer + pos);
+    ++n_events;
+    if (ev->mask & (IN_Q_OVERFLOW | IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+      /* Events lost, or a watched folder has gone away; the only safe
+       * thing is to start again from scratch. */
+      *need_full = 1;
+      continue;
+    }
+    idx = ((ev->wd >= 0) && (ev->wd < wl->max_wd)) ? wl->index_of_wd[ev->wd] : -1;
+    if (idx >= 0) {
+      wl->changed[idx] = 1;
+    }
+  }
+  return n_events;
+}
+/*}}}*/
+static int wait_for_changes(struct watch_list *wl, time_t next_full, int *need_full)/*{{{*/
+{
+  /* Block until something changes and things settle down again, or until
+   * it's time for a full pass.  Returns 0 if it timed out. */
+  struct pollfd pfd;
+  time_t now, first;
+  int timeout, r;
+
+  pfd.fd = wl->fd;
+  pfd.events = POLLIN;
+
+  do {
+    now = time(NULL);
+    if (now >= next_full) return 0;
+    timeout = (next_full - now) * 1000;
+    r = poll(&pfd, 1, timeout);
+    if ((r < 0) && (errno != EINTR)) {
+      perror("poll");
+      unlock_and_exit(2);
+    }
+  } while (r <= 0);
+
+  first = time(NULL);
+  read_events(wl, need_full);
+  while (time(NULL) < first + MAX_BATCH_SECS) {
+    r = poll(&pfd, 1, SETTLE_MSECS);
+    if (r == 0) break;
+    if (r > 0) read_events(wl, need_full);
+  }
+  return 1;
+}
+/*}}}*/
+static void get_db_ident(char *database_path, struct db_ident *ident)/*{{{*/
+{
+  struct stat sb;
+  if (stat(database_path, &sb) < 0) {
+    ident->valid = 0;
+  } else {
+    ident->valid = 1;
+    ident->dev = sb.st_dev;
+    ident->ino = sb.st_ino;
+    ident->mtime = sb.st_mtime;
+    ident->size = sb.st_size;
+  }
+}
+/*}}}*/
+static struct database *reload_if_replaced(struct database *db, struct watch_settings *ws, struct db_ident *ident)/*{{{*/
+{
+  /* If another mairix run has written the database since we did, what we
+   * have in memory is out of date, so start again from what's on disc. */
+  struct db_ident now;
+
+  get_db_ident(ws->database_path, &now);
+  if ((now.valid == ident->valid) &&
+      (!now.valid ||
+       ((now.dev == ident->dev) && (now.ino == ident->ino) &&
+        (now.mtime == ident->mtime) && (now.size == ident->size)))) {
+    return db;
+  }
+
+  if (verbose) printf("Database has been changed by another process, re-reading it\n");
+  free_database(db);
+  if (now.valid) {
+    db = new_database_from_file(ws->database_path, ws->do_integrity_checks);
+  } else {
+    db = new_database(CREATE_RANDOM_DATABASE_HASH);
+  }
+  *ident = now;
+  return db;
+}
+/*}}}*/
+static struct database *update_from_watches(struct database *db, struct watch_settings *ws, struct watch_list *wl, int full, struct db_ident *ident)/*{{{*/
+{
+  struct msgpath_array *msgs;
+  int any_updates, any_purges = 0;
+  int i;
+
+  while (!try_lock_database(ws->database_path)) {
+    if (verbose) printf("Database is locked, waiting...\n");
+    sleep(LOCK_RETRY_SECS);
+  }
+
+  db = reload_if_replaced(db, ws, ident);
+
+  if (full) {
+    if (verbose) printf("Re-reading all folders...\n");
+    setup_watches(wl, ws);
+  }
+
+  msgs = new_msgpath_array();
+  build_watched_message_list(wl->n_dirs, wl->paths, wl->fts, wl->changed, msgs, db);
+  sort_message_list(msgs);
+  if (full && check_message_list_for_duplicates(msgs)) {
+    fprintf(stderr, "Message list contains duplicates - check your 'folders' setting\n");
+    free_msgpath_array(msgs);
+    unlock_database();
+    return db;
+  }
+
+  if (full) {
+    build_mbox_lists(db, ws->folder_base, ws->mboxen, ws->omit_globs, ws->do_mbox_symlinks);
+    add_mbox_watches(wl, db);
+  } else {
+    build_changed_mbox_lists(db, wl->n - wl->n_dirs, wl->paths + wl->n_dirs, wl->changed + wl->n_dirs);
+  }
+
+  any_updates = update_database(db, msgs->paths, msgs->n, ws->do_fast_index, NULL);
+  any_updates |= set_database_dirs(db, msgs);
+  if (ws->do_purge) {
+    any_purges = cull_dead_messages(db, ws->do_integrity_checks, full);
+  }
+  if (any_updates || any_purges) {
+    write_database(db, ws->database_path, ws->do_integrity_checks);
+    get_db_ident(ws->database_path, ident);
+  }
+
+  for (i=0; i<wl->n; i++) {
+    wl->changed[i] = 0;
+  }
+  free_msgpath_array(msgs);
+  unlock_database();
+  return db;
+}
+/*}}}*/
+void watch_folders(struct database *db, struct watch_settings *ws)/*{{{*/
+{
+  /* Never returns; the process is ended by a signal. */
+  struct watch_list wl;
+  struct db_ident ident;
+  time_t next_full;
+  int need_full;
+
+  wl.fd = -1;
+  wl.paths = NULL;
+  wl.fts = NULL;
+  wl.changed = NULL;
+  wl.n = wl.n_dirs = wl.max = 0;
+  wl.index_of_wd = NULL;
+  wl.max_wd = 0;
+
+  get_db_ident(ws->database_path, &ident);
+
+  /* Anything that changed between the initial indexing pass and setting up
+   * the watches is picked up by starting with a full pass. */
+  need_full = 1;
+  for (;;) {
+    if (need_full) {
+      need_full = 0;
+      db = update_from_watches(db, ws, &wl, 1, &ident);
+      if (verbose) printf("Watching %d folders\n", wl.n);
+      next_full = time(NULL) + RESCAN_SECS;
+    }
+    if (!wait_for_changes(&wl, next_full, &need_full)) {
+      need_full = 1;
+    } else if (!need_full) {
+      db = update_from_watches(db, ws, &wl, 0, &ident);
+    }
+  }
+}
+/*}}}*/
+
+#else
+
+void watch_folders(struct database *db, struct watch_settings *ws)/*{{{*/
+{
+  fprintf(stderr, "This mairix was built without support for --watch\n");
+  unlock_and_exit(2);
+}
+/*}}}*/
+
+#endif
+
+/* vim:et:sts=2:sw=2
+*/
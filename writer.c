@@ -73,6 +73,10 @@ struct write_map {/*{{{*/
    * anywhere. */
   int mbox_checksum_offset;
 
+  int dir_paths_offset;
+  int dir_mtime_offset;
+  int dir_entries_offset;
+
   struct write_map_toktable to;
   struct write_map_toktable cc;
   struct write_map_toktable from;
@@ -81,10 +85,35 @@ struct write_map {/*{{{*/
   struct write_map_toktable attachment_name;
   struct write_map_toktable2 msg_ids;
 
+  /* Dictionary of the distinct tokens in the to .. attachment_name tables */
+  int dict_tok_offset;
+  int dict_first_offset;
+  int dict_refs_offset;
+
   /* To get base address for character data */
   int beyond_last_ui_offset;
 };
 /*}}}*/
+struct dictionary {/*{{{*/
+  int n; /* number of distinct tokens */
+  int n_refs; /* total entries in the field tables */
+  int *first_ref; /* n+1 entries, indices into refs */
+  unsigned int *refs; /* (index in field table << DICT_FIELD_BITS) | field */
+
+  /* Size of each field table, and bytes of token text and hit encoding
+   * (with terminators) that it will write */
+  int field_n[N_DICT_FIELDS];
+  int text_bytes[N_DICT_FIELDS];
+  int enc_bytes[N_DICT_FIELDS];
+};
+/*}}}*/
+struct dictionary_slot {/*{{{*/
+  const char *text;
+  unsigned int hashval;
+  int len;
+  int entry;
+};
+/*}}}*/
 
 static void create_rw_mapping(char *filename, size_t len, int *out_fd, char **out_data)/*{{{*/
 {
@@ -134,26 +163,13 @@ static void create_rw_mapping(char *filename, size_t len, int *out_fd, char **ou
 }
 /*}}}*/
 
-static int toktable_char_length(struct toktable *tab)/*{{{*/
-{
-  int result = 0;
-  int i;
-  for (i=0; i<tab->size; i++) {
-    if (tab->tokens[i]) {
-      result += (1 + strlen(tab->tokens[i]->text));
-      result += (1 + tab->tokens[i]->match0.n);
-    }
-  }
-  return result;
-}
-/*}}}*/
 static int toktable2_char_length(struct toktable2 *tab)/*{{{*/
 {
   int result = 0;
   int i;
   for (i=0; i<tab->size; i++) {
     if (tab->tokens[i]) {
-      result += (1 + strlen(tab->tokens[i]->text));
+      result += (1 + tab->slots[i].len);
       result += (1 + tab->tokens[i]->match0.n);
       result += (1 + tab->tokens[i]->match1.n);
     }
@@ -161,7 +177,7 @@ static int toktable2_char_length(struct toktable2 *tab)/*{{{*/
   return result;
 }
 /*}}}*/
-static int char_length(struct database *db)/*{{{*/
+static int char_length(struct database *db, struct dictionary *dict)/*{{{*/
 {
   /* Return total length of character data to be written. */
   int result;
@@ -195,19 +211,20 @@ static int char_length(struct database *db)/*{{{*/
     }
   }
 
-  result += toktable_char_length(db->to);
-  result += toktable_char_length(db->cc);
-  result += toktable_char_length(db->from);
-  result += toktable_char_length(db->subject);
-  result += toktable_char_length(db->body);
-  result += toktable_char_length(db->attachment_name);
+  for (i=0; i<db->n_dirs; i++) {
+    result += (1 + strlen(db->dirs[i].path));
+  }
+
+  for (i=0; i<N_DICT_FIELDS; i++) {
+    result += dict->text_bytes[i] + dict->enc_bytes[i];
+  }
   result += toktable2_char_length(db->msg_ids);
 
   return result;
 }
 /*}}}*/
 
-static void compute_mapping(struct database *db, struct write_map *map)/*{{{*/
+static void compute_mapping(struct database *db, struct dictionary *dict, struct write_map *map)/*{{{*/
 {
   int total = UI_HEADER_LEN;
 
@@ -223,32 +240,40 @@ static void compute_mapping(struct database *db, struct write_map *map)/*{{{*/
   map->mbox_size_offset  = total, total += db->n_mboxen;
   map->mbox_checksum_offset = total, total += db->n_mboxen;
 
-  map->to.tok_offset = total, total += db->to->n;
-  map->to.enc_offset = total, total += db->to->n;
+  map->dir_paths_offset = total, total += db->n_dirs;
+  map->dir_mtime_offset = total, total += db->n_dirs;
+  map->dir_entries_offset = total, total += db->n_dirs;
 
-  map->cc.tok_offset = total, total += db->cc->n;
-  map->cc.enc_offset = total, total += db->cc->n;
+  map->to.tok_offset = total, total += dict->field_n[DICT_TO];
+  map->to.enc_offset = total, total += dict->field_n[DICT_TO];
 
-  map->from.tok_offset = total, total += db->from->n;
-  map->from.enc_offset = total, total += db->from->n;
+  map->cc.tok_offset = total, total += dict->field_n[DICT_CC];
+  map->cc.enc_offset = total, total += dict->field_n[DICT_CC];
 
-  map->subject.tok_offset = total, total += db->subject->n;
-  map->subject.enc_offset = total, total += db->subject->n;
+  map->from.tok_offset = total, total += dict->field_n[DICT_FROM];
+  map->from.enc_offset = total, total += dict->field_n[DICT_FROM];
 
-  map->body.tok_offset = total, total += db->body->n;
-  map->body.enc_offset = total, total += db->body->n;
+  map->subject.tok_offset = total, total += dict->field_n[DICT_SUBJECT];
+  map->subject.enc_offset = total, total += dict->field_n[DICT_SUBJECT];
 
-  map->attachment_name.tok_offset = total, total += db->attachment_name->n;
-  map->attachment_name.enc_offset = total, total += db->attachment_name->n;
+  map->body.tok_offset = total, total += dict->field_n[DICT_BODY];
+  map->body.enc_offset = total, total += dict->field_n[DICT_BODY];
+
+  map->attachment_name.tok_offset = total, total += dict->field_n[DICT_ATTACHMENT_NAME];
+  map->attachment_name.enc_offset = total, total += dict->field_n[DICT_ATTACHMENT_NAME];
 
   map->msg_ids.tok_offset = total, total += db->msg_ids->n;
   map->msg_ids.enc0_offset = total, total += db->msg_ids->n;
   map->msg_ids.enc1_offset = total, total += db->msg_ids->n;
 
+  map->dict_tok_offset = total, total += dict->n;
+  map->dict_first_offset = total, total += dict->n + 1;
+  map->dict_refs_offset = total, total += dict->n_refs;
+
   map->beyond_last_ui_offset = total;
 }
 /*}}}*/
-static void write_header(char *data, unsigned int *uidata, struct database *db, struct write_map *map)/*{{{*/
+static void write_header(char *data, unsigned int *uidata, struct database *db, struct dictionary *dict, struct write_map *map)/*{{{*/
 {
   /* Endianness-independent writes - at least the magic number will be
    * recognized if the database is read by this program on a machine of
@@ -275,29 +300,34 @@ static void write_header(char *data, unsigned int *uidata, struct database *db,
   uidata[UI_MBOX_SIZE]  = map->mbox_size_offset;
   uidata[UI_MBOX_CKSUM] = map->mbox_checksum_offset;
 
+  uidata[UI_DIR_N] = db->n_dirs;
+  uidata[UI_DIR_PATHS] = map->dir_paths_offset;
+  uidata[UI_DIR_MTIME] = map->dir_mtime_offset;
+  uidata[UI_DIR_ENTRIES] = map->dir_entries_offset;
+
   uidata[UI_HASH_KEY] = db->hash_key;
 
-  uidata[UI_TO_N] = db->to->n;
+  uidata[UI_TO_N] = dict->field_n[DICT_TO];
   uidata[UI_TO_TOK] = map->to.tok_offset;
   uidata[UI_TO_ENC] = map->to.enc_offset;
 
-  uidata[UI_CC_N] = db->cc->n;
+  uidata[UI_CC_N] = dict->field_n[DICT_CC];
   uidata[UI_CC_TOK] = map->cc.tok_offset;
   uidata[UI_CC_ENC] = map->cc.enc_offset;
 
-  uidata[UI_FROM_N] = db->from->n;
+  uidata[UI_FROM_N] = dict->field_n[DICT_FROM];
   uidata[UI_FROM_TOK] = map->from.tok_offset;
   uidata[UI_FROM_ENC] = map->from.enc_offset;
 
-  uidata[UI_SUBJECT_N] = db->subject->n;
+  uidata[UI_SUBJECT_N] = dict->field_n[DICT_SUBJECT];
   uidata[UI_SUBJECT_TOK] = map->subject.tok_offset;
   uidata[UI_SUBJECT_ENC] = map->subject.enc_offset;
 
-  uidata[UI_BODY_N] = db->body->n;
+  uidata[UI_BODY_N] = dict->field_n[DICT_BODY];
   uidata[UI_BODY_TOK] = map->body.tok_offset;
   uidata[UI_BODY_ENC] = map->body.enc_offset;
 
-  uidata[UI_ATTACHMENT_NAME_N] = db->attachment_name->n;
+  uidata[UI_ATTACHMENT_NAME_N] = dict->field_n[DICT_ATTACHMENT_NAME];
   uidata[UI_ATTACHMENT_NAME_TOK] = map->attachment_name.tok_offset;
   uidata[UI_ATTACHMENT_NAME_ENC] = map->attachment_name.enc_offset;
 
@@ -306,6 +336,11 @@ static void write_header(char *data, unsigned int *uidata, struct database *db,
   uidata[UI_MSGID_ENC0] = map->msg_ids.enc0_offset;
   uidata[UI_MSGID_ENC1] = map->msg_ids.enc1_offset;
 
+  uidata[UI_DICT_N]     = dict->n;
+  uidata[UI_DICT_TOK]   = map->dict_tok_offset;
+  uidata[UI_DICT_FIRST] = map->dict_first_offset;
+  uidata[UI_DICT_REFS]  = map->dict_refs_offset;
+
   return;
 }
 /*}}}*/
@@ -450,6 +485,27 @@ static char * write_mbox_checksums(struct database *db, struct write_map *map, u
   return cdata;
 }
 /*}}}*/
+static char *write_dirs(struct database *db, struct write_map *map, unsigned int *uidata, char *data, char *cdata)/*{{{*/
+{
+  int i, len;
+  char *start_cdata = cdata;
+
+  for (i=0; i<db->n_dirs; i++) {
+    struct dirstamp *ds = &db->dirs[i];
+    uidata[map->dir_mtime_offset + i] = ds->mtime;
+    uidata[map->dir_entries_offset + i] = ds->n_entries;
+    uidata[map->dir_paths_offset + i] = cdata - data;
+    len = strlen(ds->path);
+    memcpy(cdata, ds->path, 1+len);
+    cdata += 1+len;
+  }
+  if (verbose) {
+    printf("Wrote %d directory headers (%d bytes of tables, %d bytes of paths)\n",
+        db->n_dirs, 3*4*db->n_dirs, (int)(cdata - start_cdata));
+  }
+  return cdata;
+}
+/*}}}*/
 
 static char *write_toktable(struct toktable *tab, struct write_map_toktable *map, unsigned int *uidata, char *data, char *cdata, char *header_name)/*{{{*/
 {
@@ -573,6 +629,254 @@ static char *write_toktable2(struct toktable2 *tab, struct write_map_toktable2 *
   return cdata;
 }
 /*}}}*/
+static void build_dictionary(struct database *db, struct dictionary *dict)/*{{{*/
+{
+  /* Merge the to .. attachment_name tables on the token text, so that a
+   * search over several fields can look at each distinct word once.  The
+   * tokens are visited in the order write_toktable() writes them, so a
+   * token's index in its field table is a count of those seen before it. */
+  struct toktable *tables[N_DICT_FIELDS];
+  int *entry_of[N_DICT_FIELDS];
+  struct dictionary_slot *slots;
+  unsigned int mask, h;
+  int size, total, f, i, k, e;
+
+  tables[DICT_TO] = db->to;
+  tables[DICT_CC] = db->cc;
+  tables[DICT_FROM] = db->from;
+  tables[DICT_SUBJECT] = db->subject;
+  tables[DICT_BODY] = db->body;
+  tables[DICT_ATTACHMENT_NAME] = db->attachment_name;
+
+  total = 0;
+  for (f=0; f<N_DICT_FIELDS; f++) {
+    total += tables[f]->n;
+  }
+
+  /* At most half full, so probing always reaches an empty slot */
+  size = 16;
+  while (size < 2 * total) size <<= 1;
+  mask = size - 1;
+  slots = new_array(struct dictionary_slot, size);
+  for (i=0; i<size; i++) {
+    slots[i].text = NULL;
+  }
+
+  dict->n = 0;
+  dict->n_refs = total;
+  dict->first_ref = new_array(int, total + 1);
+  dict->refs = new_array(unsigned int, total + 1);
+
+  /* Find the entry for each token, counting the references to each entry */
+  for (f=0; f<N_DICT_FIELDS; f++) {
+    struct toktable *tab = tables[f];
+    entry_of[f] = new_array(int, tab->n + 1);
+    dict->field_n[f] = tab->n;
+    dict->text_bytes[f] = 0;
+    dict->enc_bytes[f] = 0;
+    for (i=0, k=0; i<tab->size; i++) {
+      struct token_slot *ts;
+      const char *text;
+      if (!tab->tokens[i]) continue;
+      ts = &tab->slots[i];
+      text = tab->tokens[i]->text;
+      dict->text_bytes[f] += 1 + ts->len;
+      dict->enc_bytes[f] += 1 + tab->tokens[i]->match0.n;
+      h = ts->hashval & mask;
+      while (slots[h].text &&
+             ((slots[h].hashval != ts->hashval) ||
+              (slots[h].len != ts->len) ||
+              memcmp(slots[h].text, text, ts->len))) {
+        h = (h + 1) & mask;
+      }
+      if (!slots[h].text) {
+        slots[h].text = text;
+        slots[h].hashval = ts->hashval;
+        slots[h].len = ts->len;
+        slots[h].entry = dict->n;
+        dict->first_ref[dict->n++] = 0;
+      }
+      e = slots[h].entry;
+      entry_of[f][k++] = e;
+      dict->first_ref[e]++;
+    }
+  }
+
+  /* Turn the counts into the position of each entry's first reference */
+  for (e=0, k=0; e<dict->n; e++) {
+    int count = dict->first_ref[e];
+    dict->first_ref[e] = k;
+    k += count;
+  }
+  dict->first_ref[dict->n] = k;
+
+  /* Fill in the references.  This advances each first_ref[e] to where entry
+   * e+1 starts, so shift them back up afterwards. */
+  for (f=0; f<N_DICT_FIELDS; f++) {
+    for (k=0; k<tables[f]->n; k++) {
+      e = entry_of[f][k];
+      dict->refs[dict->first_ref[e]++] = ((unsigned int) k << DICT_FIELD_BITS) | f;
+    }
+    free(entry_of[f]);
+  }
+  for (e=dict->n; e>0; e--) {
+    dict->first_ref[e] = dict->first_ref[e-1];
+  }
+  dict->first_ref[0] = 0;
+
+  free(slots);
+}
+/*}}}*/
+static void count_spilled_tables(struct database *db, struct dictionary *dict)/*{{{*/
+{
+  /* The word tables have been written out to disk in runs while indexing.
+   * Merge the runs once to find how big the tables and the dictionary will
+   * be; write_spilled_tables() merges them again to write them out.  The
+   * merge gives the tokens in order of their text, so the tokens belonging to
+   * one dictionary entry come together. */
+  struct spill_merge *m;
+  const struct matches *match0;
+  const char *text;
+  char *last_text = NULL;
+  int last_size = 0, last_len = -1;
+  int field, len, f;
+
+  /* The tables in memory haven't been spilled yet */
+  spill_toktables(db);
+
+  for (f=0; f<N_DICT_FIELDS; f++) {
+    dict->field_n[f] = 0;
+    dict->text_bytes[f] = 0;
+    dict->enc_bytes[f] = 0;
+  }
+  dict->n = 0;
+  dict->n_refs = 0;
+
+  m = start_spill_merge(db->spill);
+  while (next_merged_token(m, &field, &text, &len, &match0)) {
+    dict->field_n[field]++;
+    dict->text_bytes[field] += 1 + len;
+    dict->enc_bytes[field] += 1 + match0->n;
+    dict->n_refs++;
+    if ((len != last_len) || memcmp(text, last_text, len)) {
+      dict->n++;
+      if (len + 1 > last_size) {
+        last_size = len + 64;
+        last_text = grow_array(char, last_size, last_text);
+      }
+      memcpy(last_text, text, len);
+      last_len = len;
+    }
+  }
+  end_spill_merge(m);
+  if (last_text) free(last_text);
+
+  dict->first_ref = new_array(int, dict->n + 1);
+  dict->refs = new_array(unsigned int, dict->n_refs + 1);
+}
+/*}}}*/
+static char *write_spilled_tables(struct database *db, struct dictionary *dict, struct write_map *map, unsigned int *uidata, char *data, char *cdata)/*{{{*/
+{
+  /* Lay out the tables just as write_toktable() would for each field in
+   * turn, filling them in from one more merge of the runs.  The runs are kept,
+   * as this may only be a checkpoint with more messages to index after it. */
+  static const char *names[N_DICT_FIELDS] = {
+    "To", "Cc", "From", "Subject", "Body", "Attachment Name"
+  };
+  struct write_map_toktable *maps[N_DICT_FIELDS];
+  char *text_pos[N_DICT_FIELDS], *enc_pos[N_DICT_FIELDS];
+  int count[N_DICT_FIELDS];
+  struct spill_merge *m;
+  const struct matches *match0;
+  const char *text;
+  int last_len = -1, last_text_offset = 0;
+  int field, len, f, e, k;
+
+  maps[DICT_TO] = &map->to;
+  maps[DICT_CC] = &map->cc;
+  maps[DICT_FROM] = &map->from;
+  maps[DICT_SUBJECT] = &map->subject;
+  maps[DICT_BODY] = &map->body;
+  maps[DICT_ATTACHMENT_NAME] = &map->attachment_name;
+
+  for (f=0; f<N_DICT_FIELDS; f++) {
+    text_pos[f] = cdata;
+    enc_pos[f] = cdata + dict->text_bytes[f];
+    cdata = enc_pos[f] + dict->enc_bytes[f];
+    count[f] = 0;
+  }
+
+  e = -1;
+  k = 0;
+  m = start_spill_merge(db->spill);
+  while (next_merged_token(m, &field, &text, &len, &match0)) {
+    int i = count[field]++;
+    char *here = text_pos[field];
+
+    uidata[maps[field]->tok_offset + i] = here - data;
+    memcpy(here, text, len);
+    here[len] = '\0';
+    text_pos[field] += 1 + len;
+
+    uidata[maps[field]->enc_offset + i] = enc_pos[field] - data;
+    memcpy(enc_pos[field], match0->msginfo, match0->n);
+    enc_pos[field] += match0->n;
+    *enc_pos[field]++ = 0xff; /* termination character */
+
+    if ((len != last_len) || memcmp(text, data + last_text_offset, len)) {
+      dict->first_ref[++e] = k;
+      last_len = len;
+      last_text_offset = here - data;
+    }
+    dict->refs[k++] = ((unsigned int) i << DICT_FIELD_BITS) | field;
+  }
+  end_spill_merge(m);
+  assert(e + 1 == dict->n);
+  assert(k == dict->n_refs);
+  dict->first_ref[dict->n] = k;
+
+  if (verbose) {
+    for (f=0; f<N_DICT_FIELDS; f++) {
+      printf("%s: Wrote %d merged tokens (%d bytes of text, %d bytes of hit encoding)\n",
+              names[f], count[f], dict->text_bytes[f], dict->enc_bytes[f]);
+    }
+  }
+
+  return cdata;
+}
+/*}}}*/
+static void write_dictionary(struct dictionary *dict, struct write_map *map, unsigned int *uidata)/*{{{*/
+{
+  /* The token texts have already been written out with the field tables;
+   * each entry shares the copy belonging to its first reference. */
+  int tok_offset[N_DICT_FIELDS];
+  int i;
+
+  tok_offset[DICT_TO] = map->to.tok_offset;
+  tok_offset[DICT_CC] = map->cc.tok_offset;
+  tok_offset[DICT_FROM] = map->from.tok_offset;
+  tok_offset[DICT_SUBJECT] = map->subject.tok_offset;
+  tok_offset[DICT_BODY] = map->body.tok_offset;
+  tok_offset[DICT_ATTACHMENT_NAME] = map->attachment_name.tok_offset;
+
+  for (i=0; i<dict->n; i++) {
+    unsigned int ref = dict->refs[dict->first_ref[i]];
+    uidata[map->dict_tok_offset + i] =
+      uidata[tok_offset[ref & DICT_FIELD_MASK] + (ref >> DICT_FIELD_BITS)];
+  }
+  for (i=0; i<=dict->n; i++) {
+    uidata[map->dict_first_offset + i] = dict->first_ref[i];
+  }
+  for (i=0; i<dict->n_refs; i++) {
+    uidata[map->dict_refs_offset + i] = dict->refs[i];
+  }
+
+  if (verbose) {
+    printf("Dictionary: Wrote %d tokens (%d bytes of tables, %d references)\n",
+            dict->n, 4*(2*dict->n + 1 + dict->n_refs), dict->n_refs);
+  }
+}
+/*}}}*/
 void write_database(struct database *db, char *filename, int do_integrity_checks)/*{{{*/
 {
   int file_len;
@@ -580,6 +884,8 @@ void write_database(struct database *db, char *filename, int do_integrity_checks
   char *data, *cdata;
   unsigned int *uidata;
   struct write_map map;
+  struct dictionary dict;
+  char *new_filename;
 
   if (do_integrity_checks) {
     check_database_integrity(db);
@@ -590,40 +896,63 @@ void write_database(struct database *db, char *filename, int do_integrity_checks
   }
 
   /* Work out mappings */
-  compute_mapping(db, &map);
+  if (db->spill) {
+    count_spilled_tables(db, &dict);
+  } else {
+    build_dictionary(db, &dict);
+  }
+  compute_mapping(db, &dict, &map);
 
-  file_len = char_length(db) + (4 * map.beyond_last_ui_offset);
+  file_len = char_length(db, &dict) + (4 * map.beyond_last_ui_offset);
 
-  create_rw_mapping(filename, file_len, &fd, &data);
+  /* Write a new file and only rename it over the old one once it's complete,
+   * so that there's always a usable database on disc, even if mairix is
+   * stopped while writing a checkpoint. */
+  new_filename = new_array(char, strlen(filename) + 5);
+  sprintf(new_filename, "%s.new", filename);
+  create_rw_mapping(new_filename, file_len, &fd, &data);
   uidata = (unsigned int *) data; /* align(int) < align(page)! */
   cdata = data + (4 * map.beyond_last_ui_offset);
 
-  write_header(data, uidata, db, &map);
+  write_header(data, uidata, db, &dict, &map);
   cdata = write_type_and_flag_table(db, uidata, data, cdata);
   cdata = write_messages(db, &map, uidata, data, cdata);
   cdata = write_mbox_headers(db, &map, uidata, data, cdata);
   cdata = write_mbox_checksums(db, &map, uidata, data, cdata);
-  cdata = write_toktable(db->to, &map.to, uidata, data, cdata, "To");
-  cdata = write_toktable(db->cc, &map.cc, uidata, data, cdata, "Cc");
-  cdata = write_toktable(db->from, &map.from, uidata, data, cdata, "From");
-  cdata = write_toktable(db->subject, &map.subject, uidata, data, cdata, "Subject");
-  cdata = write_toktable(db->body, &map.body, uidata, data, cdata, "Body");
-  cdata = write_toktable(db->attachment_name, &map.attachment_name, uidata, data, cdata, "Attachment Name");
+  cdata = write_dirs(db, &map, uidata, data, cdata);
+  if (db->spill) {
+    cdata = write_spilled_tables(db, &dict, &map, uidata, data, cdata);
+  } else {
+    cdata = write_toktable(db->to, &map.to, uidata, data, cdata, "To");
+    cdata = write_toktable(db->cc, &map.cc, uidata, data, cdata, "Cc");
+    cdata = write_toktable(db->from, &map.from, uidata, data, cdata, "From");
+    cdata = write_toktable(db->subject, &map.subject, uidata, data, cdata, "Subject");
+    cdata = write_toktable(db->body, &map.body, uidata, data, cdata, "Body");
+    cdata = write_toktable(db->attachment_name, &map.attachment_name, uidata, data, cdata, "Attachment Name");
+  }
   cdata = write_toktable2(db->msg_ids, &map.msg_ids, uidata, data, cdata, "(Threading)");
+  write_dictionary(&dict, &map, uidata);
+  free(dict.first_ref);
+  free(dict.refs);
 
   /* Write data */
   /* Unmap / close file */
   if (munmap(data, file_len) < 0) {
-    report_error("munmap", filename);
+    report_error("munmap", new_filename);
     unlock_and_exit(2);
   }
   if (fsync(fd) < 0) {
-    report_error("fsync", filename);
+    report_error("fsync", new_filename);
     unlock_and_exit(2);
   }
   if (close(fd) < 0) {
-    report_error("close", filename);
+    report_error("close", new_filename);
+    unlock_and_exit(2);
+  }
+  if (rename(new_filename, filename) < 0) {
+    report_error("rename", filename);
     unlock_and_exit(2);
   }
+  free(new_filename);
 }
   /*}}}*/